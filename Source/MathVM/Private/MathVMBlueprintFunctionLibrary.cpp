@@ -35,21 +35,27 @@ bool MathVM::BlueprintUtility::RegisterResources(FMathVM& MathVM, const TArray<U
 	return true;
 }
 
-UMathVMResourceObject* UMathVMBlueprintFunctionLibrary::MathVMResourceObjectFromTexture2D(UTexture2D* Texture)
+UMathVMResourceObject* UMathVMBlueprintFunctionLibrary::MathVMResourceObjectFromTexture2D(UTexture2D* Texture, const bool bClampAddress)
 {
 	if (!Texture)
 	{
 		return nullptr;
 	}
 
+	TSharedRef<FMathVMTexture2DResource> TextureResource = MakeShared<FMathVMTexture2DResource>(Texture, bClampAddress ? EMathVMTextureAddress::Clamp : EMathVMTextureAddress::Wrap);
+	if (!TextureResource->IsValid())
+	{
+		return nullptr;
+	}
+
 	UMathVMResourceObject* NewResourceObject = NewObject<UMathVMResourceObject>();
 
-	NewResourceObject->SetMathVMResource(MakeShared<FMathVMTexture2DResource>(Texture));
+	NewResourceObject->SetMathVMResource(TextureResource);
 
 	return NewResourceObject;
 }
 
-UMathVMResourceObject* UMathVMBlueprintFunctionLibrary::MathVMResourceObjectFromCurveBase(UCurveBase* Curve)
+UMathVMResourceObject* UMathVMBlueprintFunctionLibrary::MathVMResourceObjectFromCurveBase(UCurveBase* Curve, const int32 BakeResolution, const double BakeTolerance)
 {
 	if (!Curve)
 	{
@@ -58,7 +64,7 @@ UMathVMResourceObject* UMathVMBlueprintFunctionLibrary::MathVMResourceObjectFrom
 
 	UMathVMResourceObject* NewResourceObject = NewObject<UMathVMResourceObject>();
 
-	NewResourceObject->SetMathVMResource(MakeShared<FMathVMCurveBaseResource>(Curve));
+	NewResourceObject->SetMathVMResource(MakeShared<FMathVMCurveBaseResource>(Curve, BakeResolution, BakeTolerance));
 
 	return NewResourceObject;
 }
@@ -77,6 +83,97 @@ UMathVMResourceObject* UMathVMBlueprintFunctionLibrary::MathVMResourceObjectAsDo
 	return NewResourceObject;
 }
 
+template<typename ArrayResourceType>
+static TSharedPtr<IMathVMResource> MakeArrayResource(const int32 ArraySize, const bool bPrivatizedAtomics)
+{
+	TSharedRef<ArrayResourceType> ArrayResource = MakeShared<ArrayResourceType>(ArraySize);
+	ArrayResource->SetPrivatized(bPrivatizedAtomics);
+	return ArrayResource;
+}
+
+UMathVMResourceObject* UMathVMBlueprintFunctionLibrary::MathVMResourceObjectAsTypedArray(const int32 ArraySize, const EMathVMArrayElementType ElementType, const bool bPrivatizedAtomics)
+{
+	if (ArraySize <= 0)
+	{
+		return nullptr;
+	}
+
+	TSharedPtr<IMathVMResource> Resource = nullptr;
+	switch (ElementType)
+	{
+	case(EMathVMArrayElementType::Double):
+		Resource = MakeArrayResource<FMathVMDoubleArrayResource>(ArraySize, bPrivatizedAtomics);
+		break;
+	case(EMathVMArrayElementType::Float):
+		Resource = MakeArrayResource<FMathVMFloatArrayResource>(ArraySize, bPrivatizedAtomics);
+		break;
+	case(EMathVMArrayElementType::Half):
+		Resource = MakeArrayResource<FMathVMHalfArrayResource>(ArraySize, bPrivatizedAtomics);
+		break;
+	case(EMathVMArrayElementType::Int32):
+		Resource = MakeArrayResource<FMathVMIntArrayResource>(ArraySize, bPrivatizedAtomics);
+		break;
+	case(EMathVMArrayElementType::NormalizedByte):
+		Resource = MakeArrayResource<FMathVMByteArrayResource>(ArraySize, bPrivatizedAtomics);
+		break;
+	default:
+		return nullptr;
+	}
+
+	UMathVMResourceObject* NewResourceObject = NewObject<UMathVMResourceObject>();
+
+	NewResourceObject->SetMathVMResource(Resource);
+
+	return NewResourceObject;
+}
+
+template<typename ElementType>
+static TSharedPtr<IMathVMResource> MakeMappedFileResource(const FString& Filename, const bool bCopyOnWrite)
+{
+	TSharedRef<TMathVMMappedFileResource<ElementType>> MappedFileResource = MakeShared<TMathVMMappedFileResource<ElementType>>(Filename, bCopyOnWrite);
+	if (!MappedFileResource->IsValid())
+	{
+		return nullptr;
+	}
+	return MappedFileResource;
+}
+
+UMathVMResourceObject* UMathVMBlueprintFunctionLibrary::MathVMResourceObjectFromMappedFile(const FString& Filename, const EMathVMArrayElementType ElementType, const bool bCopyOnWrite)
+{
+	TSharedPtr<IMathVMResource> Resource = nullptr;
+	switch (ElementType)
+	{
+	case(EMathVMArrayElementType::Double):
+		Resource = MakeMappedFileResource<double>(Filename, bCopyOnWrite);
+		break;
+	case(EMathVMArrayElementType::Float):
+		Resource = MakeMappedFileResource<float>(Filename, bCopyOnWrite);
+		break;
+	case(EMathVMArrayElementType::Half):
+		Resource = MakeMappedFileResource<FFloat16>(Filename, bCopyOnWrite);
+		break;
+	case(EMathVMArrayElementType::Int32):
+		Resource = MakeMappedFileResource<int32>(Filename, bCopyOnWrite);
+		break;
+	case(EMathVMArrayElementType::NormalizedByte):
+		Resource = MakeMappedFileResource<uint8>(Filename, bCopyOnWrite);
+		break;
+	default:
+		break;
+	}
+
+	if (!Resource)
+	{
+		return nullptr;
+	}
+
+	UMathVMResourceObject* NewResourceObject = NewObject<UMathVMResourceObject>();
+
+	NewResourceObject->SetMathVMResource(Resource);
+
+	return NewResourceObject;
+}
+
 UMathVMResourceObject* UMathVMBlueprintFunctionLibrary::MathVMResourceObjectFromDataTable(UDataTable* DataTable, const TArray<FString>& FieldNames)
 {
 	if (!DataTable || FieldNames.IsEmpty())
@@ -139,6 +236,52 @@ bool UMathVMBlueprintFunctionLibrary::MathVMRunSimpleMulti(const FString& Code,
 	return MathVM.Execute(LocalVariables, PopResults, Results, Error);
 }
 
+bool UMathVMBlueprintFunctionLibrary::MathVMRunSimpleProgram(UMathVMProgram* Program, UPARAM(ref) TMap<FString, double>& LocalVariables, const TArray<UMathVMResourceObject*>& Resources, double& Result, FString& Error)
+{
+	if (!Program)
+	{
+		Error = "Null Program";
+		return false;
+	}
+
+	FMathVM MathVM;
+
+	if (!MathVM::BlueprintUtility::RegisterResources(MathVM, Resources, Error))
+	{
+		return false;
+	}
+
+	if (!Program->Load(MathVM, Error))
+	{
+		return false;
+	}
+
+	return MathVM.ExecuteOne(LocalVariables, Result, Error);
+}
+
+bool UMathVMBlueprintFunctionLibrary::MathVMRunSimpleMultiProgram(UMathVMProgram* Program, UPARAM(ref) TMap<FString, double>& LocalVariables, const TArray<UMathVMResourceObject*>& Resources, const int32 PopResults, TArray<double>& Results, FString& Error)
+{
+	if (!Program)
+	{
+		Error = "Null Program";
+		return false;
+	}
+
+	FMathVM MathVM;
+
+	if (!MathVM::BlueprintUtility::RegisterResources(MathVM, Resources, Error))
+	{
+		return false;
+	}
+
+	if (!Program->Load(MathVM, Error))
+	{
+		return false;
+	}
+
+	return MathVM.Execute(LocalVariables, PopResults, Results, Error);
+}
+
 void UMathVMBlueprintFunctionLibrary::MathVMRun(const FString& Code, const TMap<FString, double>& GlobalVariables, const TMap<FString, double>& Constants, const TArray<UMathVMResourceObject*>& Resources, const FMathVMEvaluatedWithResult& OnEvaluated, const int32 NumSamples, const FString& SampleLocalVariable)
 {
 	if (Code.IsEmpty())
@@ -147,6 +290,33 @@ void UMathVMBlueprintFunctionLibrary::MathVMRun(const FString& Code, const TMap<
 		return;
 	}
 
+	RunAsync([Code](FMathVM& MathVM, FString& Error) -> bool
+		{
+			if (!MathVM.TokenizeAndCompile(Code))
+			{
+				Error = MathVM.GetError();
+				return false;
+			}
+			return true;
+		}, GlobalVariables, Constants, Resources, OnEvaluated, NumSamples, SampleLocalVariable);
+}
+
+void UMathVMBlueprintFunctionLibrary::MathVMRunProgram(UMathVMProgram* Program, const TMap<FString, double>& GlobalVariables, const TMap<FString, double>& Constants, const TArray<UMathVMResourceObject*>& Resources, const FMathVMEvaluatedWithResult& OnEvaluated, const int32 NumSamples, const FString& SampleLocalVariable)
+{
+	if (!Program)
+	{
+		OnEvaluated.ExecuteIfBound(FMathVMEvaluationResult("Null Program"));
+		return;
+	}
+
+	RunAsync([Program](FMathVM& MathVM, FString& Error) -> bool
+		{
+			return Program->Load(MathVM, Error);
+		}, GlobalVariables, Constants, Resources, OnEvaluated, NumSamples, SampleLocalVariable);
+}
+
+void UMathVMBlueprintFunctionLibrary::RunAsync(TFunction<bool(FMathVM& MathVM, FString& Error)> Compile, const TMap<FString, double>& GlobalVariables, const TMap<FString, double>& Constants, const TArray<UMathVMResourceObject*>& Resources, const FMathVMEvaluatedWithResult& OnEvaluated, const int32 NumSamples, const FString& SampleLocalVariable)
+{
 	if (NumSamples < 1)
 	{
 		OnEvaluated.ExecuteIfBound(FMathVMEvaluationResult("Invalid NumThreads"));
@@ -186,21 +356,33 @@ void UMathVMBlueprintFunctionLibrary::MathVMRun(const FString& Code, const TMap<
 		return;
 	}
 
-	if (!MathVM->TokenizeAndCompile(Code))
+	FString CompileError;
+	if (!Compile(*MathVM, CompileError))
 	{
-		OnEvaluated.ExecuteIfBound(FMathVMEvaluationResult(MathVM->GetError()));
+		OnEvaluated.ExecuteIfBound(FMathVMEvaluationResult(CompileError));
 		return;
 	}
 
-	Async(EAsyncExecution::Thread, [MathVM, NumSamples, GlobalVariables, SampleLocalVariable, OnEvaluated]()
+	// only global variables are reported, so statements computing unused locals are skipped
+	const int32 Variant = MathVM->GetProgramVariant({}, 0);
+	const int32 SampleLocalVariableIndex = MathVM->GetVariableIndex(SampleLocalVariable);
+
+	Async(EAsyncExecution::Thread, [MathVM, NumSamples, Variant, SampleLocalVariableIndex, OnEvaluated]()
 		{
 			ParallelFor(NumSamples, [&](const int32 ThreadId)
 				{
-					TMap<FString, double> LocalVariables;
-					LocalVariables.Add(SampleLocalVariable, ThreadId);
-					MathVM->ExecuteStealth(LocalVariables);
+					FMathVMLocals Locals;
+					Locals.Init(MathVM->GetNumVariables());
+					Locals.SetVariable(SampleLocalVariableIndex, ThreadId);
+
+					TArray<double> Results;
+					FString Error;
+					MathVM->ExecuteVariant(Variant, Locals, 0, Results, Error);
 				});
 
+			// merge privatized resources updates
+			MathVM->FlushResources();
+
 			FGraphEventRef Task = FFunctionGraphTask::CreateAndDispatchWhenReady([&]()
 				{
 					OnEvaluated.ExecuteIfBound(FMathVMEvaluationResult(MathVM->GetGlobalVariables()));
@@ -303,38 +485,55 @@ void UMathVMBlueprintFunctionLibrary::MathVMPlotter(UObject* WorldContextObject,
 		}
 	}
 
+	// only the statements required by the plotted variables are evaluated
+	TArray<FString> PlottedVariables;
+	VariablesToPlot.GetKeys(PlottedVariables);
+	const int32 Variant = MathVM.GetProgramVariant(PlottedVariables, 0);
+
+	TArray<int32> PlottedIndices;
+	TArray<TArray<FVector2D>*> PlottedPoints;
+	for (const FString& PlottedVariable : PlottedVariables)
+	{
+		PlottedIndices.Add(MathVM.GetVariableIndex(PlottedVariable));
+		PlottedPoints.Add(&Points[PlottedVariable]);
+	}
+
+	const int32 SampleLocalVariableIndex = MathVM.GetVariableIndex(SampleLocalVariable);
+
 	FString ErrorZero;
 
 	ParallelFor(NumSamples, [&](const int32 SampleIndex)
 		{
 			const double X = FMath::GetMappedRangeValueUnclamped(FVector2D(0, NumSamples - 1), FVector2D(PlotterConfig.BorderSize.Left + PlotterConfig.BorderThickness, TextureWidth - 1 - PlotterConfig.BorderSize.Right - PlotterConfig.BorderThickness), SampleIndex);
 
-			TMap<FString, double> LocalVariables;
-			LocalVariables.Add(SampleLocalVariable, SampleIndex);
+			FMathVMLocals Locals;
+			Locals.Init(MathVM.GetNumVariables());
+			Locals.SetVariable(SampleLocalVariableIndex, SampleIndex);
 
-			bool bSuccess = false;
-			if (SampleIndex == 0)
+			TArray<double> Results;
+			FString Error;
+			const bool bSuccess = MathVM.ExecuteVariant(Variant, Locals, 0, Results, Error);
+			if (!bSuccess && SampleIndex == 0)
 			{
-				bSuccess = MathVM.ExecuteAndDiscard(LocalVariables, ErrorZero);
-			}
-			else
-			{
-				bSuccess = MathVM.ExecuteStealth(LocalVariables);
+				ErrorZero = Error;
 			}
 
 			if (bSuccess)
 			{
-				for (const TPair<FString, FMathVMPlot>& Pair : VariablesToPlot)
+				for (int32 PlottedIndex = 0; PlottedIndex < PlottedIndices.Num(); PlottedIndex++)
 				{
-					if (LocalVariables.Contains(Pair.Key))
+					double Value = 0;
+					if (Locals.GetVariable(PlottedIndices[PlottedIndex], Value))
 					{
-						const double Y = FMath::GetMappedRangeValueUnclamped(FVector2D(DomainMin, DomainMax), FVector2D(PlotterConfig.BorderSize.Bottom + PlotterConfig.BorderThickness, TextureHeight - 1 - PlotterConfig.BorderSize.Top - PlotterConfig.BorderThickness), FMath::Clamp(LocalVariables[Pair.Key], DomainMin, DomainMax));
-						Points[Pair.Key][SampleIndex] = FVector2D(X, (TextureHeight - 1 - PlotterConfig.BorderSize.Top - PlotterConfig.BorderThickness) - Y + PlotterConfig.BorderSize.Bottom + PlotterConfig.BorderThickness);
+						const double Y = FMath::GetMappedRangeValueUnclamped(FVector2D(DomainMin, DomainMax), FVector2D(PlotterConfig.BorderSize.Bottom + PlotterConfig.BorderThickness, TextureHeight - 1 - PlotterConfig.BorderSize.Top - PlotterConfig.BorderThickness), FMath::Clamp(Value, DomainMin, DomainMax));
+						(*PlottedPoints[PlottedIndex])[SampleIndex] = FVector2D(X, (TextureHeight - 1 - PlotterConfig.BorderSize.Top - PlotterConfig.BorderThickness) - Y + PlotterConfig.BorderSize.Bottom + PlotterConfig.BorderThickness);
 					}
 				}
 			}
 		});
 
+	MathVM.FlushResources();
+
 	if (!ErrorZero.IsEmpty())
 	{
 		OnPlotGenerated.ExecuteIfBound(nullptr, FMathVMEvaluationResult(ErrorZero));
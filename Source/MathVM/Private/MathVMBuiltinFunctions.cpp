@@ -7,6 +7,139 @@ namespace MathVM
 {
 	namespace BuiltinFunctions
 	{
+		// script values are checked before the conversion (casting NaN or out of range doubles to int32 is undefined)
+		static bool ToInt32(const double Value, int32& Result)
+		{
+			if (!(Value >= static_cast<double>(MIN_int32) && Value <= static_cast<double>(MAX_int32)))
+			{
+				return false;
+			}
+			Result = static_cast<int32>(Value);
+			return true;
+		}
+
+		static bool GetResourceRange(FMathVMCallContext& CallContext, const TCHAR* Name, const double FromValue, const double ToValue, int32& From, int32& To, int32& NumElements)
+		{
+			if (!ToInt32(FromValue, From) || !ToInt32(ToValue, To))
+			{
+				return CallContext.SetError(FString::Printf(TEXT("%s range (%f, %f) is out of bounds"), Name, FromValue, ToValue));
+			}
+
+			// the difference of two int32 can overflow
+			const int64 NumElements64 = FMath::Max<int64>(static_cast<int64>(To) - From, 0);
+			if (NumElements64 > MAX_int32)
+			{
+				return CallContext.SetError(FString::Printf(TEXT("%s range (%d, %d) is out of bounds"), Name, From, To));
+			}
+
+			NumElements = static_cast<int32>(NumElements64);
+			return true;
+		}
+
+		// the fallback reads each element, so the range is capped like the ones of sum() and prod()
+		static bool CheckFallbackRange(FMathVMCallContext& CallContext, const TCHAR* Name, const int32 NumElements)
+		{
+			if (NumElements > CallContext.MathVM.GetMaxRangeIterations())
+			{
+				return CallContext.SetError(FString::Printf(TEXT("%s range of %d elements exceeds the limit of %d"), Name, NumElements, CallContext.MathVM.GetMaxRangeIterations()));
+			}
+			return true;
+		}
+
+		static bool ReduceResource(FMathVMCallContext& CallContext, const TCHAR* Name, const EMathVMResourceReduction Reduction, const TArray<double>& Args, double& Result, int32& NumElements)
+		{
+			if (Args.Num() < 3)
+			{
+				return CallContext.SetError(FString::Printf(TEXT("%s expects at least 3 arguments"), Name));
+			}
+
+			int32 From = 0;
+			int32 To = 0;
+			if (!GetResourceRange(CallContext, Name, Args[1], Args[2], From, To, NumElements))
+			{
+				return false;
+			}
+
+			if (NumElements == 0 && Reduction != EMathVMResourceReduction::Sum)
+			{
+				return CallContext.SetError(FString::Printf(TEXT("%s expects a non empty range"), Name));
+			}
+
+			Result = 0;
+
+			int32 ResourceIndex = -1;
+			TSharedPtr<IMathVMResource> Resource = ToInt32(Args[0], ResourceIndex) ? CallContext.MathVM.GetResource(ResourceIndex) : nullptr;
+			if (!Resource || NumElements == 0)
+			{
+				return true;
+			}
+
+			// additional coordinates after the range
+			const TArray<double> ExtraArgs(Args.GetData() + 3, Args.Num() - 3);
+			if (Resource->Reduce(Reduction, From, To, ExtraArgs, Result))
+			{
+				return true;
+			}
+
+			if (!CheckFallbackRange(CallContext, Name, NumElements))
+			{
+				return false;
+			}
+
+			// fallback, a single args array is reused for each element
+			TArray<double> ResourceArgs;
+			ResourceArgs.Add(From);
+			ResourceArgs.Append(ExtraArgs);
+
+			Result = Resource->Read(ResourceArgs);
+			for (int32 Index = From + 1; Index < To; Index++)
+			{
+				ResourceArgs[0] = Index;
+				const double Value = Resource->Read(ResourceArgs);
+				switch (Reduction)
+				{
+				case(EMathVMResourceReduction::Sum):
+					Result += Value;
+					break;
+				case(EMathVMResourceReduction::Min):
+					Result = FMath::Min(Result, Value);
+					break;
+				case(EMathVMResourceReduction::Max):
+					Result = FMath::Max(Result, Value);
+					break;
+				default:
+					break;
+				}
+			}
+
+			return true;
+		}
+
+		static bool AtomicResource(FMathVMCallContext& CallContext, const TCHAR* Name, const EMathVMResourceAtomic Operation, const TArray<double>& Args)
+		{
+			if (Args.Num() < 2)
+			{
+				return CallContext.SetError(FString::Printf(TEXT("%s expects at least 2 arguments"), Name));
+			}
+
+			const int32 ResourceIndex = static_cast<int32>(Args[0]);
+			IMathVMResource* Resource = CallContext.MathVM.GetRawResource(ResourceIndex);
+			if (!Resource)
+			{
+				return CallContext.PushResult(0);
+			}
+
+			const TArray<double> InterfaceArgs(Args.GetData() + 1, Args.Num() - 1);
+
+			double Result = 0;
+			if (!Resource->Atomic(Operation, InterfaceArgs, Result))
+			{
+				return CallContext.SetError(FString::Printf(TEXT("Resource %d does not support %s"), ResourceIndex, Name));
+			}
+
+			return CallContext.PushResult(Result);
+		}
+
 		bool Abs(MATHVM_ARGS)
 		{
 			MATHVM_RETURN(FMath::Abs(Args[0]));
@@ -66,6 +199,16 @@ namespace MathVM
 			MATHVM_RETURN(FMath::Cos(Args[0]));
 		}
 
+		bool Cross(MATHVM_ARGS)
+		{
+			if (Args.Num() != 6)
+			{
+				MATHVM_ERROR("cross expects two 3 components vectors");
+			}
+
+			MATHVM_RETURN(FMathVMVector(FVector::CrossProduct(FVector(Args[0], Args[1], Args[2]), FVector(Args[3], Args[4], Args[5]))));
+		}
+
 		bool Degrees(MATHVM_ARGS)
 		{
 			MATHVM_RETURN(FMath::RadiansToDegrees(Args[0]));
@@ -355,6 +498,34 @@ namespace MathVM
 			MATHVM_RETURN(FMath::Fmod(Args[0], Args[1]));
 		}
 
+		bool Normalize(MATHVM_ARGS)
+		{
+			if (Args.Num() < 1 || Args.Num() > 4)
+			{
+				MATHVM_ERROR("normalize expects a vector of 1 to 4 components");
+			}
+
+			double TotalLength = 0;
+			for (const double Arg : Args)
+			{
+				TotalLength += Arg * Arg;
+			}
+
+			FMathVMVector Result;
+			Result.NumComponents = Args.Num();
+
+			if (TotalLength > 0)
+			{
+				const double InvLength = 1.0 / FMath::Sqrt(TotalLength);
+				for (int32 ComponentIndex = 0; ComponentIndex < Args.Num(); ComponentIndex++)
+				{
+					Result.Value[ComponentIndex] = Args[ComponentIndex] * InvLength;
+				}
+			}
+
+			MATHVM_RETURN(Result);
+		}
+
 		bool Not(MATHVM_ARGS)
 		{
 			MATHVM_RETURN(Args[0] == 0.0 ? 1 : 0);
@@ -365,6 +536,12 @@ namespace MathVM
 			MATHVM_RETURN(FMath::Pow(Args[0], Args[1]));
 		}
 
+		// sum() and prod() are compiled to loops, the functions are only placeholders for the tokenizer
+		bool Prod(MATHVM_ARGS)
+		{
+			MATHVM_ERROR("prod() cannot be called directly");
+		}
+
 		bool Radians(MATHVM_ARGS)
 		{
 			MATHVM_RETURN(FMath::DegreesToRadians(Args[0]));
@@ -386,6 +563,12 @@ namespace MathVM
 			MATHVM_RETURN(FMath::RoundHalfToEven(Args[0]));
 		}
 
+		// eager version, select() and if() calls are compiled to conditional jumps
+		bool Select(MATHVM_ARGS)
+		{
+			MATHVM_RETURN(Args[0] != 0 ? Args[1] : Args[2]);
+		}
+
 		bool Sign(MATHVM_ARGS)
 		{
 			MATHVM_RETURN(FMath::Sign(Args[0]));
@@ -401,6 +584,11 @@ namespace MathVM
 			MATHVM_RETURN(FMath::Sqrt(Args[0]));
 		}
 
+		bool Sum(MATHVM_ARGS)
+		{
+			MATHVM_ERROR("sum() cannot be called directly");
+		}
+
 		bool Tan(MATHVM_ARGS)
 		{
 			MATHVM_RETURN(FMath::Tan(Args[0]));
@@ -411,6 +599,38 @@ namespace MathVM
 			MATHVM_RETURN(FMath::TruncToDouble(Args[0]));
 		}
 
+		// Vectors
+
+		bool Vec2(MATHVM_ARGS)
+		{
+			if (Args.Num() != 2)
+			{
+				MATHVM_ERROR("vec2 expects 2 components");
+			}
+
+			MATHVM_RETURN(FMathVMVector(FVector2D(Args[0], Args[1])));
+		}
+
+		bool Vec3(MATHVM_ARGS)
+		{
+			if (Args.Num() != 3)
+			{
+				MATHVM_ERROR("vec3 expects 3 components");
+			}
+
+			MATHVM_RETURN(FMathVMVector(FVector(Args[0], Args[1], Args[2])));
+		}
+
+		bool Vec4(MATHVM_ARGS)
+		{
+			if (Args.Num() != 4)
+			{
+				MATHVM_ERROR("vec4 expects 4 components");
+			}
+
+			MATHVM_RETURN(FMathVMVector(FVector4(Args[0], Args[1], Args[2], Args[3])));
+		}
+
 		// Resources
 
 		bool Read(MATHVM_ARGS)
@@ -420,15 +640,38 @@ namespace MathVM
 				MATHVM_ERROR("read expects at least 1 argument");
 			};
 
-			TArray<double> InterfaceArgs;
-			for (int32 Index = 1; Index < Args.Num(); Index++)
-			{
-				InterfaceArgs.Add(Args[Index]);
-			}
+			const TArray<double> InterfaceArgs(Args.GetData() + 1, Args.Num() - 1);
 
 			MATHVM_RETURN(CallContext.ReadResource(static_cast<int32>(Args[0]), InterfaceArgs));
 		}
 
+		bool Sample(MATHVM_ARGS)
+		{
+			if (Args.Num() < 1)
+			{
+				MATHVM_ERROR("sample expects at least 1 argument");
+			};
+
+			const TArray<double> InterfaceArgs(Args.GetData() + 1, Args.Num() - 1);
+
+			MATHVM_RETURN(CallContext.SampleResource(static_cast<int32>(Args[0]), InterfaceArgs));
+		}
+
+		bool AtomicAdd(MATHVM_ARGS)
+		{
+			return AtomicResource(CallContext, TEXT("atomic_add"), EMathVMResourceAtomic::Add, Args);
+		}
+
+		bool AtomicMin(MATHVM_ARGS)
+		{
+			return AtomicResource(CallContext, TEXT("atomic_min"), EMathVMResourceAtomic::Min, Args);
+		}
+
+		bool AtomicMax(MATHVM_ARGS)
+		{
+			return AtomicResource(CallContext, TEXT("atomic_max"), EMathVMResourceAtomic::Max, Args);
+		}
+
 		bool Write(MATHVM_ARGS)
 		{
 			if (Args.Num() < 1)
@@ -436,14 +679,107 @@ namespace MathVM
 				MATHVM_ERROR("write expects at least 1 argument");
 			};
 
-			TArray<double> InterfaceArgs;
-			for (int32 Index = 1; Index < Args.Num(); Index++)
-			{
-				InterfaceArgs.Add(Args[Index]);
-			}
+			const TArray<double> InterfaceArgs(Args.GetData() + 1, Args.Num() - 1);
 
 			CallContext.WriteResource(static_cast<int32>(Args[0]), InterfaceArgs);
 			return true;
 		}
+
+		bool SumOf(MATHVM_ARGS)
+		{
+			double Result = 0;
+			int32 NumElements = 0;
+			if (!ReduceResource(CallContext, TEXT("sum_of"), EMathVMResourceReduction::Sum, Args, Result, NumElements))
+			{
+				return false;
+			}
+
+			MATHVM_RETURN(Result);
+		}
+
+		bool MinOf(MATHVM_ARGS)
+		{
+			double Result = 0;
+			int32 NumElements = 0;
+			if (!ReduceResource(CallContext, TEXT("min_of"), EMathVMResourceReduction::Min, Args, Result, NumElements))
+			{
+				return false;
+			}
+
+			MATHVM_RETURN(Result);
+		}
+
+		bool MaxOf(MATHVM_ARGS)
+		{
+			double Result = 0;
+			int32 NumElements = 0;
+			if (!ReduceResource(CallContext, TEXT("max_of"), EMathVMResourceReduction::Max, Args, Result, NumElements))
+			{
+				return false;
+			}
+
+			MATHVM_RETURN(Result);
+		}
+
+		bool MeanOf(MATHVM_ARGS)
+		{
+			double Result = 0;
+			int32 NumElements = 0;
+			if (!ReduceResource(CallContext, TEXT("mean_of"), EMathVMResourceReduction::Sum, Args, Result, NumElements))
+			{
+				return false;
+			}
+
+			if (NumElements == 0)
+			{
+				MATHVM_ERROR("mean_of expects a non empty range");
+			}
+
+			MATHVM_RETURN(Result / NumElements);
+		}
+
+		bool DotOf(MATHVM_ARGS)
+		{
+			int32 From = 0;
+			int32 To = 0;
+			int32 NumElements = 0;
+			if (!GetResourceRange(CallContext, TEXT("dot_of"), Args[2], Args[3], From, To, NumElements))
+			{
+				return false;
+			}
+
+			int32 ResourceIndexA = -1;
+			int32 ResourceIndexB = -1;
+			TSharedPtr<IMathVMResource> ResourceA = ToInt32(Args[0], ResourceIndexA) ? CallContext.MathVM.GetResource(ResourceIndexA) : nullptr;
+			TSharedPtr<IMathVMResource> ResourceB = ToInt32(Args[1], ResourceIndexB) ? CallContext.MathVM.GetResource(ResourceIndexB) : nullptr;
+			if (!ResourceA || !ResourceB)
+			{
+				MATHVM_RETURN(0);
+			}
+
+			TConstArrayView<double> LinearViewA = ResourceA->GetLinearView();
+			TConstArrayView<double> LinearViewB = ResourceB->GetLinearView();
+			if (From >= 0 && From < To && To <= LinearViewA.Num() && To <= LinearViewB.Num())
+			{
+				MATHVM_RETURN(MathVM::Utils::Dot(LinearViewA.Slice(From, To - From), LinearViewB.Slice(From, To - From)));
+			}
+
+			if (!CheckFallbackRange(CallContext, TEXT("dot_of"), NumElements))
+			{
+				return false;
+			}
+
+			TArray<double> ResourceArgs;
+			ResourceArgs.AddUninitialized(1);
+
+			double Result = 0;
+			for (int32 Index = From; Index < To; Index++)
+			{
+				ResourceArgs[0] = Index;
+				Result += ResourceA->Read(ResourceArgs) * ResourceB->Read(ResourceArgs);
+			}
+
+			MATHVM_RETURN(Result);
+		}
 	}
 }
\ No newline at end of file
@@ -2,125 +2,186 @@
 
 #include "MathVMBuiltinFunctions.h"
 
-FMathVMBase::FMathVMBase()
+namespace MathVM
 {
-	OperatorAdd = [](FMathVMCallContext& CallContext) -> bool
+	namespace Operators
+	{
+		// applies a binary operator component-wise (scalars are broadcasted to vectors)
+		template<typename OperatorType>
+		bool ComponentWise(FMathVMCallContext& CallContext, OperatorType Operator)
 		{
-			double A = 0, B = 0;
-			if (!CallContext.PopArgument(B))
+			FMathVMVector A, B;
+			if (!CallContext.PopVector(B))
 			{
 				return false;
 			}
-			if (!CallContext.PopArgument(A))
+			if (!CallContext.PopVector(A))
 			{
 				return false;
 			}
 
-			return CallContext.PushResult(A + B);
-		};
+			if (A.NumComponents == 1 && B.NumComponents == 1)
+			{
+				double Result = 0;
+				if (!Operator(CallContext, A.Value.X, B.Value.X, Result))
+				{
+					return false;
+				}
+				return CallContext.PushResult(Result);
+			}
 
-	OperatorSub = [](FMathVMCallContext& CallContext) -> bool
-		{
-			double A = 0, B = 0;
-			if (!CallContext.PopArgument(B))
+			if (A.NumComponents > 1 && B.NumComponents > 1 && A.NumComponents != B.NumComponents)
 			{
-				return false;
+				return CallContext.SetError(FString::Printf(TEXT("Vector size mismatch (%d and %d)"), A.NumComponents, B.NumComponents));
 			}
-			if (!CallContext.PopArgument(A))
+
+			FMathVMVector Result;
+			Result.NumComponents = FMath::Max(A.NumComponents, B.NumComponents);
+			for (int32 ComponentIndex = 0; ComponentIndex < Result.NumComponents; ComponentIndex++)
 			{
-				return false;
+				const double ComponentA = A.NumComponents == 1 ? A.Value.X : A.Value[ComponentIndex];
+				const double ComponentB = B.NumComponents == 1 ? B.Value.X : B.Value[ComponentIndex];
+				if (!Operator(CallContext, ComponentA, ComponentB, Result.Value[ComponentIndex]))
+				{
+					return false;
+				}
 			}
 
-			return CallContext.PushResult(A - B);
+			return CallContext.PushResult(Result);
+		}
+	}
+}
+
+FMathVMBase::FMathVMBase()
+{
+	OperatorAdd = [](FMathVMCallContext& CallContext) -> bool
+		{
+			return MathVM::Operators::ComponentWise(CallContext, [](FMathVMCallContext&, const double A, const double B, double& Result)
+				{
+					Result = A + B;
+					return true;
+				});
 		};
 
-	OperatorMul = [](FMathVMCallContext& CallContext) -> bool
+	OperatorSub = [](FMathVMCallContext& CallContext) -> bool
 		{
-			double A = 0, B = 0;
-			if (!CallContext.PopArgument(B))
-			{
-				return false;
-			}
-			if (!CallContext.PopArgument(A))
-			{
-				return false;
-			}
+			return MathVM::Operators::ComponentWise(CallContext, [](FMathVMCallContext&, const double A, const double B, double& Result)
+				{
+					Result = A - B;
+					return true;
+				});
+		};
 
-			return CallContext.PushResult(A * B);
+	OperatorMul = [](FMathVMCallContext& CallContext) -> bool
+		{
+			return MathVM::Operators::ComponentWise(CallContext, [](FMathVMCallContext&, const double A, const double B, double& Result)
+				{
+					Result = A * B;
+					return true;
+				});
 		};
 
 	OperatorDiv = [](FMathVMCallContext& CallContext) -> bool
 		{
-			double A = 0, B = 0;
-			if (!CallContext.PopArgument(B))
-			{
-				return false;
-			}
-
-			if (B == 0.0)
-			{
-				return CallContext.SetError("Division by zero");
-			}
+			return MathVM::Operators::ComponentWise(CallContext, [](FMathVMCallContext& CallContext, const double A, const double B, double& Result)
+				{
+					if (B == 0.0)
+					{
+						return CallContext.SetError("Division by zero");
+					}
 
-			if (!CallContext.PopArgument(A))
-			{
-				return false;
-			}
-
-			return CallContext.PushResult(A / B);
+					Result = A / B;
+					return true;
+				});
 		};
 
 	OperatorMod = [](FMathVMCallContext& CallContext) -> bool
 		{
-			double A = 0, B = 0;
-			if (!CallContext.PopArgument(B))
-			{
-				return false;
-			}
-			if (!CallContext.PopArgument(A))
-			{
-				return false;
-			}
-
-			return CallContext.PushResult(static_cast<int64>(A) % static_cast<int64>(B));
+			return MathVM::Operators::ComponentWise(CallContext, [](FMathVMCallContext&, const double A, const double B, double& Result)
+				{
+					Result = static_cast<int64>(A) % static_cast<int64>(B);
+					return true;
+				});
 		};
 
 	OperatorAssign = [](FMathVMCallContext& CallContext) -> bool
 		{
-			FString A;
-			double B = 0;
+			int32 SymbolIndex = -1;
+			FMathVMVector Vector;
 
-			if (!CallContext.PopArgument(B))
+			if (!CallContext.PopVector(Vector))
 			{
 				return false;
 			}
-			if (!CallContext.PopName(A))
+			if (!CallContext.PopSymbol(SymbolIndex))
 			{
 				return false;
 			}
 
-			if (CallContext.LocalVariables.Contains(A))
+			const FMathVMSymbolBinding& Binding = CallContext.MathVM.GetSymbolBinding(SymbolIndex);
+			FMathVMVector& Local = CallContext.Locals.Values[Binding.Variable];
+
+			if (Vector.NumComponents > 1)
 			{
-				CallContext.LocalVariables[A] = B;
+				if (Local.NumComponents == 1 || Binding.GlobalVariable >= 0)
+				{
+					return CallContext.SetError(FString::Printf(TEXT("Unable to assign a vector to the scalar variable \"%s\""), *CallContext.MathVM.GetSymbolName(SymbolIndex)));
+				}
+
+				if (Local.NumComponents == 0 && Binding.GlobalVector >= 0)
+				{
+					CallContext.MathVM.SetGlobalVector(Binding.GlobalVector, Vector);
+				}
+				else
+				{
+					Local = Vector;
+				}
+
+				return true;
+			}
+
+			if (Local.NumComponents > 1 || Binding.GlobalVector >= 0)
+			{
+				return CallContext.SetError(FString::Printf(TEXT("Unable to assign a scalar to the vector variable \"%s\""), *CallContext.MathVM.GetSymbolName(SymbolIndex)));
 			}
-			else if (CallContext.MathVM.HasGlobalVariable(A))
+
+			const double B = Vector.Value.X;
+
+			if (Local.NumComponents == 0 && Binding.GlobalVariable >= 0)
 			{
-				CallContext.MathVM.SetGlobalVariable(A, B);
+				// globals assigned by the program are never baked, so the globals version is not bumped
+				CallContext.MathVM.GlobalVariables[Binding.GlobalVariable] = B;
 			}
 			else
 			{
-				CallContext.LocalVariables.Add(A, B);
+				Local = FMathVMVector(B);
 			}
 
 			return true;
 		};
 }
 
+FMathVMBase::~FMathVMBase()
+{
+	// the pending optimization references the VM
+	WaitForPromotion();
+}
+
 const FString& FMathVMBase::GetError() const
 {
 	return LastError;
 }
 
+void FMathVMBase::SetMaxRangeIterations(const int32 NumIterations)
+{
+	MaxRangeIterations = NumIterations;
+}
+
+int32 FMathVMBase::GetMaxRangeIterations() const
+{
+	return MaxRangeIterations;
+}
+
 bool FMathVMBase::SetError(const FString& InError)
 {
 	LastError = InError;
@@ -143,12 +204,153 @@ bool FMathVMBase::RegisterFunction(const FString& Name, FMathVMFunction Callable
 		Functions.Add(Name, { Callable, NumArgs });
 	}
 
+	// an overridden resource function cannot be bound anymore
+	ResourceFunctions.Remove(Name);
+	PureFunctions.Remove(Name);
+	SelectFunctions.Remove(Name);
+	RangeFunctions.Remove(Name);
+	// the name would not be tokenized as a call to the inline function anymore
+	InlineFunctions.Remove(Name);
+	// already compiled programs keep the previous function
+	ProgramFunctionIndices.Remove(Name);
+
 	return true;
 }
 
+bool FMathVMBase::RegisterInlineFunctions(const FString& Code)
+{
+	// the background optimization reads the symbols table
+	WaitForPromotion();
+
+	// the library is parsed in a scratch state, the pending tokens and the symbols they reference are preserved
+	TArray<FMathVMToken> PendingTokens = MoveTemp(Tokens);
+	const int32 NumSymbols = Symbols.Num();
+
+	// def statements are removed by the tokenizer
+	bool bSuccess = TokenizeSource(Code);
+	for (int32 TokenIndex = 0; bSuccess && TokenIndex < Tokens.Num(); TokenIndex++)
+	{
+		if (Tokens[TokenIndex].TokenType != EMathVMTokenType::Semicolon)
+		{
+			bSuccess = SetError("Only def statements are allowed in inline functions libraries");
+		}
+	}
+
+	// the bodies of inline functions reference symbols by name
+	Tokens = MoveTemp(PendingTokens);
+	Symbols.Truncate(NumSymbols);
+	if (SymbolBindings.Num() > Symbols.Num())
+	{
+		BindSymbols();
+	}
+
+	return bSuccess;
+}
+
+bool FMathVMBase::HasInlineFunction(const FString& Name) const
+{
+	return InlineFunctions.Contains(Name);
+}
+
+bool FMathVMBase::RegisterResourceFunction(const FString& Name, FMathVMFunction Callable, const int32 NumArgs, const EMathVMResourceFunction ResourceFunction)
+{
+	if (!RegisterFunction(Name, Callable, NumArgs))
+	{
+		return false;
+	}
+
+	ResourceFunctions.Add(Name, ResourceFunction);
+
+	if (ResourceFunction == EMathVMResourceFunction::Read || ResourceFunction == EMathVMResourceFunction::Sample || ResourceFunction == EMathVMResourceFunction::Reduce)
+	{
+		PureFunctions.Add(Name);
+	}
+
+	return true;
+}
+
+bool FMathVMBase::RegisterPureFunction(const FString& Name, FMathVMFunction Callable, const int32 NumArgs)
+{
+	if (!RegisterFunction(Name, Callable, NumArgs))
+	{
+		return false;
+	}
+
+	PureFunctions.Add(Name);
+	return true;
+}
+
+int32 FMathVMBase::AddProgramFunction(const FString& Name, const int32 ResourceIndex, FMathVMFunction BoundFunction)
+{
+	if (BoundFunction)
+	{
+		// bound functions are variadic (the signature has been already validated by the compiler)
+		FMathVMProgramFunction ProgramFunction;
+		ProgramFunction.Name = Name;
+		ProgramFunction.Function = MoveTemp(BoundFunction);
+		ProgramFunction.ResourceIndex = ResourceIndex;
+		ProgramFunction.bPure = PureFunctions.Contains(Name);
+		return ProgramFunctions.Add(MoveTemp(ProgramFunction));
+	}
+
+	if (const int32* Index = ProgramFunctionIndices.Find(Name))
+	{
+		return *Index;
+	}
+
+	const TPair<FMathVMFunction, int32>* Function = Functions.Find(Name);
+	if (!Function)
+	{
+		return -1;
+	}
+
+	FMathVMProgramFunction ProgramFunction;
+	ProgramFunction.Name = Name;
+	ProgramFunction.Function = Function->Key;
+	ProgramFunction.NumArgs = Function->Value;
+	ProgramFunction.bPure = PureFunctions.Contains(Name);
+
+	const int32 NewIndex = ProgramFunctions.Add(MoveTemp(ProgramFunction));
+	ProgramFunctionIndices.Add(Name, NewIndex);
+	return NewIndex;
+}
+
+const FMathVMProgramFunction& FMathVMBase::GetProgramFunction(const int32 Index) const
+{
+	return ProgramFunctions[Index];
+}
+
+const FString& FMathVMBase::GetSymbolName(const int32 Index) const
+{
+	return Symbols.GetName(Index);
+}
+
+bool FMathVMBase::CallOperator(FMathVMCallContext& CallContext, const EMathVMOperator Operator) const
+{
+	switch (Operator)
+	{
+	case(EMathVMOperator::Add):
+		return OperatorAdd(CallContext);
+	case(EMathVMOperator::Sub):
+		return OperatorSub(CallContext);
+	case(EMathVMOperator::Mul):
+		return OperatorMul(CallContext);
+	case(EMathVMOperator::Div):
+		return OperatorDiv(CallContext);
+	case(EMathVMOperator::Mod):
+		return OperatorMod(CallContext);
+	case(EMathVMOperator::Assign):
+		return OperatorAssign(CallContext);
+	default:
+		break;
+	}
+
+	return CallContext.SetError("Unknown operator");
+}
+
 bool FMathVMBase::HasGlobalVariable(const FString& Name) const
 {
-	return GlobalVariables.Contains(Name);
+	return GlobalVariableIndices.Contains(Name);
 }
 
 bool FMathVMBase::HasConst(const FString& Name) const
@@ -158,17 +360,133 @@ bool FMathVMBase::HasConst(const FString& Name) const
 
 void FMathVMBase::SetGlobalVariable(const FString& Name, const double Value)
 {
-	GlobalVariables[Name] = Value;
+	SetGlobalVariable(GlobalVariableIndices[Name], Value);
 }
 
 double FMathVMBase::GetGlobalVariable(const FString& Name) const
 {
-	return GlobalVariables[Name];
+	return GlobalVariables[GlobalVariableIndices[Name]];
+}
+
+int32 FMathVMBase::GetGlobalVariableIndex(const FString& Name) const
+{
+	if (const int32* Index = GlobalVariableIndices.Find(Name))
+	{
+		return *Index;
+	}
+
+	return -1;
+}
+
+void FMathVMBase::SetGlobalVariable(const int32 Index, const double Value)
+{
+	GlobalVariables[Index] = Value;
+	GlobalsVersion.fetch_add(1, std::memory_order_release);
+}
+
+double FMathVMBase::GetGlobalVariable(const int32 Index) const
+{
+	return GlobalVariables[Index];
+}
+
+TMap<FString, double> FMathVMBase::GetGlobalVariables() const
+{
+	TMap<FString, double> Variables;
+	for (const TPair<FString, int32>& Pair : GlobalVariableIndices)
+	{
+		Variables.Add(Pair.Key, GlobalVariables[Pair.Value]);
+	}
+	return Variables;
+}
+
+bool FMathVMBase::HasGlobalVector(const FString& Name) const
+{
+	return GlobalVectorIndices.Contains(Name);
+}
+
+void FMathVMBase::SetGlobalVector(const FString& Name, const FMathVMVector& Value)
+{
+	GlobalVectors[GlobalVectorIndices[Name]] = Value;
+}
+
+FMathVMVector FMathVMBase::GetGlobalVector(const FString& Name) const
+{
+	return GlobalVectors[GlobalVectorIndices[Name]];
+}
+
+int32 FMathVMBase::GetGlobalVectorIndex(const FString& Name) const
+{
+	if (const int32* Index = GlobalVectorIndices.Find(Name))
+	{
+		return *Index;
+	}
+
+	return -1;
+}
+
+void FMathVMBase::SetGlobalVector(const int32 Index, const FMathVMVector& Value)
+{
+	GlobalVectors[Index] = Value;
+}
+
+FMathVMVector FMathVMBase::GetGlobalVector(const int32 Index) const
+{
+	return GlobalVectors[Index];
 }
 
-const TMap<FString, double>& FMathVMBase::GetGlobalVariables() const
+TMap<FString, FMathVMVector> FMathVMBase::GetGlobalVectors() const
 {
-	return GlobalVariables;
+	TMap<FString, FMathVMVector> Vectors;
+	for (const TPair<FString, int32>& Pair : GlobalVectorIndices)
+	{
+		Vectors.Add(Pair.Key, GlobalVectors[Pair.Value]);
+	}
+	return Vectors;
+}
+
+int32 FMathVMBase::GetVariableIndex(const FString& Name) const
+{
+	if (const int32* Index = VariableIndices.Find(Name))
+	{
+		return *Index;
+	}
+
+	return -1;
+}
+
+int32 FMathVMBase::GetNumVariables() const
+{
+	return VariableIndices.Num();
+}
+
+void FMathVMBase::BindSymbols()
+{
+	// the background optimization reads the bindings
+	ResetPromotion();
+	ProgramVersion.fetch_add(1, std::memory_order_acq_rel);
+
+	// rebuilding gives the same slots to the same names, so FMathVMLocals objects stay valid
+	SymbolBindings.Reset();
+	VariableIndices.Reset();
+	// variants depend on the bindings (assignments to globals are side effects)
+	ProgramVariants.Empty();
+	ProgramVariantIndices.Empty();
+
+	for (int32 SymbolIndex = 0; SymbolIndex < Symbols.Num(); SymbolIndex++)
+	{
+		const FString& Name = Symbols.GetName(SymbolIndex);
+
+		FMathVMSymbolBinding& Binding = SymbolBindings.AddDefaulted_GetRef();
+		Binding.Variable = VariableIndices.FindOrAdd(Name, VariableIndices.Num());
+		Binding.GlobalVariable = GetGlobalVariableIndex(Name);
+		Binding.GlobalVector = GetGlobalVectorIndex(Name);
+
+		if (const double* Const = Constants.Find(Name))
+		{
+			Binding.bIsConst = true;
+			Binding.ConstValue = *Const;
+		}
+	}
 }
 
 double FMathVMBase::GetConst(const FString& Name)
@@ -203,6 +521,301 @@ bool MathVM::Utils::SanitizeName(const FString& Name)
 	return true;
 }
 
+bool MathVM::Utils::ParseOperator(FStringView Symbol, EMathVMOperator& Operator, int32& Precedence)
+{
+	if (Symbol.Len() != 1)
+	{
+		return false;
+	}
+
+	switch (Symbol[0])
+	{
+	case('+'):
+		Operator = EMathVMOperator::Add;
+		Precedence = 6;
+		break;
+	case('-'):
+		Operator = EMathVMOperator::Sub;
+		Precedence = 6;
+		break;
+	case('*'):
+		Operator = EMathVMOperator::Mul;
+		Precedence = 5;
+		break;
+	case('/'):
+		Operator = EMathVMOperator::Div;
+		Precedence = 5;
+		break;
+	case('%'):
+		Operator = EMathVMOperator::Mod;
+		Precedence = 5;
+		break;
+	case('='):
+		Operator = EMathVMOperator::Assign;
+		Precedence = 17;
+		break;
+	default:
+		return false;
+	}
+
+	return true;
+}
+
+const TCHAR* MathVM::Utils::GetOperatorSymbol(const EMathVMOperator Operator)
+{
+	switch (Operator)
+	{
+	case(EMathVMOperator::Add):
+		return TEXT("+");
+	case(EMathVMOperator::Sub):
+		return TEXT("-");
+	case(EMathVMOperator::Mul):
+		return TEXT("*");
+	case(EMathVMOperator::Div):
+		return TEXT("/");
+	case(EMathVMOperator::Mod):
+		return TEXT("%");
+	case(EMathVMOperator::Assign):
+		return TEXT("=");
+	default:
+		break;
+	}
+
+	return TEXT("");
+}
+
+bool MathVM::Utils::ParseNumber(FStringView Text, double& Value)
+{
+	// exactly representable powers of 10
+	static const double PowersOf10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+	const int32 Len = Text.Len();
+	int32 Index = 0;
+	uint64 Mantissa = 0;
+	int32 NumSignificantDigits = 0;
+	int32 Exponent = 0;
+	bool bHasDigits = false;
+
+	auto AddDigit = [&](const TCHAR Char, const bool bFractional)
+		{
+			bHasDigits = true;
+			if (Mantissa == 0 && Char == '0')
+			{
+				// leading zeros are not significant
+				Exponent -= bFractional ? 1 : 0;
+				return;
+			}
+
+			// digits exceeding uint64 precision are tracked only for falling back to the slow path
+			NumSignificantDigits++;
+			if (NumSignificantDigits <= 19)
+			{
+				Mantissa = Mantissa * 10 + (Char - '0');
+				Exponent -= bFractional ? 1 : 0;
+			}
+			else if (!bFractional)
+			{
+				Exponent++;
+			}
+		};
+
+	while (Index < Len && Text[Index] >= '0' && Text[Index] <= '9')
+	{
+		AddDigit(Text[Index++], false);
+	}
+
+	if (Index < Len && Text[Index] == '.')
+	{
+		Index++;
+		while (Index < Len && Text[Index] >= '0' && Text[Index] <= '9')
+		{
+			AddDigit(Text[Index++], true);
+		}
+	}
+
+	if (!bHasDigits)
+	{
+		return false;
+	}
+
+	if (Index < Len && (Text[Index] == 'e' || Text[Index] == 'E'))
+	{
+		Index++;
+		bool bNegativeExponent = false;
+		if (Index < Len && (Text[Index] == '+' || Text[Index] == '-'))
+		{
+			bNegativeExponent = Text[Index++] == '-';
+		}
+
+		if (Index >= Len || Text[Index] < '0' || Text[Index] > '9')
+		{
+			return false;
+		}
+
+		int32 ExplicitExponent = 0;
+		while (Index < Len && Text[Index] >= '0' && Text[Index] <= '9')
+		{
+			// huge exponents are clamped (the result is zero or infinity anyway)
+			ExplicitExponent = FMath::Min(ExplicitExponent * 10 + (Text[Index++] - '0'), 100000);
+		}
+		Exponent += bNegativeExponent ? -ExplicitExponent : ExplicitExponent;
+	}
+
+	if (Index != Len)
+	{
+		return false;
+	}
+
+	// Clinger's fast path: both the mantissa and the power of 10 are exact, so a single operation is correctly rounded
+	if (NumSignificantDigits <= 19 && Mantissa <= (1ULL << 53) && Exponent >= -22 && Exponent <= 22)
+	{
+		const double DoubleMantissa = static_cast<double>(Mantissa);
+		Value = Exponent < 0 ? DoubleMantissa / PowersOf10[-Exponent] : DoubleMantissa * PowersOf10[Exponent];
+		return true;
+	}
+
+	// slow path (the text is already validated, copy it to a null terminated buffer)
+	TCHAR Buffer[128];
+	if (Len < UE_ARRAY_COUNT(Buffer))
+	{
+		FMemory::Memcpy(Buffer, Text.GetData(), Len * sizeof(TCHAR));
+		Buffer[Len] = 0;
+		Value = FCString::Atod(Buffer);
+	}
+	else
+	{
+		Value = FCString::Atod(*FString(Text));
+	}
+
+	return true;
+}
+
+int32 MathVM::Utils::GetSwizzleComponent(const TCHAR Char)
+{
+	switch (Char)
+	{
+	case('x'):
+	case('r'):
+		return 0;
+	case('y'):
+	case('g'):
+		return 1;
+	case('z'):
+	case('b'):
+		return 2;
+	case('w'):
+	case('a'):
+		return 3;
+	default:
+		break;
+	}
+	return -1;
+}
+
+bool MathVM::Utils::ValidateSwizzle(FStringView Components, FString& Error)
+{
+	if (Components.Len() < 1 || Components.Len() > 4)
+	{
+		Error = FString::Printf(TEXT("Invalid swizzle .%s (max 4 components)"), *FString(Components));
+		return false;
+	}
+
+	for (const TCHAR Component : Components)
+	{
+		if (GetSwizzleComponent(Component) < 0)
+		{
+			Error = FString::Printf(TEXT("Invalid swizzle component %c"), Component);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+uint32 FMathVMSymbolTable::Hash(FStringView Name)
+{
+	return FCrc::MemCrc32(Name.GetData(), Name.Len() * sizeof(TCHAR));
+}
+
+int32 FMathVMSymbolTable::Find(FStringView Name) const
+{
+	const int32* FirstIndex = Buckets.Find(Hash(Name));
+	if (!FirstIndex)
+	{
+		return -1;
+	}
+
+	for (int32 Index = *FirstIndex; Index >= 0; Index = NextInBucket[Index])
+	{
+		if (Name.Equals(Names[Index], ESearchCase::CaseSensitive))
+		{
+			return Index;
+		}
+	}
+
+	return -1;
+}
+
+int32 FMathVMSymbolTable::Intern(FStringView Name)
+{
+	const uint32 NameHash = Hash(Name);
+	int32& FirstIndex = Buckets.FindOrAdd(NameHash, -1);
+
+	for (int32 Index = FirstIndex; Index >= 0; Index = NextInBucket[Index])
+	{
+		if (Name.Equals(Names[Index], ESearchCase::CaseSensitive))
+		{
+			return Index;
+		}
+	}
+
+	const int32 NewIndex = Names.Emplace(Name);
+	NextInBucket.Add(FirstIndex);
+	FirstIndex = NewIndex;
+
+	return NewIndex;
+}
+
+const FString& FMathVMSymbolTable::GetName(const int32 Index) const
+{
+	return Names[Index];
+}
+
+int32 FMathVMSymbolTable::Num() const
+{
+	return Names.Num();
+}
+
+void FMathVMSymbolTable::Empty()
+{
+	Names.Empty();
+	NextInBucket.Empty();
+	Buckets.Empty();
+}
+
+void FMathVMSymbolTable::Truncate(const int32 NumSymbols)
+{
+	// symbols are removed from the most recent one, so each of them is the head of its bucket
+	for (int32 Index = Names.Num() - 1; Index >= FMath::Max(NumSymbols, 0); Index--)
+	{
+		const uint32 NameHash = Hash(Names[Index]);
+		if (NextInBucket[Index] >= 0)
+		{
+			Buckets[NameHash] = NextInBucket[Index];
+		}
+		else
+		{
+			Buckets.Remove(NameHash);
+		}
+	}
+
+	if (NumSymbols < Names.Num())
+	{
+		Names.SetNum(FMath::Max(NumSymbols, 0));
+		NextInBucket.SetNum(FMath::Max(NumSymbols, 0));
+	}
+}
+
 bool FMathVMBase::RegisterConst(const FString& Name, const double Value)
 {
 	if (!MathVM::Utils::SanitizeName(Name))
@@ -216,6 +829,7 @@ bool FMathVMBase::RegisterConst(const FString& Name, const double Value)
 	}
 
 	Constants.Add(Name, Value);
+	BindSymbols();
 
 	return true;
 }
@@ -227,13 +841,46 @@ bool FMathVMBase::RegisterGlobalVariable(const FString& Name, const double Value
 		return false;
 	}
 
-	if (GlobalVariables.Contains(Name))
+	if (const int32* Index = GlobalVariableIndices.Find(Name))
+	{
+		SetGlobalVariable(*Index, Value);
+	}
+	else
+	{
+		// the background optimization reads the globals
+		WaitForPromotion();
+		GlobalVariableIndices.Add(Name, GlobalVariables.Add(Value));
+		BindSymbols();
+	}
+
+	return true;
+}
+
+bool FMathVMBase::RegisterGlobalVector(const FString& Name, const FMathVMVector& Value)
+{
+	if (!MathVM::Utils::SanitizeName(Name))
+	{
+		return false;
+	}
+
+	if (Value.NumComponents < 2 || Value.NumComponents > 4)
+	{
+		return false;
+	}
+
+	if (GlobalVariableIndices.Contains(Name))
+	{
+		return false;
+	}
+
+	if (const int32* Index = GlobalVectorIndices.Find(Name))
 	{
-		GlobalVariables[Name] = Value;
+		GlobalVectors[*Index] = Value;
 	}
 	else
 	{
-		GlobalVariables.Add(Name, Value);
+		GlobalVectorIndices.Add(Name, GlobalVectors.Add(Value));
+		BindSymbols();
 	}
 
 	return true;
@@ -244,6 +891,36 @@ int32 FMathVMBase::RegisterResource(TSharedPtr<IMathVMResource> Resource)
 	return Resources.Add(Resource);
 }
 
+int32 FMathVMBase::RegisterResource(const FString& Name, TSharedPtr<IMathVMResource> Resource)
+{
+	if (!MathVM::Utils::SanitizeName(Name))
+	{
+		return -1;
+	}
+
+	if (ResourceNames.Contains(Name) || HasConst(Name) || Functions.Contains(Name))
+	{
+		return -1;
+	}
+
+	const int32 Index = Resources.Add(Resource);
+	ResourceNames.Add(Name, Index);
+	// the name is a constant too, so it can be used with any function expecting a resource index
+	RegisterConst(Name, Index);
+
+	return Index;
+}
+
+int32 FMathVMBase::GetResourceIndex(const FString& Name) const
+{
+	if (const int32* Index = ResourceNames.Find(Name))
+	{
+		return *Index;
+	}
+
+	return -1;
+}
+
 TSharedPtr<IMathVMResource> FMathVMBase::GetResource(const int32 Index) const
 {
 	if (Resources.IsValidIndex(Index))
@@ -254,65 +931,122 @@ TSharedPtr<IMathVMResource> FMathVMBase::GetResource(const int32 Index) const
 	return nullptr;
 }
 
+IMathVMResource* FMathVMBase::GetRawResource(const int32 Index) const
+{
+	if (Resources.IsValidIndex(Index))
+	{
+		return Resources[Index].Get();
+	}
+
+	return nullptr;
+}
+
+void FMathVMBase::FlushResources()
+{
+	for (TSharedPtr<IMathVMResource>& Resource : Resources)
+	{
+		if (Resource)
+		{
+			Resource->Flush();
+		}
+	}
+}
+
 void FMathVMBase::Reset()
 {
+	ResetPromotion();
+	ProgramVersion.fetch_add(1, std::memory_order_acq_rel);
 	Tokens.Empty();
 	Statements.Empty();
+	ProgramFunctions.Empty();
+	ProgramFunctionIndices.Empty();
+	Symbols.Empty();
+	NumCompiledSymbols = 0;
+	SymbolBindings.Empty();
+	VariableIndices.Empty();
+	ProgramVariants.Empty();
+	ProgramVariantIndices.Empty();
 }
 
 FMathVM::FMathVM()
 {
-	RegisterFunction("abs", MathVM::BuiltinFunctions::Abs, MathVM::BuiltinFunctions::AbsArgs);
-	RegisterFunction("acos", MathVM::BuiltinFunctions::ACos, MathVM::BuiltinFunctions::ACosArgs);
-	RegisterFunction("all", MathVM::BuiltinFunctions::All, MathVM::BuiltinFunctions::AllArgs);
-	RegisterFunction("any", MathVM::BuiltinFunctions::Any, MathVM::BuiltinFunctions::AnyArgs);
-	RegisterFunction("asin", MathVM::BuiltinFunctions::ASin, MathVM::BuiltinFunctions::ASinArgs);
-	RegisterFunction("atan", MathVM::BuiltinFunctions::ATan, MathVM::BuiltinFunctions::ATanArgs);
-	RegisterFunction("ceil", MathVM::BuiltinFunctions::Ceil, MathVM::BuiltinFunctions::CeilArgs);
-	RegisterFunction("clamp", MathVM::BuiltinFunctions::Clamp, MathVM::BuiltinFunctions::ClampArgs);
-	RegisterFunction("cos", MathVM::BuiltinFunctions::Cos, MathVM::BuiltinFunctions::CosArgs);
-	RegisterFunction("degrees", MathVM::BuiltinFunctions::Degrees, MathVM::BuiltinFunctions::DegreesArgs);
-	RegisterFunction("distance", MathVM::BuiltinFunctions::Distance, MathVM::BuiltinFunctions::DistanceArgs);
-	RegisterFunction("dot", MathVM::BuiltinFunctions::Dot, MathVM::BuiltinFunctions::DotArgs);
-	RegisterFunction("equal", MathVM::BuiltinFunctions::Equal, MathVM::BuiltinFunctions::EqualArgs);
-	RegisterFunction("exp", MathVM::BuiltinFunctions::Exp, MathVM::BuiltinFunctions::ExpArgs);
-	RegisterFunction("exp2", MathVM::BuiltinFunctions::Exp2, MathVM::BuiltinFunctions::Exp2Args);
-	RegisterFunction("floor", MathVM::BuiltinFunctions::Floor, MathVM::BuiltinFunctions::FloorArgs);
-	RegisterFunction("fract", MathVM::BuiltinFunctions::Fract, MathVM::BuiltinFunctions::FractArgs);
-	RegisterFunction("gradient", MathVM::BuiltinFunctions::Gradient, MathVM::BuiltinFunctions::GradientArgs);
-	RegisterFunction("greater", MathVM::BuiltinFunctions::Greater, MathVM::BuiltinFunctions::GreaterArgs);
-	RegisterFunction("greater_equal", MathVM::BuiltinFunctions::GreaterEqual, MathVM::BuiltinFunctions::GreaterEqualArgs);
-	RegisterFunction("hue2b", MathVM::BuiltinFunctions::Hue2B, MathVM::BuiltinFunctions::Hue2BArgs);
-	RegisterFunction("hue2g", MathVM::BuiltinFunctions::Hue2G, MathVM::BuiltinFunctions::Hue2GArgs);
-	RegisterFunction("hue2r", MathVM::BuiltinFunctions::Hue2R, MathVM::BuiltinFunctions::Hue2RArgs);
-	RegisterFunction("length", MathVM::BuiltinFunctions::Length, MathVM::BuiltinFunctions::LengthArgs);
-	RegisterFunction("lerp", MathVM::BuiltinFunctions::Lerp, MathVM::BuiltinFunctions::LerpArgs);
-	RegisterFunction("less", MathVM::BuiltinFunctions::Less, MathVM::BuiltinFunctions::LessArgs);
-	RegisterFunction("less_equal", MathVM::BuiltinFunctions::LessEqual, MathVM::BuiltinFunctions::LessEqualArgs);
-	RegisterFunction("log", MathVM::BuiltinFunctions::Log, MathVM::BuiltinFunctions::LogArgs);
-	RegisterFunction("log10", MathVM::BuiltinFunctions::Log10, MathVM::BuiltinFunctions::Log10Args);
-	RegisterFunction("log2", MathVM::BuiltinFunctions::Log2, MathVM::BuiltinFunctions::Log2Args);
-	RegisterFunction("logx", MathVM::BuiltinFunctions::LogX, MathVM::BuiltinFunctions::LogXArgs);
-	RegisterFunction("map", MathVM::BuiltinFunctions::Map, MathVM::BuiltinFunctions::MapArgs);
-	RegisterFunction("max", MathVM::BuiltinFunctions::Max, MathVM::BuiltinFunctions::MaxArgs);
-	RegisterFunction("mean", MathVM::BuiltinFunctions::Mean, MathVM::BuiltinFunctions::MeanArgs);
-	RegisterFunction("min", MathVM::BuiltinFunctions::Min, MathVM::BuiltinFunctions::MinArgs);
-	RegisterFunction("mod", MathVM::BuiltinFunctions::Mod, MathVM::BuiltinFunctions::ModArgs);
-	RegisterFunction("not", MathVM::BuiltinFunctions::Not, MathVM::BuiltinFunctions::NotArgs);
-	RegisterFunction("pow", MathVM::BuiltinFunctions::Pow, MathVM::BuiltinFunctions::PowArgs);
-	RegisterFunction("radians", MathVM::BuiltinFunctions::Radians, MathVM::BuiltinFunctions::RadiansArgs);
+	RegisterPureFunction("abs", MathVM::BuiltinFunctions::Abs, MathVM::BuiltinFunctions::AbsArgs);
+	RegisterPureFunction("acos", MathVM::BuiltinFunctions::ACos, MathVM::BuiltinFunctions::ACosArgs);
+	RegisterPureFunction("all", MathVM::BuiltinFunctions::All, MathVM::BuiltinFunctions::AllArgs);
+	RegisterPureFunction("any", MathVM::BuiltinFunctions::Any, MathVM::BuiltinFunctions::AnyArgs);
+	RegisterPureFunction("asin", MathVM::BuiltinFunctions::ASin, MathVM::BuiltinFunctions::ASinArgs);
+	RegisterPureFunction("atan", MathVM::BuiltinFunctions::ATan, MathVM::BuiltinFunctions::ATanArgs);
+	RegisterPureFunction("ceil", MathVM::BuiltinFunctions::Ceil, MathVM::BuiltinFunctions::CeilArgs);
+	RegisterPureFunction("clamp", MathVM::BuiltinFunctions::Clamp, MathVM::BuiltinFunctions::ClampArgs);
+	RegisterPureFunction("cos", MathVM::BuiltinFunctions::Cos, MathVM::BuiltinFunctions::CosArgs);
+	RegisterPureFunction("cross", MathVM::BuiltinFunctions::Cross, MathVM::BuiltinFunctions::CrossArgs);
+	RegisterPureFunction("degrees", MathVM::BuiltinFunctions::Degrees, MathVM::BuiltinFunctions::DegreesArgs);
+	RegisterPureFunction("distance", MathVM::BuiltinFunctions::Distance, MathVM::BuiltinFunctions::DistanceArgs);
+	RegisterPureFunction("dot", MathVM::BuiltinFunctions::Dot, MathVM::BuiltinFunctions::DotArgs);
+	RegisterPureFunction("equal", MathVM::BuiltinFunctions::Equal, MathVM::BuiltinFunctions::EqualArgs);
+	RegisterPureFunction("exp", MathVM::BuiltinFunctions::Exp, MathVM::BuiltinFunctions::ExpArgs);
+	RegisterPureFunction("exp2", MathVM::BuiltinFunctions::Exp2, MathVM::BuiltinFunctions::Exp2Args);
+	RegisterPureFunction("floor", MathVM::BuiltinFunctions::Floor, MathVM::BuiltinFunctions::FloorArgs);
+	RegisterPureFunction("fract", MathVM::BuiltinFunctions::Fract, MathVM::BuiltinFunctions::FractArgs);
+	RegisterPureFunction("gradient", MathVM::BuiltinFunctions::Gradient, MathVM::BuiltinFunctions::GradientArgs);
+	RegisterPureFunction("greater", MathVM::BuiltinFunctions::Greater, MathVM::BuiltinFunctions::GreaterArgs);
+	RegisterPureFunction("greater_equal", MathVM::BuiltinFunctions::GreaterEqual, MathVM::BuiltinFunctions::GreaterEqualArgs);
+	RegisterPureFunction("hue2b", MathVM::BuiltinFunctions::Hue2B, MathVM::BuiltinFunctions::Hue2BArgs);
+	RegisterPureFunction("hue2g", MathVM::BuiltinFunctions::Hue2G, MathVM::BuiltinFunctions::Hue2GArgs);
+	RegisterPureFunction("hue2r", MathVM::BuiltinFunctions::Hue2R, MathVM::BuiltinFunctions::Hue2RArgs);
+	RegisterPureFunction("if", MathVM::BuiltinFunctions::Select, MathVM::BuiltinFunctions::SelectArgs);
+	RegisterPureFunction("length", MathVM::BuiltinFunctions::Length, MathVM::BuiltinFunctions::LengthArgs);
+	RegisterPureFunction("lerp", MathVM::BuiltinFunctions::Lerp, MathVM::BuiltinFunctions::LerpArgs);
+	RegisterPureFunction("less", MathVM::BuiltinFunctions::Less, MathVM::BuiltinFunctions::LessArgs);
+	RegisterPureFunction("less_equal", MathVM::BuiltinFunctions::LessEqual, MathVM::BuiltinFunctions::LessEqualArgs);
+	RegisterPureFunction("log", MathVM::BuiltinFunctions::Log, MathVM::BuiltinFunctions::LogArgs);
+	RegisterPureFunction("log10", MathVM::BuiltinFunctions::Log10, MathVM::BuiltinFunctions::Log10Args);
+	RegisterPureFunction("log2", MathVM::BuiltinFunctions::Log2, MathVM::BuiltinFunctions::Log2Args);
+	RegisterPureFunction("logx", MathVM::BuiltinFunctions::LogX, MathVM::BuiltinFunctions::LogXArgs);
+	RegisterPureFunction("map", MathVM::BuiltinFunctions::Map, MathVM::BuiltinFunctions::MapArgs);
+	RegisterPureFunction("max", MathVM::BuiltinFunctions::Max, MathVM::BuiltinFunctions::MaxArgs);
+	RegisterPureFunction("mean", MathVM::BuiltinFunctions::Mean, MathVM::BuiltinFunctions::MeanArgs);
+	RegisterPureFunction("min", MathVM::BuiltinFunctions::Min, MathVM::BuiltinFunctions::MinArgs);
+	RegisterPureFunction("mod", MathVM::BuiltinFunctions::Mod, MathVM::BuiltinFunctions::ModArgs);
+	RegisterPureFunction("normalize", MathVM::BuiltinFunctions::Normalize, MathVM::BuiltinFunctions::NormalizeArgs);
+	RegisterPureFunction("not", MathVM::BuiltinFunctions::Not, MathVM::BuiltinFunctions::NotArgs);
+	RegisterPureFunction("pow", MathVM::BuiltinFunctions::Pow, MathVM::BuiltinFunctions::PowArgs);
+	RegisterPureFunction("prod", MathVM::BuiltinFunctions::Prod, MathVM::BuiltinFunctions::ProdArgs);
+	RegisterPureFunction("radians", MathVM::BuiltinFunctions::Radians, MathVM::BuiltinFunctions::RadiansArgs);
 	RegisterFunction("rand", MathVM::BuiltinFunctions::Rand, MathVM::BuiltinFunctions::RandArgs);
-	RegisterFunction("round", MathVM::BuiltinFunctions::Round, MathVM::BuiltinFunctions::RoundArgs);
-	RegisterFunction("round_even", MathVM::BuiltinFunctions::RoundEven, MathVM::BuiltinFunctions::RoundEvenArgs);
-	RegisterFunction("sign", MathVM::BuiltinFunctions::Sign, MathVM::BuiltinFunctions::SignArgs);
-	RegisterFunction("sin", MathVM::BuiltinFunctions::Sin, MathVM::BuiltinFunctions::SinArgs);
-	RegisterFunction("sqrt", MathVM::BuiltinFunctions::Sqrt, MathVM::BuiltinFunctions::SqrtArgs);
-	RegisterFunction("tan", MathVM::BuiltinFunctions::Tan, MathVM::BuiltinFunctions::TanArgs);
-	RegisterFunction("trunc", MathVM::BuiltinFunctions::Trunc, MathVM::BuiltinFunctions::TruncArgs);
+	RegisterPureFunction("round", MathVM::BuiltinFunctions::Round, MathVM::BuiltinFunctions::RoundArgs);
+	RegisterPureFunction("round_even", MathVM::BuiltinFunctions::RoundEven, MathVM::BuiltinFunctions::RoundEvenArgs);
+	RegisterPureFunction("select", MathVM::BuiltinFunctions::Select, MathVM::BuiltinFunctions::SelectArgs);
+	RegisterPureFunction("sign", MathVM::BuiltinFunctions::Sign, MathVM::BuiltinFunctions::SignArgs);
+	RegisterPureFunction("sin", MathVM::BuiltinFunctions::Sin, MathVM::BuiltinFunctions::SinArgs);
+	RegisterPureFunction("sqrt", MathVM::BuiltinFunctions::Sqrt, MathVM::BuiltinFunctions::SqrtArgs);
+	RegisterPureFunction("sum", MathVM::BuiltinFunctions::Sum, MathVM::BuiltinFunctions::SumArgs);
+	RegisterPureFunction("tan", MathVM::BuiltinFunctions::Tan, MathVM::BuiltinFunctions::TanArgs);
+	RegisterPureFunction("trunc", MathVM::BuiltinFunctions::Trunc, MathVM::BuiltinFunctions::TruncArgs);
+	RegisterPureFunction("vec2", MathVM::BuiltinFunctions::Vec2, MathVM::BuiltinFunctions::Vec2Args);
+	RegisterPureFunction("vec3", MathVM::BuiltinFunctions::Vec3, MathVM::BuiltinFunctions::Vec3Args);
+	RegisterPureFunction("vec4", MathVM::BuiltinFunctions::Vec4, MathVM::BuiltinFunctions::Vec4Args);
 
 	// Resources functions
-	RegisterFunction("read", MathVM::BuiltinFunctions::Read, MathVM::BuiltinFunctions::ReadArgs);
-	RegisterFunction("write", MathVM::BuiltinFunctions::Write, MathVM::BuiltinFunctions::WriteArgs);
+	RegisterResourceFunction("read", MathVM::BuiltinFunctions::Read, MathVM::BuiltinFunctions::ReadArgs, EMathVMResourceFunction::Read);
+	RegisterResourceFunction("write", MathVM::BuiltinFunctions::Write, MathVM::BuiltinFunctions::WriteArgs, EMathVMResourceFunction::Write);
+	RegisterResourceFunction("sample", MathVM::BuiltinFunctions::Sample, MathVM::BuiltinFunctions::SampleArgs, EMathVMResourceFunction::Sample);
+	RegisterResourceFunction("atomic_add", MathVM::BuiltinFunctions::AtomicAdd, MathVM::BuiltinFunctions::AtomicAddArgs, EMathVMResourceFunction::AtomicAdd);
+	RegisterResourceFunction("atomic_min", MathVM::BuiltinFunctions::AtomicMin, MathVM::BuiltinFunctions::AtomicMinArgs, EMathVMResourceFunction::AtomicMin);
+	RegisterResourceFunction("atomic_max", MathVM::BuiltinFunctions::AtomicMax, MathVM::BuiltinFunctions::AtomicMaxArgs, EMathVMResourceFunction::AtomicMax);
+	RegisterResourceFunction("sum_of", MathVM::BuiltinFunctions::SumOf, MathVM::BuiltinFunctions::SumOfArgs, EMathVMResourceFunction::Reduce);
+	RegisterResourceFunction("min_of", MathVM::BuiltinFunctions::MinOf, MathVM::BuiltinFunctions::MinOfArgs, EMathVMResourceFunction::Reduce);
+	RegisterResourceFunction("max_of", MathVM::BuiltinFunctions::MaxOf, MathVM::BuiltinFunctions::MaxOfArgs, EMathVMResourceFunction::Reduce);
+	RegisterResourceFunction("mean_of", MathVM::BuiltinFunctions::MeanOf, MathVM::BuiltinFunctions::MeanOfArgs, EMathVMResourceFunction::Reduce);
+	// reads resources like the other reductions (its result must never be folded)
+	RegisterResourceFunction("dot_of", MathVM::BuiltinFunctions::DotOf, MathVM::BuiltinFunctions::DotOfArgs, EMathVMResourceFunction::Reduce);
+
+	// the arms are evaluated only when selected
+	SelectFunctions.Add("if");
+	SelectFunctions.Add("select");
+
+	RangeFunctions.Add("prod", EMathVMTokenType::RangeProduct);
+	RangeFunctions.Add("sum", EMathVMTokenType::RangeSum);
 
 	RegisterConst("PI", UE_PI);
 }
\ No newline at end of file
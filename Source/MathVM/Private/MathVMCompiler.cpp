@@ -4,12 +4,35 @@
 
 bool FMathVMBase::Compile()
 {
-	TArray<const FMathVMToken*> OutputQueue;
-	TArray<const FMathVMToken*> OperatorStack;
+	TArray<FMathVMToken> OutputQueue;
+	TArray<FMathVMToken> OperatorStack;
 	TArray<int32> FunctionsArgsStack;
 	TArray<bool> FunctionHasFirstArgStack;
+	TArray<TArray<int32>> FunctionArgsStartsStack;
 	bool bLocked = false;
 
+	// statements are added even if the compilation fails, so every symbol of the tokens is kept from now on
+	NumCompiledSymbols = Symbols.Num();
+	// a pending background optimization works on the previous program
+	ProgramVersion.fetch_add(1, std::memory_order_acq_rel);
+
+	// variables assigned by the code (including the variables of the ranges) are never resolved as symbolic resource arguments
+	TSet<int32> AssignedSymbols;
+	for (int32 TokenIndex = 0; TokenIndex + 1 < Tokens.Num(); TokenIndex++)
+	{
+		const FMathVMToken& Token = Tokens[TokenIndex];
+		const FMathVMToken& NextToken = Tokens[TokenIndex + 1];
+		if (Token.TokenType == EMathVMTokenType::Variable && NextToken.TokenType == EMathVMTokenType::Operator && NextToken.GetOperator() == EMathVMOperator::Assign)
+		{
+			AssignedSymbols.Add(Token.Index);
+		}
+		else if (Token.TokenType == EMathVMTokenType::Function && RangeFunctions.Contains(GetProgramFunction(Token.Index).Name) &&
+			TokenIndex + 2 < Tokens.Num() && Tokens[TokenIndex + 2].TokenType == EMathVMTokenType::Variable)
+		{
+			AssignedSymbols.Add(Tokens[TokenIndex + 2].Index);
+		}
+	}
+
 	for (const FMathVMToken& Token : Tokens)
 	{
 		if (Token.TokenType == EMathVMTokenType::Number || Token.TokenType == EMathVMTokenType::Variable)
@@ -18,29 +41,36 @@ bool FMathVMBase::Compile()
 			{
 				FunctionHasFirstArgStack.Last() = true;
 			}
-			OutputQueue.Add(&Token);
+			OutputQueue.Add(Token);
+		}
+		else if (Token.TokenType == EMathVMTokenType::Swizzle)
+		{
+			// postfix with the highest precedence, it applies directly to the previous operand
+			OutputQueue.Add(Token);
 		}
 		else if (Token.TokenType == EMathVMTokenType::Function)
 		{
-			OperatorStack.Add(&Token);
+			OperatorStack.Add(Token);
 			if (!FunctionHasFirstArgStack.IsEmpty())
 			{
 				FunctionHasFirstArgStack.Last() = true;
 			}
 			FunctionHasFirstArgStack.Add(false);
 			FunctionsArgsStack.Add(0);
+			// output queue index of the first argument
+			FunctionArgsStartsStack.Add({ OutputQueue.Num() });
 		}
 		else if (Token.TokenType == EMathVMTokenType::Operator)
 		{
-			while (!OperatorStack.IsEmpty() && OperatorStack.Last()->TokenType == EMathVMTokenType::Operator && OperatorStack.Last()->Precedence <= Token.Precedence)
+			while (!OperatorStack.IsEmpty() && OperatorStack.Last().TokenType == EMathVMTokenType::Operator && OperatorStack.Last().Precedence <= Token.Precedence)
 			{
 				OutputQueue.Add(MATHVM_POP(OperatorStack));
 			}
-			OperatorStack.Add(&Token);
+			OperatorStack.Add(Token);
 		}
 		else if (Token.TokenType == EMathVMTokenType::Comma)
 		{
-			while (!OperatorStack.IsEmpty() && OperatorStack.Last()->TokenType != EMathVMTokenType::OpenParenthesis)
+			while (!OperatorStack.IsEmpty() && OperatorStack.Last().TokenType != EMathVMTokenType::OpenParenthesis)
 			{
 				OutputQueue.Add(MATHVM_POP(OperatorStack));
 			}
@@ -53,10 +83,11 @@ bool FMathVMBase::Compile()
 			FunctionsArgsStack.Last()++;
 
 			FunctionHasFirstArgStack.Last() = false;
+			FunctionArgsStartsStack.Last().Add(OutputQueue.Num());
 		}
 		else if (Token.TokenType == EMathVMTokenType::OpenParenthesis)
 		{
-			OperatorStack.Add(&Token);
+			OperatorStack.Add(Token);
 		}
 		else if (Token.TokenType == EMathVMTokenType::Lock)
 		{
@@ -70,7 +101,7 @@ bool FMathVMBase::Compile()
 				return SetError("Lock without Unlock");
 			}
 			bLocked = true;
-			Statements.Add({ &Token });
+			Statements.Add({ Token });
 		}
 		else if (Token.TokenType == EMathVMTokenType::Unlock)
 		{
@@ -84,15 +115,15 @@ bool FMathVMBase::Compile()
 				return SetError("Unlock without Lock");
 			}
 			bLocked = false;
-			Statements.Add({ &Token });
+			Statements.Add({ Token });
 		}
 		else if (Token.TokenType == EMathVMTokenType::CloseParenthesis)
 		{
-			while (!OperatorStack.IsEmpty() && OperatorStack.Last()->TokenType != EMathVMTokenType::OpenParenthesis)
+			while (!OperatorStack.IsEmpty() && OperatorStack.Last().TokenType != EMathVMTokenType::OpenParenthesis)
 			{
 				OutputQueue.Add(MATHVM_POP(OperatorStack));
 			}
-			if (OperatorStack.IsEmpty() || OperatorStack.Last()->TokenType != EMathVMTokenType::OpenParenthesis)
+			if (OperatorStack.IsEmpty() || OperatorStack.Last().TokenType != EMathVMTokenType::OpenParenthesis)
 			{
 				return SetError("Expected open parenthesis");
 			}
@@ -100,18 +131,53 @@ bool FMathVMBase::Compile()
 
 			if (!OperatorStack.IsEmpty())
 			{
-				if (OperatorStack.Last()->TokenType == EMathVMTokenType::Function)
+				if (OperatorStack.Last().TokenType == EMathVMTokenType::Function)
 				{
-					// this is basically the only case the compiler needs a const_cast
-					FMathVMToken* FunctionToken = const_cast<FMathVMToken*>(OperatorStack.Last());
+					FMathVMToken FunctionToken = MATHVM_POP(OperatorStack);
+					const FMathVMProgramFunction& Function = GetProgramFunction(FunctionToken.Index);
 
-					FunctionToken->DetectedNumArgs = MATHVM_POP(FunctionsArgsStack) + (FunctionHasFirstArgStack.Pop() ? 1 : 0);
+					const int32 DetectedNumArgs = MATHVM_POP(FunctionsArgsStack) + (FunctionHasFirstArgStack.Pop() ? 1 : 0);
+					const TArray<int32> ArgsStarts = MATHVM_POP(FunctionArgsStartsStack);
 
-					if (FunctionToken->NumArgs >= 0 && FunctionToken->DetectedNumArgs != FunctionToken->NumArgs)
+					if (DetectedNumArgs > MAX_uint16)
+					{
+						return SetError(FString::Printf(TEXT("Too many arguments for function %s"), *Function.Name));
+					}
+					FunctionToken.DetectedNumArgs = static_cast<uint16>(DetectedNumArgs);
+
+					if (Function.NumArgs >= 0 && DetectedNumArgs != Function.NumArgs)
+					{
+						return SetError(FString::Printf(TEXT("Function %s expects %d argument%s (detected %d)"), *Function.Name, Function.NumArgs, Function.NumArgs == 1 ? TEXT("") : TEXT("s"), DetectedNumArgs));
+					}
+
+					// select(condition, a, b) becomes: condition JumpIfZero(a + 1) a Jump(b) b
+					if (DetectedNumArgs == 3 && SelectFunctions.Contains(Function.Name))
+					{
+						const int32 ElseStart = ArgsStarts[2];
+						OutputQueue.Insert(FMathVMToken(EMathVMTokenType::Jump, OutputQueue.Num() - ElseStart), ElseStart);
+						OutputQueue.Insert(FMathVMToken(EMathVMTokenType::JumpIfZero, ElseStart - ArgsStarts[1] + 1), ArgsStarts[1]);
+					}
+					// sum(k, from, to, expression) becomes: k from to RangeSum(expression) expression
+					else if (DetectedNumArgs == 4 && RangeFunctions.Contains(Function.Name))
+					{
+						if (ArgsStarts[1] - ArgsStarts[0] != 1 || OutputQueue[ArgsStarts[0]].TokenType != EMathVMTokenType::Variable)
+						{
+							return SetError(FString::Printf(TEXT("The first argument of %s must be a variable"), *Function.Name));
+						}
+
+						const int32 ExpressionStart = ArgsStarts[3];
+						OutputQueue.Insert(FMathVMToken(RangeFunctions[Function.Name], OutputQueue.Num() - ExpressionStart), ExpressionStart);
+					}
+					else
 					{
-						return SetError(FString::Printf(TEXT("Function %s expects %d argument%s (detected %d)"), *(FunctionToken->Value), FunctionToken->NumArgs, FunctionToken->NumArgs == 1 ? TEXT("") : TEXT("s"), FunctionToken->DetectedNumArgs));
+						// the token is replaced by a bound one when possible
+						if (!BindResourceFunction(FunctionToken, OutputQueue, ArgsStarts, AssignedSymbols))
+						{
+							return false;
+						}
+
+						OutputQueue.Add(FunctionToken);
 					}
-					OutputQueue.Add(MATHVM_POP(OperatorStack));
 				}
 			}
 		}
@@ -119,7 +185,7 @@ bool FMathVMBase::Compile()
 		{
 			while (!OperatorStack.IsEmpty())
 			{
-				if (OperatorStack.Last()->TokenType == EMathVMTokenType::OpenParenthesis)
+				if (OperatorStack.Last().TokenType == EMathVMTokenType::OpenParenthesis)
 				{
 					return SetError("Mismatched parenthesis");
 				}
@@ -130,12 +196,13 @@ bool FMathVMBase::Compile()
 			OperatorStack.Empty();
 			FunctionsArgsStack.Empty();
 			FunctionHasFirstArgStack.Empty();
+			FunctionArgsStartsStack.Empty();
 		}
 	}
 
 	while (!OperatorStack.IsEmpty())
 	{
-		if (OperatorStack.Last()->TokenType == EMathVMTokenType::OpenParenthesis)
+		if (OperatorStack.Last().TokenType == EMathVMTokenType::OpenParenthesis)
 		{
 			return SetError("Mismatched parenthesis");
 		}
@@ -148,5 +215,160 @@ bool FMathVMBase::Compile()
 		return SetError("Lock without Unlock");
 	}
 
+	BindSymbols();
+
+	return true;
+}
+
+bool FMathVMBase::BindResourceFunction(FMathVMToken& FunctionToken, TArray<FMathVMToken>& OutputQueue, const TArray<int32>& ArgsStarts, const TSet<int32>& AssignedSymbols)
+{
+	// copied, the program functions array can grow
+	const FString FunctionName = GetProgramFunction(FunctionToken.Index).Name;
+
+	const EMathVMResourceFunction* ResourceFunction = ResourceFunctions.Find(FunctionName);
+	if (!ResourceFunction || FunctionToken.DetectedNumArgs < 1 || ArgsStarts.IsEmpty())
+	{
+		return true;
+	}
+
+	// the resource index must be a single number or resource name token
+	const int32 FirstArgStart = ArgsStarts[0];
+	const int32 FirstArgEnd = ArgsStarts.Num() > 1 ? ArgsStarts[1] : OutputQueue.Num();
+	if (FirstArgEnd - FirstArgStart != 1)
+	{
+		return true;
+	}
+
+	const FMathVMToken ResourceToken = OutputQueue[FirstArgStart];
+	IMathVMResource* Resource = nullptr;
+	int32 ResourceIndex = -1;
+
+	if (ResourceToken.TokenType == EMathVMTokenType::Number)
+	{
+		// unknown resources are resolved at runtime
+		ResourceIndex = static_cast<int32>(ResourceToken.NumericValue);
+		Resource = GetRawResource(ResourceIndex);
+		if (!Resource)
+		{
+			return true;
+		}
+	}
+	else if (ResourceToken.TokenType == EMathVMTokenType::Variable && ResourceNames.Contains(GetSymbolName(ResourceToken.Index)))
+	{
+		const FString& ResourceName = GetSymbolName(ResourceToken.Index);
+		ResourceIndex = ResourceNames[ResourceName];
+		Resource = GetRawResource(ResourceIndex);
+		if (!Resource)
+		{
+			return SetError(FString::Printf(TEXT("Invalid resource %s"), *ResourceName));
+		}
+
+		// named resources are validated against their signature
+		if (*ResourceFunction != EMathVMResourceFunction::Reduce)
+		{
+			// atomics have the same signature of write()
+			const bool bWriteSignature = *ResourceFunction == EMathVMResourceFunction::Write || *ResourceFunction == EMathVMResourceFunction::AtomicAdd || *ResourceFunction == EMathVMResourceFunction::AtomicMin || *ResourceFunction == EMathVMResourceFunction::AtomicMax;
+			const int32 NumArgs = bWriteSignature ? Resource->GetNumWriteArgs() : Resource->GetNumReadArgs();
+			const int32 DetectedNumArgs = FunctionToken.DetectedNumArgs - 1;
+			if (NumArgs >= 0 && DetectedNumArgs != NumArgs)
+			{
+				return SetError(FString::Printf(TEXT("Function %s on resource %s expects %d argument%s (detected %d)"), *FunctionName, *ResourceName, NumArgs, NumArgs == 1 ? TEXT("") : TEXT("s"), DetectedNumArgs));
+			}
+		}
+	}
+	else
+	{
+		return true;
+	}
+
+	// symbolic arguments (single variable tokens) are resolved by the resource into numbers
+	for (int32 ArgIndex = 1; ArgIndex < ArgsStarts.Num(); ArgIndex++)
+	{
+		const int32 ArgStart = ArgsStarts[ArgIndex];
+		const int32 ArgEnd = ArgsStarts.IsValidIndex(ArgIndex + 1) ? ArgsStarts[ArgIndex + 1] : OutputQueue.Num();
+		if (ArgEnd - ArgStart != 1 || OutputQueue[ArgStart].TokenType != EMathVMTokenType::Variable)
+		{
+			continue;
+		}
+
+		// names of program variables, globals and constants (including resources) keep their meaning
+		const FString& ArgName = GetSymbolName(OutputQueue[ArgStart].Index);
+		if (AssignedSymbols.Contains(OutputQueue[ArgStart].Index) || Constants.Contains(ArgName) || GlobalVariableIndices.Contains(ArgName) || GlobalVectorIndices.Contains(ArgName))
+		{
+			continue;
+		}
+
+		// reductions have the range (from and to) on the first coordinate
+		int32 Coordinate = ArgIndex - 1;
+		if (*ResourceFunction == EMathVMResourceFunction::Reduce)
+		{
+			Coordinate = FMath::Max(ArgIndex - 2, 0);
+		}
+
+		double Value = 0;
+		if (Resource->ResolveArgument(Coordinate, ArgName, Value))
+		{
+			OutputQueue[ArgStart] = FMathVMToken(Value);
+		}
+	}
+
+	FMathVMFunction BoundFunction = nullptr;
+	if (!MakeResourceFunction(FunctionName, *ResourceFunction, Resource, BoundFunction))
+	{
+		return true;
+	}
+
+	FunctionToken.Index = AddProgramFunction(FunctionName, ResourceIndex, BoundFunction);
+	FunctionToken.DetectedNumArgs--;
+
+	// the resource index is now part of the function
+	OutputQueue.RemoveAt(FirstArgStart);
+
+	return true;
+}
+
+bool FMathVMBase::MakeResourceFunction(const FString& Name, const EMathVMResourceFunction ResourceFunction, IMathVMResource* Resource, FMathVMFunction& BoundFunction) const
+{
+	switch (ResourceFunction)
+	{
+	case(EMathVMResourceFunction::Read):
+		BoundFunction = [Resource](MATHVM_ARGS) -> bool
+			{
+				MATHVM_RETURN(Resource->Read(Args));
+			};
+		break;
+	case(EMathVMResourceFunction::Sample):
+		BoundFunction = [Resource](MATHVM_ARGS) -> bool
+			{
+				MATHVM_RETURN(Resource->Sample(Args));
+			};
+		break;
+	case(EMathVMResourceFunction::Write):
+		BoundFunction = [Resource](MATHVM_ARGS) -> bool
+			{
+				Resource->Write(Args);
+				return true;
+			};
+		break;
+	case(EMathVMResourceFunction::AtomicAdd):
+	case(EMathVMResourceFunction::AtomicMin):
+	case(EMathVMResourceFunction::AtomicMax):
+	{
+		const EMathVMResourceAtomic Operation = ResourceFunction == EMathVMResourceFunction::AtomicAdd ? EMathVMResourceAtomic::Add : (ResourceFunction == EMathVMResourceFunction::AtomicMin ? EMathVMResourceAtomic::Min : EMathVMResourceAtomic::Max);
+		BoundFunction = [Resource, Operation, Name](MATHVM_ARGS) -> bool
+			{
+				double Result = 0;
+				if (!Resource->Atomic(Operation, Args, Result))
+				{
+					MATHVM_ERROR(FString::Printf(TEXT("Resource does not support %s"), *Name));
+				}
+				MATHVM_RETURN(Result);
+			};
+	}
+	break;
+	default:
+		return false;
+	}
+
 	return true;
 }
\ No newline at end of file
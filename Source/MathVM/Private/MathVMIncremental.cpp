@@ -0,0 +1,239 @@
+// Copyright 2024, Roberto De Ioris.
+
+#include "MathVMIncremental.h"
+
+namespace MathVM
+{
+	namespace Incremental
+	{
+		FORCEINLINE bool IsSameValue(const FMathVMVector& A, const FMathVMVector& B)
+		{
+			if (A.NumComponents != B.NumComponents)
+			{
+				return false;
+			}
+
+			for (int32 ComponentIndex = 0; ComponentIndex < A.NumComponents; ComponentIndex++)
+			{
+				if (A.Value[ComponentIndex] != B.Value[ComponentIndex])
+				{
+					return false;
+				}
+			}
+
+			return true;
+		}
+	}
+}
+
+FMathVMIncrementalEvaluator::FMathVMIncrementalEvaluator(FMathVMBase& InMathVM, void* InLocalContext) : MathVM(InMathVM), LocalContext(InLocalContext)
+{
+	Init();
+}
+
+bool FMathVMIncrementalEvaluator::Init()
+{
+	const int32 NumVariables = MathVM.GetNumVariables();
+	const int32 NumStatements = MathVM.GetNumStatements();
+
+	Locals.Init(NumVariables);
+	Changed.Init(false, NumVariables);
+	FirstUses.Init(NumStatements, NumVariables);
+
+	StatementStates.Empty();
+	StatementStates.SetNum(NumStatements);
+
+	for (int32 StatementIndex = 0; StatementIndex < NumStatements; StatementIndex++)
+	{
+		FStatementState& StatementState = StatementStates[StatementIndex];
+		if (!MathVM.GetStatementInfo(StatementIndex, StatementState.Info))
+		{
+			StatementStates.Empty();
+			return SetError("Program not compiled");
+		}
+
+		for (const int32 Use : StatementState.Info.Uses)
+		{
+			FirstUses[Use] = FMath::Min(FirstUses[Use], StatementIndex);
+		}
+	}
+
+	bAllDirty = true;
+	return true;
+}
+
+void FMathVMIncrementalEvaluator::SetVariable(const int32 Index, const double Value)
+{
+	SetVector(Index, FMathVMVector(Value));
+}
+
+void FMathVMIncrementalEvaluator::SetVariable(const FString& Name, const double Value)
+{
+	SetVariable(MathVM.GetVariableIndex(Name), Value);
+}
+
+void FMathVMIncrementalEvaluator::SetVector(const int32 Index, const FMathVMVector& Value)
+{
+	if (!Locals.Values.IsValidIndex(Index) || MathVM::Incremental::IsSameValue(Locals.Values[Index], Value))
+	{
+		return;
+	}
+
+	Locals.Values[Index] = Value;
+	Changed[Index] = true;
+}
+
+void FMathVMIncrementalEvaluator::SetVector(const FString& Name, const FMathVMVector& Value)
+{
+	SetVector(MathVM.GetVariableIndex(Name), Value);
+}
+
+void FMathVMIncrementalEvaluator::MarkChanged(const int32 Index)
+{
+	if (Changed.IsValidIndex(Index))
+	{
+		Changed[Index] = true;
+	}
+}
+
+void FMathVMIncrementalEvaluator::MarkChanged(const FString& Name)
+{
+	MarkChanged(MathVM.GetVariableIndex(Name));
+}
+
+void FMathVMIncrementalEvaluator::MarkAllDirty()
+{
+	bAllDirty = true;
+}
+
+bool FMathVMIncrementalEvaluator::Evaluate()
+{
+	NumExecutedStatements = 0;
+
+	if (StatementStates.Num() != MathVM.GetNumStatements() && !Init())
+	{
+		return false;
+	}
+
+	// changes to be propagated by the next evaluation (variables read before being assigned)
+	TBitArray<> NextChanged(false, Changed.Num());
+	TArray<FMathVMVector> PreviousValues;
+
+	for (int32 StatementIndex = 0; StatementIndex < StatementStates.Num(); StatementIndex++)
+	{
+		FStatementState& StatementState = StatementStates[StatementIndex];
+
+		bool bDirty = bAllDirty || !StatementState.bValid || StatementState.Info.bHasSideEffects;
+		for (int32 UseIndex = 0; !bDirty && UseIndex < StatementState.Info.Uses.Num(); UseIndex++)
+		{
+			bDirty = Changed[StatementState.Info.Uses[UseIndex]];
+		}
+
+		if (!bDirty)
+		{
+			continue;
+		}
+
+		PreviousValues.Reset();
+		for (const int32 Def : StatementState.Info.Defs)
+		{
+			PreviousValues.Add(Locals.Values[Def]);
+		}
+
+		FMathVMCallContext CallContext(MathVM, Locals, LocalContext);
+		FString StatementError;
+		if (!MathVM.ExecuteStatement(StatementIndex, CallContext, StatementError))
+		{
+			// the cached state cannot be trusted anymore
+			for (FStatementState& StatementStateToInvalidate : StatementStates)
+			{
+				StatementStateToInvalidate.bValid = false;
+			}
+			Changed.Init(false, Changed.Num());
+			return SetError(StatementError);
+		}
+
+		StatementState.Stack = MoveTemp(CallContext.Stack);
+		StatementState.TempVectors = MoveTemp(CallContext.TempVectors);
+		StatementState.bValid = true;
+		NumExecutedStatements++;
+
+		for (int32 DefIndex = 0; DefIndex < StatementState.Info.Defs.Num(); DefIndex++)
+		{
+			const int32 Def = StatementState.Info.Defs[DefIndex];
+			// assignments to globals do not touch the local slot
+			if (StatementState.Info.bHasSideEffects || !MathVM::Incremental::IsSameValue(PreviousValues[DefIndex], Locals.Values[Def]))
+			{
+				Changed[Def] = true;
+				if (FirstUses[Def] <= StatementIndex)
+				{
+					NextChanged[Def] = true;
+				}
+			}
+		}
+	}
+
+	Changed = MoveTemp(NextChanged);
+	bAllDirty = false;
+
+	return true;
+}
+
+bool FMathVMIncrementalEvaluator::GetResults(const int32 PopResults, TArray<double>& Results)
+{
+	FMathVMCallContext CallContext(MathVM, Locals, LocalContext);
+
+	for (const FStatementState& StatementState : StatementStates)
+	{
+		if (!StatementState.bValid)
+		{
+			continue;
+		}
+
+		const int32 TempVectorsOffset = CallContext.TempVectors.Num();
+		CallContext.TempVectors.Append(StatementState.TempVectors);
+
+		for (const FMathVMToken& Token : StatementState.Stack)
+		{
+			FMathVMToken& NewToken = CallContext.Stack.Add_GetRef(Token);
+			if (NewToken.TokenType == EMathVMTokenType::Vector)
+			{
+				NewToken.Index += TempVectorsOffset;
+			}
+		}
+	}
+
+	FString ResultsError;
+	if (!MathVM.PopStackResults(CallContext, PopResults, Results, ResultsError))
+	{
+		return SetError(ResultsError);
+	}
+
+	return true;
+}
+
+bool FMathVMIncrementalEvaluator::GetVariable(const FString& Name, double& Value) const
+{
+	return Locals.GetVariable(MathVM.GetVariableIndex(Name), Value);
+}
+
+const FMathVMLocals& FMathVMIncrementalEvaluator::GetLocals() const
+{
+	return Locals;
+}
+
+const FString& FMathVMIncrementalEvaluator::GetError() const
+{
+	return Error;
+}
+
+int32 FMathVMIncrementalEvaluator::GetNumExecutedStatements() const
+{
+	return NumExecutedStatements;
+}
+
+bool FMathVMIncrementalEvaluator::SetError(const FString& InError)
+{
+	Error = InError;
+	return false;
+}
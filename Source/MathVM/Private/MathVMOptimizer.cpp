@@ -0,0 +1,746 @@
+// Copyright 2024, Roberto De Ioris.
+
+#include "MathVM.h"
+#include "Async/Async.h"
+
+namespace MathVM
+{
+	namespace Optimizer
+	{
+		// simulates the stack of the statement for finding the targets of the assignments
+		void AnalyzeStatement(const FMathVMBase& MathVM, const TArray<FMathVMToken>& Statement, FMathVMStatementInfo& Info)
+		{
+			// index of the Variable token producing each value (-1 for computed values)
+			TArray<int32> Sources;
+			TArray<bool> AssignTargets;
+			AssignTargets.AddZeroed(Statement.Num());
+			// ends of select() (where the value of the arms is pushed) and of range expressions (where the value of the expression is replaced
+			// by the result), the later ones are the innermost
+			TArray<TPair<int32, bool>> MergeTargets;
+			// tokens before this index could be skipped by a jump
+			int32 ConditionalEnd = 0;
+			TArray<int32> ConditionalDefs;
+
+			for (int32 TokenIndex = 0; TokenIndex < Statement.Num(); TokenIndex++)
+			{
+				const FMathVMToken& Token = Statement[TokenIndex];
+
+				for (int32 MergeIndex = MergeTargets.Num() - 1; MergeIndex >= 0; MergeIndex--)
+				{
+					if (MergeTargets[MergeIndex].Key == TokenIndex)
+					{
+						if (MergeTargets[MergeIndex].Value && !Sources.IsEmpty())
+						{
+							MATHVM_POP(Sources);
+						}
+						Sources.Add(-1);
+						MergeTargets.RemoveAt(MergeIndex);
+					}
+				}
+
+				switch (Token.TokenType)
+				{
+				case(EMathVMTokenType::Number):
+					Sources.Add(-1);
+					break;
+				case(EMathVMTokenType::Variable):
+					Sources.Add(TokenIndex);
+					break;
+				case(EMathVMTokenType::Swizzle):
+					if (Sources.IsEmpty())
+					{
+						Info.bHasSideEffects = true;
+						Sources.Add(-1);
+					}
+					Sources.Last() = -1;
+					break;
+				case(EMathVMTokenType::Operator):
+				{
+					const int32 B = Sources.IsEmpty() ? -1 : MATHVM_POP(Sources);
+					const int32 A = Sources.IsEmpty() ? -1 : MATHVM_POP(Sources);
+					if (Token.GetOperator() == EMathVMOperator::Assign)
+					{
+						if (A < 0)
+						{
+							// malformed, keep it for reporting the error at runtime
+							Info.bHasSideEffects = true;
+							break;
+						}
+
+						AssignTargets[A] = true;
+						const FMathVMSymbolBinding& Binding = MathVM.GetSymbolBinding(Statement[A].Index);
+						Info.Defs.Add(Binding.Variable);
+						Info.DefTokens.Add(TokenIndex);
+						Info.TargetTokens.Add(A);
+						// the previous value survives when the assignment is skipped
+						if (TokenIndex < ConditionalEnd)
+						{
+							ConditionalDefs.Add(Binding.Variable);
+						}
+						if (Binding.GlobalVariable >= 0 || Binding.GlobalVector >= 0)
+						{
+							Info.bHasSideEffects = true;
+						}
+					}
+					else
+					{
+						Sources.Add(-1);
+					}
+				}
+				break;
+				case(EMathVMTokenType::Function):
+				{
+					const int32 NumArgs = FMath::Min<int32>(Token.DetectedNumArgs, Sources.Num());
+					Sources.SetNum(Sources.Num() - NumArgs);
+					if (!MathVM.GetProgramFunction(Token.Index).bPure)
+					{
+						Info.bHasSideEffects = true;
+						Info.bUnknownResults = true;
+					}
+					Sources.Add(-1);
+				}
+				break;
+				case(EMathVMTokenType::JumpIfZero):
+					if (!Sources.IsEmpty())
+					{
+						MATHVM_POP(Sources);
+					}
+					ConditionalEnd = FMath::Max(ConditionalEnd, TokenIndex + 1 + Token.Index);
+					break;
+				case(EMathVMTokenType::Jump):
+					// the value of the first arm is merged with the one of the second arm
+					if (!Sources.IsEmpty())
+					{
+						MATHVM_POP(Sources);
+					}
+					MergeTargets.Add({ TokenIndex + 1 + Token.Index, false });
+					ConditionalEnd = FMath::Max(ConditionalEnd, TokenIndex + 1 + Token.Index);
+					break;
+				case(EMathVMTokenType::RangeSum):
+				case(EMathVMTokenType::RangeProduct):
+				{
+					// the bounds and the variable, assigned (and restored) for each step
+					const int32 B = Sources.IsEmpty() ? -1 : MATHVM_POP(Sources);
+					const int32 A = Sources.IsEmpty() ? -1 : MATHVM_POP(Sources);
+					const int32 Variable = Sources.IsEmpty() ? -1 : MATHVM_POP(Sources);
+					if (Variable >= 0)
+					{
+						const int32 Slot = MathVM.GetSymbolBinding(Statement[Variable].Index).Variable;
+						Info.Defs.Add(Slot);
+						Info.DefTokens.Add(TokenIndex);
+						Info.TargetTokens.Add(Variable);
+						ConditionalDefs.Add(Slot);
+					}
+					MergeTargets.Add({ TokenIndex + 1 + Token.Index, true });
+					// the expression could be never evaluated
+					ConditionalEnd = FMath::Max(ConditionalEnd, TokenIndex + 1 + Token.Index);
+				}
+				break;
+				default:
+					// Lock and Unlock
+					Info.bHasSideEffects = true;
+					break;
+				}
+			}
+
+			for (int32 MergeIndex = MergeTargets.Num() - 1; MergeIndex >= 0; MergeIndex--)
+			{
+				if (MergeTargets[MergeIndex].Value && !Sources.IsEmpty())
+				{
+					MATHVM_POP(Sources);
+				}
+				Sources.Add(-1);
+			}
+
+			for (int32 TokenIndex = 0; TokenIndex < Statement.Num(); TokenIndex++)
+			{
+				if (Statement[TokenIndex].TokenType == EMathVMTokenType::Variable && !AssignTargets[TokenIndex])
+				{
+					Info.Uses.Add(MathVM.GetSymbolBinding(Statement[TokenIndex].Index).Variable);
+				}
+			}
+			Info.Uses.Append(ConditionalDefs);
+
+			Info.NumResults = Sources.Num();
+		}
+
+		// jump emitted by FoldStatements() whose offset is fixed when the original target is reached
+		struct FPendingJump
+		{
+			int32 Index;
+			int32 Target;
+			// start of the value produced by the select() (for the jump at the end of the first arm) or by the range, -1 otherwise
+			int32 MergedStart;
+			// the value of the range expression is replaced by the result
+			bool bPopsValue = false;
+		};
+
+		struct FSelectState
+		{
+			// the condition is a constant different from zero, the second arm is removed
+			bool bConstantTrue;
+			int32 ConditionStart;
+		};
+
+		TArray<TArray<FMathVMToken>> PruneStatements(const FMathVMBase& MathVM, const TArray<TArray<FMathVMToken>>& Program, const TArray<int32>& OutputSlots, const int32 PopResults)
+		{
+			// backward liveness: a statement is required if it has side effects, if it produces a popped result or if it assigns a live variable
+			TBitArray<> Live(false, MathVM.GetNumVariables());
+			for (const int32 Slot : OutputSlots)
+			{
+				Live[Slot] = true;
+			}
+
+			int32 RemainingResults = PopResults;
+			bool bKeepAllResults = false;
+
+			TArray<bool> Required;
+			Required.AddZeroed(Program.Num());
+
+			for (int32 StatementIndex = Program.Num() - 1; StatementIndex >= 0; StatementIndex--)
+			{
+				FMathVMStatementInfo Info;
+				AnalyzeStatement(MathVM, Program[StatementIndex], Info);
+
+				bool bRequired = Info.bHasSideEffects;
+
+				if (Info.NumResults > 0 && (RemainingResults > 0 || bKeepAllResults))
+				{
+					bRequired = true;
+				}
+
+				for (const int32 Def : Info.Defs)
+				{
+					if (Live[Def])
+					{
+						bRequired = true;
+					}
+				}
+
+				// the values below this statement cannot be matched with the popped results anymore
+				if (Info.bUnknownResults && RemainingResults > 0)
+				{
+					bKeepAllResults = true;
+				}
+				RemainingResults = FMath::Max(0, RemainingResults - Info.NumResults);
+
+				if (bRequired)
+				{
+					Required[StatementIndex] = true;
+
+					for (const int32 Def : Info.Defs)
+					{
+						Live[Def] = false;
+					}
+
+					for (const int32 Use : Info.Uses)
+					{
+						Live[Use] = true;
+					}
+				}
+			}
+
+			TArray<TArray<FMathVMToken>> Variant;
+			for (int32 StatementIndex = 0; StatementIndex < Program.Num(); StatementIndex++)
+			{
+				if (Required[StatementIndex])
+				{
+					Variant.Add(Program[StatementIndex]);
+				}
+			}
+
+			return Variant;
+		}
+	}
+}
+
+int32 FMathVMBase::GetProgramVariant(const TArray<FString>& OutputVariables, const int32 PopResults)
+{
+	if (PopResults < 0 || SymbolBindings.Num() != Symbols.Num())
+	{
+		return -1;
+	}
+
+	const TArray<int32> OutputSlots = GetOutputSlots(OutputVariables);
+
+	FString Key = FString::Printf(TEXT("%d:"), PopResults);
+	for (const int32 Slot : OutputSlots)
+	{
+		Key += FString::Printf(TEXT("%d,"), Slot);
+	}
+
+	if (const int32* Variant = ProgramVariantIndices.Find(Key))
+	{
+		return *Variant;
+	}
+
+	const int32 VariantIndex = ProgramVariants.Add(MathVM::Optimizer::PruneStatements(*this, Statements, OutputSlots, PopResults));
+	ProgramVariantIndices.Add(Key, VariantIndex);
+	return VariantIndex;
+}
+
+int32 FMathVMBase::Specialize(const TMap<FString, double>& KnownValues, const TArray<FString>& OutputVariables, const int32 PopResults)
+{
+	if (PopResults < 0)
+	{
+		SetError("Invalid number of results");
+		return -1;
+	}
+
+	if (SymbolBindings.Num() != Symbols.Num())
+	{
+		SetError("Program not compiled");
+		return -1;
+	}
+
+	return ProgramVariants.Add(MathVM::Optimizer::PruneStatements(*this, FoldStatements(KnownValues), GetOutputSlots(OutputVariables), PopResults));
+}
+
+TArray<TArray<FMathVMToken>> FMathVMBase::FoldStatements(const TMap<FString, double>& KnownValues)
+{
+	// a known variable is baked only before its first assignment (statement and token)
+	TArray<int32> KnownUntil;
+	KnownUntil.Init(-1, GetNumVariables());
+	TArray<int32> KnownUntilToken;
+	KnownUntilToken.Init(-1, GetNumVariables());
+	TArray<double> KnownSlotValues;
+	KnownSlotValues.AddZeroed(GetNumVariables());
+
+	for (const TPair<FString, double>& KnownValue : KnownValues)
+	{
+		const int32 Slot = GetVariableIndex(KnownValue.Key);
+		if (Slot >= 0)
+		{
+			KnownUntil[Slot] = Statements.Num();
+			KnownSlotValues[Slot] = KnownValue.Value;
+		}
+	}
+
+	for (int32 StatementIndex = Statements.Num() - 1; StatementIndex >= 0; StatementIndex--)
+	{
+		FMathVMStatementInfo Info;
+		MathVM::Optimizer::AnalyzeStatement(*this, Statements[StatementIndex], Info);
+		for (int32 DefIndex = 0; DefIndex < Info.Defs.Num(); DefIndex++)
+		{
+			const int32 Def = Info.Defs[DefIndex];
+			if (KnownUntil[Def] > StatementIndex)
+			{
+				KnownUntil[Def] = StatementIndex;
+				KnownUntilToken[Def] = Info.DefTokens[DefIndex];
+			}
+			else if (KnownUntil[Def] == StatementIndex)
+			{
+				KnownUntilToken[Def] = FMath::Min(KnownUntilToken[Def], Info.DefTokens[DefIndex]);
+			}
+		}
+	}
+
+	TArray<TArray<FMathVMToken>> Specialized;
+	Specialized.Reserve(Statements.Num());
+
+	for (int32 StatementIndex = 0; StatementIndex < Statements.Num(); StatementIndex++)
+	{
+		const TArray<FMathVMToken>& Statement = Statements[StatementIndex];
+		TArray<FMathVMToken>& NewStatement = Specialized.AddDefaulted_GetRef();
+		NewStatement.Reserve(Statement.Num());
+
+		// the targets of the assignments are never baked (the defining statement reads the known values before its assignment)
+		FMathVMStatementInfo Info;
+		MathVM::Optimizer::AnalyzeStatement(*this, Statement, Info);
+		TBitArray<> Targets(false, Statement.Num());
+		for (const int32 TargetToken : Info.TargetTokens)
+		{
+			Targets[TargetToken] = true;
+		}
+
+		// symbolic stack: where each value starts in NewStatement and if it is a constant
+		TArray<TPair<int32, bool>> Values;
+		// jumps emitted in NewStatement whose offset is fixed when their target (in Statement) is reached
+		TArray<MathVM::Optimizer::FPendingJump> PendingJumps;
+		// the select() whose first arm is being processed
+		TArray<MathVM::Optimizer::FSelectState> Selects;
+
+		for (int32 TokenIndex = 0; TokenIndex <= Statement.Num(); TokenIndex++)
+		{
+			const int32 Start = NewStatement.Num();
+
+			for (int32 PendingIndex = PendingJumps.Num() - 1; PendingIndex >= 0; PendingIndex--)
+			{
+				const MathVM::Optimizer::FPendingJump& PendingJump = PendingJumps[PendingIndex];
+				if (PendingJump.Target == TokenIndex)
+				{
+					NewStatement[PendingJump.Index].Index = Start - PendingJump.Index - 1;
+					// the arms of a select() are merged at the end of the second one, the range result replaces the value of the expression
+					if (PendingJump.bPopsValue && !Values.IsEmpty())
+					{
+						MATHVM_POP(Values);
+					}
+					if (PendingJump.MergedStart >= 0)
+					{
+						Values.Add({ PendingJump.MergedStart, false });
+					}
+					PendingJumps.RemoveAt(PendingIndex);
+				}
+			}
+
+			if (TokenIndex == Statement.Num())
+			{
+				break;
+			}
+
+			const FMathVMToken& Token = Statement[TokenIndex];
+
+			switch (Token.TokenType)
+			{
+			case(EMathVMTokenType::Number):
+				NewStatement.Add(Token);
+				Values.Add({ Start, true });
+				break;
+			case(EMathVMTokenType::Variable):
+			{
+				const int32 Slot = SymbolBindings[Token.Index].Variable;
+				if (KnownUntil[Slot] > StatementIndex || (KnownUntil[Slot] == StatementIndex && TokenIndex < KnownUntilToken[Slot] && !Targets[TokenIndex]))
+				{
+					NewStatement.Add(FMathVMToken(KnownSlotValues[Slot]));
+					Values.Add({ Start, true });
+				}
+				else
+				{
+					NewStatement.Add(Token);
+					Values.Add({ Start, false });
+				}
+			}
+			break;
+			case(EMathVMTokenType::Swizzle):
+			{
+				const bool bConstant = !Values.IsEmpty() && Values.Last().Value;
+				NewStatement.Add(Token);
+				if (Values.IsEmpty())
+				{
+					Values.Add({ Start, false });
+				}
+				Values.Last().Value = bConstant && FoldConstants(NewStatement, Values.Last().Key);
+			}
+			break;
+			case(EMathVMTokenType::Operator):
+			{
+				const bool bAssign = Token.GetOperator() == EMathVMOperator::Assign;
+				bool bConstant = Values.Num() >= 2 && !bAssign;
+				int32 FirstArg = Start;
+				for (int32 ArgIndex = 0; ArgIndex < 2 && !Values.IsEmpty(); ArgIndex++)
+				{
+					const TPair<int32, bool> Arg = MATHVM_POP(Values);
+					bConstant = bConstant && Arg.Value;
+					FirstArg = Arg.Key;
+				}
+
+				NewStatement.Add(Token);
+				if (!bAssign)
+				{
+					Values.Add({ FirstArg, bConstant && FoldConstants(NewStatement, FirstArg) });
+				}
+			}
+			break;
+			case(EMathVMTokenType::Function):
+			{
+				const FMathVMProgramFunction& Function = ProgramFunctions[Token.Index];
+				// resources can change between executions
+				bool bConstant = Function.bPure && Function.ResourceIndex < 0 && !ResourceFunctions.Contains(Function.Name) && Values.Num() >= Token.DetectedNumArgs;
+				int32 FirstArg = Start;
+				for (int32 ArgIndex = 0; ArgIndex < Token.DetectedNumArgs && !Values.IsEmpty(); ArgIndex++)
+				{
+					const TPair<int32, bool> Arg = MATHVM_POP(Values);
+					bConstant = bConstant && Arg.Value;
+					FirstArg = Arg.Key;
+				}
+
+				NewStatement.Add(Token);
+				Values.Add({ FirstArg, bConstant && FoldConstants(NewStatement, FirstArg) });
+			}
+			break;
+			case(EMathVMTokenType::JumpIfZero):
+			{
+				const TPair<int32, bool> Condition = Values.IsEmpty() ? TPair<int32, bool>(Start, false) : MATHVM_POP(Values);
+				if (Condition.Value)
+				{
+					// constant condition, only one arm is kept
+					const double ConditionValue = NewStatement.Last().NumericValue;
+					NewStatement.SetNum(Condition.Key);
+					if (ConditionValue == 0)
+					{
+						TokenIndex += Token.Index;
+					}
+					else
+					{
+						Selects.Add({ true, Condition.Key });
+					}
+				}
+				else
+				{
+					Selects.Add({ false, Condition.Key });
+					PendingJumps.Add({ NewStatement.Add(Token), TokenIndex + 1 + Token.Index, -1 });
+				}
+			}
+			break;
+			case(EMathVMTokenType::Jump):
+			{
+				const MathVM::Optimizer::FSelectState Select = Selects.IsEmpty() ? MathVM::Optimizer::FSelectState{ false, Start } : MATHVM_POP(Selects);
+				if (Select.bConstantTrue)
+				{
+					// end of the first arm, the second one is skipped
+					TokenIndex += Token.Index;
+				}
+				else
+				{
+					if (!Values.IsEmpty())
+					{
+						MATHVM_POP(Values);
+					}
+					PendingJumps.Add({ NewStatement.Add(Token), TokenIndex + 1 + Token.Index, Select.ConditionStart });
+				}
+			}
+			break;
+			case(EMathVMTokenType::RangeSum):
+			case(EMathVMTokenType::RangeProduct):
+			{
+				// the variable and the bounds
+				int32 FirstArg = Start;
+				for (int32 ArgIndex = 0; ArgIndex < 3 && !Values.IsEmpty(); ArgIndex++)
+				{
+					FirstArg = MATHVM_POP(Values).Key;
+				}
+				PendingJumps.Add({ NewStatement.Add(Token), TokenIndex + 1 + Token.Index, FirstArg, true });
+			}
+			break;
+			default:
+				// Lock and Unlock
+				NewStatement.Add(Token);
+				break;
+			}
+		}
+	}
+
+	return Specialized;
+}
+
+bool FMathVMBase::FoldConstants(TArray<FMathVMToken>& Statement, const int32 Start)
+{
+	FMathVMLocals Locals;
+	FMathVMCallContext CallContext(*this, Locals, nullptr);
+	FString Error;
+
+	// errors (like a division by zero) are left to the runtime
+	if (!ExecuteStatement(CallContext, TConstArrayView<FMathVMToken>(Statement).RightChop(Start), Error))
+	{
+		return false;
+	}
+
+	if (CallContext.Stack.Num() != 1 || CallContext.Stack[0].TokenType != EMathVMTokenType::Number)
+	{
+		return false;
+	}
+
+	Statement.SetNum(Start);
+	Statement.Add(CallContext.Stack[0]);
+	return true;
+}
+
+TArray<int32> FMathVMBase::GetOutputSlots(const TArray<FString>& OutputVariables) const
+{
+	TArray<int32> OutputSlots;
+	for (const FString& OutputVariable : OutputVariables)
+	{
+		// variables not referenced by the program cannot be changed by it
+		const int32 Slot = GetVariableIndex(OutputVariable);
+		if (Slot >= 0)
+		{
+			OutputSlots.AddUnique(Slot);
+		}
+	}
+	OutputSlots.Sort();
+	return OutputSlots;
+}
+
+int32 FMathVMBase::GetNumStatements(const int32 Variant) const
+{
+	if (Variant < 0)
+	{
+		return Statements.Num();
+	}
+
+	if (ProgramVariants.IsValidIndex(Variant))
+	{
+		return ProgramVariants[Variant].Num();
+	}
+
+	return 0;
+}
+
+bool FMathVMBase::GetStatementInfo(const int32 StatementIndex, FMathVMStatementInfo& Info) const
+{
+	if (!Statements.IsValidIndex(StatementIndex) || SymbolBindings.Num() != Symbols.Num())
+	{
+		return false;
+	}
+
+	Info = FMathVMStatementInfo();
+	MathVM::Optimizer::AnalyzeStatement(*this, Statements[StatementIndex], Info);
+	return true;
+}
+
+void FMathVMBase::SetPromotionThreshold(const int32 NumExecutions)
+{
+	PromotionThreshold = NumExecutions;
+}
+
+void FMathVMBase::SetSpecializeGlobals(const bool bEnabled)
+{
+	ResetPromotion();
+	bSpecializeGlobals = bEnabled;
+}
+
+bool FMathVMBase::IsPromoted() const
+{
+	const FMathVMPromotedProgram* Promoted = GetPromotedProgram();
+	return Promoted && IsPromotedProgramValid(*Promoted, nullptr);
+}
+
+void FMathVMBase::WaitForPromotion()
+{
+	TFuture<void> Pending;
+	{
+		FScopeLock ScopeLock(&PromotionLock);
+		Pending = MoveTemp(PendingPromotion);
+	}
+
+	if (Pending.IsValid())
+	{
+		Pending.Wait();
+	}
+}
+
+void FMathVMBase::ResetPromotion()
+{
+	WaitForPromotion();
+
+	FScopeLock ScopeLock(&PromotionLock);
+	PromotedProgram.store(nullptr, std::memory_order_release);
+	PromotedPrograms.Empty();
+	NumExecutions.store(0, std::memory_order_relaxed);
+}
+
+void FMathVMBase::StartPromotion()
+{
+	FScopeLock ScopeLock(&PromotionLock);
+
+	if (PromotedPrograms.Num() >= MaxPromotedPrograms)
+	{
+		return;
+	}
+
+	TUniquePtr<FMathVMPromotedProgram> NewProgram = MakeUnique<FMathVMPromotedProgram>();
+	TMap<FString, double> KnownValues;
+
+	if (bSpecializeGlobals)
+	{
+		// the version is read before the values, so a concurrent change fails the guard
+		NewProgram->GlobalsVersion = GlobalsVersion.load(std::memory_order_acquire);
+		NewProgram->bGuarded = true;
+
+		// globals assigned by the program change at every execution
+		TBitArray<> Assigned(false, GetNumVariables());
+		for (int32 StatementIndex = 0; StatementIndex < Statements.Num(); StatementIndex++)
+		{
+			FMathVMStatementInfo Info;
+			MathVM::Optimizer::AnalyzeStatement(*this, Statements[StatementIndex], Info);
+			for (const int32 Def : Info.Defs)
+			{
+				Assigned[Def] = true;
+			}
+		}
+
+		for (const TPair<FString, int32>& GlobalVariableIndex : GlobalVariableIndices)
+		{
+			const int32 Slot = GetVariableIndex(GlobalVariableIndex.Key);
+			if (Slot >= 0 && !Assigned[Slot])
+			{
+				KnownValues.Add(GlobalVariableIndex.Key, GlobalVariables[GlobalVariableIndex.Value]);
+				NewProgram->BakedSlots.Add(Slot);
+			}
+		}
+	}
+
+	// the task never touches the VM state (it can be compiled, reset or rebound in the meantime)
+	TSharedRef<FMathVMBase> Snapshot = MakeShared<FMathVMBase>();
+	CopyProgram(*Snapshot);
+	const uint32 SnapshotVersion = ProgramVersion.load(std::memory_order_acquire);
+
+	PendingPromotion = Async(EAsyncExecution::ThreadPool, [this, Snapshot, NewProgram = MoveTemp(NewProgram), KnownValues = MoveTemp(KnownValues), SnapshotVersion]() mutable
+		{
+			NewProgram->Statements = Snapshot->FoldStatements(KnownValues);
+
+			FScopeLock ScopeLock(&PromotionLock);
+			// the optimized program does not match the current one anymore
+			if (ProgramVersion.load(std::memory_order_acquire) != SnapshotVersion)
+			{
+				return;
+			}
+
+			PromotedProgram.store(NewProgram.Get(), std::memory_order_release);
+			PromotedPrograms.Add(MoveTemp(NewProgram));
+		});
+}
+
+void FMathVMBase::CopyProgram(FMathVMBase& Target) const
+{
+	Target.Statements = Statements;
+	Target.Symbols = Symbols;
+	Target.NumCompiledSymbols = NumCompiledSymbols;
+	Target.SymbolBindings = SymbolBindings;
+	Target.VariableIndices = VariableIndices;
+	Target.ProgramFunctions = ProgramFunctions;
+	Target.ProgramFunctionIndices = ProgramFunctionIndices;
+	Target.Functions = Functions;
+	Target.ResourceFunctions = ResourceFunctions;
+	Target.PureFunctions = PureFunctions;
+	Target.SelectFunctions = SelectFunctions;
+	Target.RangeFunctions = RangeFunctions;
+	Target.MaxRangeIterations = MaxRangeIterations;
+	Target.GlobalVariableIndices = GlobalVariableIndices;
+	Target.GlobalVariables = GlobalVariables;
+	Target.GlobalVectorIndices = GlobalVectorIndices;
+	Target.GlobalVectors = GlobalVectors;
+	Target.Resources = Resources;
+	Target.ResourceNames = ResourceNames;
+}
+
+const FMathVMPromotedProgram* FMathVMBase::GetPromotedProgram() const
+{
+	return PromotedProgram.load(std::memory_order_acquire);
+}
+
+bool FMathVMBase::IsPromotedProgramValid(const FMathVMPromotedProgram& Program, const FMathVMLocals* Locals) const
+{
+	if (!Program.bGuarded)
+	{
+		return true;
+	}
+
+	if (Program.GlobalsVersion != GlobalsVersion.load(std::memory_order_acquire))
+	{
+		return false;
+	}
+
+	if (Locals)
+	{
+		for (const int32 Slot : Program.BakedSlots)
+		{
+			if (Locals->IsSet(Slot))
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
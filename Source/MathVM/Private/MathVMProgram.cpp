@@ -0,0 +1,175 @@
+// Copyright 2024, Roberto De Ioris.
+
+
+#include "MathVMProgram.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+#include "UObject/ObjectSaveContext.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogMathVMProgram, Log, All);
+
+bool UMathVMProgram::Compile()
+{
+	CompiledProgram.Empty();
+	CompileError.Empty();
+	bUnknownFunctions = false;
+
+	if (Code.IsEmpty())
+	{
+		CompileError = "Empty Code";
+		return false;
+	}
+
+	FMathVM MathVM;
+	if (!RegisterLibraries(MathVM, CompileError))
+	{
+		return false;
+	}
+
+	if (!MathVM.TokenizeAndCompile(Code))
+	{
+		CompileError = MathVM.GetError();
+		bUnknownFunctions = CompileError.StartsWith(TEXT("Unknown function "), ESearchCase::CaseSensitive);
+		return false;
+	}
+
+	FMemoryWriter Writer(CompiledProgram);
+	if (!MathVM.SaveProgram(Writer))
+	{
+		CompiledProgram.Empty();
+		CompileError = MathVM.GetError();
+		return false;
+	}
+
+	CompiledLibrariesHash = GetLibrariesHash();
+
+	return true;
+}
+
+bool UMathVMProgram::Load(FMathVMBase& MathVM, FString& Error) const
+{
+	// the inline functions of the libraries are expanded in the compiled program, so it is stale when a library changes
+	if (!CompiledProgram.IsEmpty() && CompiledLibrariesHash == GetLibrariesHash())
+	{
+		FMemoryReader Reader(CompiledProgram);
+		if (MathVM.LoadProgram(Reader))
+		{
+			return true;
+		}
+	}
+
+	if (Code.IsEmpty())
+	{
+		Error = "Empty Code";
+		return false;
+	}
+
+	MathVM.Reset();
+	if (!RegisterLibraries(MathVM, Error))
+	{
+		return false;
+	}
+
+	if (!MathVM.TokenizeAndCompile(Code))
+	{
+		Error = MathVM.GetError();
+		return false;
+	}
+
+	return true;
+}
+
+bool UMathVMProgram::RegisterLibraries(FMathVMBase& MathVM, FString& Error) const
+{
+	// depth first, so that a library can use the functions of its own libraries (cycles are skipped)
+	TArray<const UMathVMProgram*> Visited;
+	TFunction<bool(const UMathVMProgram*)> RegisterLibrariesOf = [&](const UMathVMProgram* Program) -> bool
+		{
+			Visited.Add(Program);
+			for (const UMathVMProgram* Library : Program->Libraries)
+			{
+				if (!Library || Visited.Contains(Library))
+				{
+					continue;
+				}
+
+				if (!RegisterLibrariesOf(Library))
+				{
+					return false;
+				}
+
+				if (!MathVM.RegisterInlineFunctions(Library->Code))
+				{
+					Error = FString::Printf(TEXT("%s: %s"), *Library->GetName(), *MathVM.GetError());
+					return false;
+				}
+			}
+			return true;
+		};
+
+	return RegisterLibrariesOf(this);
+}
+
+uint32 UMathVMProgram::GetLibrariesHash() const
+{
+	// same visit order of RegisterLibraries()
+	uint32 Hash = 0;
+	TArray<const UMathVMProgram*> Visited;
+	TFunction<void(const UMathVMProgram*)> HashLibrariesOf = [&](const UMathVMProgram* Program)
+		{
+			Visited.Add(Program);
+			for (const UMathVMProgram* Library : Program->Libraries)
+			{
+				if (!Library || Visited.Contains(Library))
+				{
+					continue;
+				}
+
+				HashLibrariesOf(Library);
+				Hash = HashCombine(Hash, GetTypeHash(Library->Code));
+			}
+		};
+
+	HashLibrariesOf(this);
+	return Hash;
+}
+
+const TArray<uint8>& UMathVMProgram::GetCompiledProgram() const
+{
+	return CompiledProgram;
+}
+
+void UMathVMProgram::PreSave(FObjectPreSaveContext ObjectSaveContext)
+{
+	Super::PreSave(ObjectSaveContext);
+
+	if (!Compile())
+	{
+		if (bUnknownFunctions)
+		{
+			// Load() compiles the code with the functions registered in the VM
+			UE_LOG(LogMathVMProgram, Warning, TEXT("%s: %s (the code will be compiled at runtime)"), *GetPathName(), *CompileError);
+		}
+		else if (ObjectSaveContext.IsCooking())
+		{
+			UE_LOG(LogMathVMProgram, Error, TEXT("%s: %s"), *GetPathName(), *CompileError);
+		}
+		else
+		{
+			UE_LOG(LogMathVMProgram, Warning, TEXT("%s: %s"), *GetPathName(), *CompileError);
+		}
+	}
+}
+
+#if WITH_EDITOR
+void UMathVMProgram::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)
+{
+	Super::PostEditChangeProperty(PropertyChangedEvent);
+
+	if (PropertyChangedEvent.GetPropertyName() == GET_MEMBER_NAME_CHECKED(UMathVMProgram, Code) || PropertyChangedEvent.GetPropertyName() == GET_MEMBER_NAME_CHECKED(UMathVMProgram, Libraries))
+	{
+		// immediate feedback in the details panel
+		Compile();
+	}
+}
+#endif
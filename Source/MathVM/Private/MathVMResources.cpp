@@ -1,96 +1,491 @@
 // Copyright 2024, Roberto De Ioris.
 
 #include "MathVMResources.h"
+#include "HAL/PlatformFileManager.h"
 #include "TextureResource.h"
+#include <atomic>
 
-FMathVMTexture2DResource::FMathVMTexture2DResource(UTexture2D* Texture)
+namespace MathVM
 {
-	const TIndirectArray<FTexture2DMipMap>& Mips = Texture->GetPlatformMips();
-	if (Mips.Num() > 0)
+	namespace Utils
 	{
-		Width = Mips[0].SizeX;
-		Height = Mips[0].SizeY;
-		PixelFormat = Texture->GetPixelFormat();
-		if (Width > 0 && Height > 0)
+		// 4 independent accumulators allow the compiler to vectorize the loop
+		template<typename OperatorType>
+		double ReduceValues(const double* Values, const int32 NumValues, const double InitialValue, OperatorType Operator)
 		{
-			const void* Data = Mips[0].BulkData.LockReadOnly();
-			if (Data)
+			double Accumulators[4] = { InitialValue, InitialValue, InitialValue, InitialValue };
+
+			int32 Index = 0;
+			for (; Index + 4 <= NumValues; Index += 4)
+			{
+				Accumulators[0] = Operator(Accumulators[0], Values[Index]);
+				Accumulators[1] = Operator(Accumulators[1], Values[Index + 1]);
+				Accumulators[2] = Operator(Accumulators[2], Values[Index + 2]);
+				Accumulators[3] = Operator(Accumulators[3], Values[Index + 3]);
+			}
+
+			double Result = Operator(Operator(Accumulators[0], Accumulators[1]), Operator(Accumulators[2], Accumulators[3]));
+			for (; Index < NumValues; Index++)
 			{
-				Pixels.AddUninitialized(Mips[0].BulkData.GetBulkDataSize());
-				FMemory::Memcpy(Pixels.GetData(), Data, Pixels.Num());
-				Mips[0].BulkData.Unlock();
+				Result = Operator(Result, Values[Index]);
 			}
+
+			return Result;
 		}
 	}
 }
 
-double FMathVMTexture2DResource::Read(const TArray<double>& Args) const
+bool MathVM::Utils::Reduce(const EMathVMResourceReduction Reduction, TConstArrayView<double> Values, double& Result)
 {
-	if (Args.Num() < 1 || Pixels.IsEmpty())
+	if (Values.IsEmpty())
 	{
-		return 0;
+		return false;
 	}
 
-	const int32 Channel = static_cast<int32>(Args[0]);
+	switch (Reduction)
+	{
+	case(EMathVMResourceReduction::Sum):
+		Result = ReduceValues(Values.GetData(), Values.Num(), 0, [](const double A, const double B) { return A + B; });
+		return true;
+	case(EMathVMResourceReduction::Min):
+		Result = ReduceValues(Values.GetData(), Values.Num(), Values[0], [](const double A, const double B) { return FMath::Min(A, B); });
+		return true;
+	case(EMathVMResourceReduction::Max):
+		Result = ReduceValues(Values.GetData(), Values.Num(), Values[0], [](const double A, const double B) { return FMath::Max(A, B); });
+		return true;
+	default:
+		break;
+	}
+
+	return false;
+}
 
-	double U = 0;
-	double V = 0;
+double MathVM::Utils::Dot(TConstArrayView<double> A, TConstArrayView<double> B)
+{
+	const int32 NumValues = FMath::Min(A.Num(), B.Num());
+	const double* ValuesA = A.GetData();
+	const double* ValuesB = B.GetData();
+
+	double Accumulators[4] = { 0, 0, 0, 0 };
 
-	if (Args.Num() > 1)
+	int32 Index = 0;
+	for (; Index + 4 <= NumValues; Index += 4)
 	{
-		U = Args[1];
-		if (Args.Num() > 2)
-		{
-			V = Args[2];
-		}
+		Accumulators[0] += ValuesA[Index] * ValuesB[Index];
+		Accumulators[1] += ValuesA[Index + 1] * ValuesB[Index + 1];
+		Accumulators[2] += ValuesA[Index + 2] * ValuesB[Index + 2];
+		Accumulators[3] += ValuesA[Index + 3] * ValuesB[Index + 3];
 	}
 
-	int32 X = 0;
-	int32 Y = 0;
+	double Result = (Accumulators[0] + Accumulators[1]) + (Accumulators[2] + Accumulators[3]);
+	for (; Index < NumValues; Index++)
+	{
+		Result += ValuesA[Index] * ValuesB[Index];
+	}
+
+	return Result;
+}
+
+void IMathVMResource::ReadBatch(TConstArrayView<double> Coordinates, const int32 NumCoordinates, TArrayView<double> Results) const
+{
+	const int32 NumElements = NumCoordinates > 0 ? FMath::Min(Results.Num(), Coordinates.Num() / NumCoordinates) : Results.Num();
+
+	TArray<double> Args;
+	Args.AddUninitialized(NumCoordinates);
 
-	if (Width > 1)
+	for (int32 ElementIndex = 0; ElementIndex < NumElements; ElementIndex++)
 	{
-		X = static_cast<int32>(Width * U) % (Width - 1);
+		FMemory::Memcpy(Args.GetData(), Coordinates.GetData() + ElementIndex * NumCoordinates, sizeof(double) * NumCoordinates);
+		Results[ElementIndex] = Read(Args);
 	}
+}
+
+void IMathVMResource::WriteBatch(TConstArrayView<double> Coordinates, const int32 NumCoordinates, TConstArrayView<double> Values)
+{
+	const int32 NumElements = NumCoordinates > 0 ? FMath::Min(Values.Num(), Coordinates.Num() / NumCoordinates) : Values.Num();
 
-	if (Height > 1)
+	TArray<double> Args;
+	Args.AddUninitialized(NumCoordinates + 1);
+
+	for (int32 ElementIndex = 0; ElementIndex < NumElements; ElementIndex++)
 	{
-		Y = static_cast<int32>(Height * V) % (Height - 1);
+		FMemory::Memcpy(Args.GetData(), Coordinates.GetData() + ElementIndex * NumCoordinates, sizeof(double) * NumCoordinates);
+		Args[NumCoordinates] = Values[ElementIndex];
+		Write(Args);
 	}
+}
 
-	switch (PixelFormat)
+bool IMathVMResource::Reduce(const EMathVMResourceReduction Reduction, const int32 From, const int32 To, const TArray<double>& Args, double& Result) const
+{
+	TConstArrayView<double> LinearView = GetLinearView();
+	if (!Args.IsEmpty() || From < 0 || To > LinearView.Num() || From >= To)
 	{
-	case(EPixelFormat::PF_B8G8R8A8):
+		return false;
+	}
+
+	return MathVM::Utils::Reduce(Reduction, LinearView.Slice(From, To - From), Result);
+}
+
+namespace MathVM
+{
+	namespace Texture
 	{
-		int32 BGRChannel = Channel;
-		if (BGRChannel == 0)
+		// converts interleaved pixels to one float plane per channel (SourceChannels maps planes to the pixel layout).
+		// The layout is known at compile time, so the loop has constant strides and offsets and the compiler can vectorize the de-interleaving.
+		template<typename SourceType, int32... SourceChannels, typename ConverterType>
+		bool ConvertPixels(const uint8* Data, const int64 DataSize, const int32 NumPixels, ConverterType Converter, TArray<float>& Planes)
 		{
-			BGRChannel = 2;
+			constexpr int32 NumChannels = sizeof...(SourceChannels);
+			constexpr int32 Channels[NumChannels] = { SourceChannels... };
+
+			if (DataSize < static_cast<int64>(NumPixels) * NumChannels * static_cast<int64>(sizeof(SourceType)))
+			{
+				return false;
+			}
+
+			const SourceType* RESTRICT Pixels = reinterpret_cast<const SourceType*>(Data);
+			Planes.SetNumUninitialized(NumPixels * NumChannels);
+			float* RESTRICT Output = Planes.GetData();
+
+			for (int32 PixelIndex = 0; PixelIndex < NumPixels; PixelIndex++)
+			{
+				const SourceType* Pixel = Pixels + PixelIndex * NumChannels;
+				for (int32 Channel = 0; Channel < NumChannels; Channel++)
+				{
+					Output[Channel * NumPixels + PixelIndex] = Converter(Pixel[Channels[Channel]]);
+				}
+			}
+
+			return true;
 		}
-		else if (BGRChannel == 2)
+
+		// branchless (so vectorizable) half to float: the exponent is rebiased by a multiplication (denormals included), infinities and NaNs are fixed by a select
+		FORCEINLINE float HalfToFloat(const uint16 Half)
 		{
-			BGRChannel = 0;
+			constexpr float Rebias = 5.192296858534828e33f; // 2^112
+			constexpr float InfNaNThreshold = 65536.0f; // the smallest rebiased value with the maximum half exponent
+
+			uint32 Bits = static_cast<uint32>(Half & 0x7FFF) << 13;
+			float Value = 0;
+			FMemory::Memcpy(&Value, &Bits, sizeof(float));
+			Value *= Rebias;
+			FMemory::Memcpy(&Bits, &Value, sizeof(float));
+			Bits |= Value >= InfNaNThreshold ? 0x7F800000u : 0;
+			Bits |= static_cast<uint32>(Half & 0x8000) << 16;
+			FMemory::Memcpy(&Value, &Bits, sizeof(float));
+			return Value;
 		}
-		const int32 Offset = ((Y * Width + X) * 4) + BGRChannel;
-		if (Pixels.IsValidIndex(Offset))
+
+		double AddressCoordinate(const double Coordinate, const EMathVMTextureAddress Address)
 		{
-			return Pixels[Offset] / 255.0;
+			if (!FMath::IsFinite(Coordinate))
+			{
+				return 0;
+			}
+
+			if (Address == EMathVMTextureAddress::Clamp)
+			{
+				return FMath::Clamp(Coordinate, 0.0, 1.0);
+			}
+
+			return Coordinate - FMath::Floor(Coordinate);
 		}
 	}
-	break;
-	case(EPixelFormat::PF_R8G8B8A8):
+}
+
+FMathVMTexture2DResource::FMathVMTexture2DResource(UTexture2D* Texture, const EMathVMTextureAddress InAddress) : Address(InAddress)
+{
+	const EPixelFormat PixelFormat = Texture->GetPixelFormat();
+	const TIndirectArray<FTexture2DMipMap>& PlatformMips = Texture->GetPlatformMips();
+
+	// streamed mips (usually the top ones) are not resident, so every mip is loaded from the bulk data (the copies must be freed)
+	TArray<void*> MipData;
+	MipData.AddZeroed(PlatformMips.Num());
+	if (FTexturePlatformData* PlatformData = Texture->GetPlatformData())
+	{
+		PlatformData->TryLoadMips(0, MipData.GetData(), Texture->GetPathName());
+	}
+
+	for (int32 MipIndex = 0; MipIndex < PlatformMips.Num(); MipIndex++)
 	{
-		const int32 Offset = ((Y * Width + X) * 4) + Channel;
-		if (Pixels.IsValidIndex(Offset))
+		const FTexture2DMipMap& PlatformMip = PlatformMips[MipIndex];
+		const int64 MipSize = PlatformMip.BulkData.GetBulkDataSize();
+		// the mips following an unavailable one are rebuilt from the last cached mip
+		if (!MipData[MipIndex] || PlatformMip.SizeX < 1 || PlatformMip.SizeY < 1 || MipSize <= 0 || !CacheMip(static_cast<const uint8*>(MipData[MipIndex]), MipSize, PlatformMip.SizeX, PlatformMip.SizeY, PixelFormat))
 		{
-			return Pixels[Offset] / 255.0;
+			break;
 		}
 	}
-	break;
+
+	for (void* Data : MipData)
+	{
+		FMemory::Free(Data);
+	}
+
+#if WITH_EDITORONLY_DATA
+	// compressed (or unsupported) platform formats are decoded from the source data
+	if (Mips.IsEmpty())
+	{
+		CacheSourceMip(Texture);
+	}
+#endif
+
+	// missing (not generated) mips are rebuilt from the last available one
+	BuildMipChain();
+}
+
+bool FMathVMTexture2DResource::IsValid() const
+{
+	return !Mips.IsEmpty();
+}
+
+bool FMathVMTexture2DResource::CacheMip(const uint8* Data, const int64 DataSize, const int32 Width, const int32 Height, const EPixelFormat Format)
+{
+	auto Unorm8 = [](const uint8 Value) -> float { return Value / 255.0f; };
+	auto Unorm16 = [](const uint16 Value) -> float { return Value / 65535.0f; };
+	auto Half = [](const uint16 Value) -> float { return MathVM::Texture::HalfToFloat(Value); };
+	auto Float = [](const float Value) -> float { return Value; };
+
+	FMip Mip;
+	Mip.Width = Width;
+	Mip.Height = Height;
+
+	const int32 NumPixels = Width * Height;
+	bool bSuccess = false;
+
+	switch (Format)
+	{
+	case(EPixelFormat::PF_B8G8R8A8):
+		Mip.NumChannels = 4;
+		bSuccess = MathVM::Texture::ConvertPixels<uint8, 2, 1, 0, 3>(Data, DataSize, NumPixels, Unorm8, Mip.Planes);
+		break;
+	case(EPixelFormat::PF_R8G8B8A8):
+		Mip.NumChannels = 4;
+		bSuccess = MathVM::Texture::ConvertPixels<uint8, 0, 1, 2, 3>(Data, DataSize, NumPixels, Unorm8, Mip.Planes);
+		break;
+	case(EPixelFormat::PF_G8):
+		Mip.NumChannels = 1;
+		bSuccess = MathVM::Texture::ConvertPixels<uint8, 0>(Data, DataSize, NumPixels, Unorm8, Mip.Planes);
+		break;
+	case(EPixelFormat::PF_G16):
+		Mip.NumChannels = 1;
+		bSuccess = MathVM::Texture::ConvertPixels<uint16, 0>(Data, DataSize, NumPixels, Unorm16, Mip.Planes);
+		break;
+	case(EPixelFormat::PF_A16B16G16R16):
+		Mip.NumChannels = 4;
+		bSuccess = MathVM::Texture::ConvertPixels<uint16, 0, 1, 2, 3>(Data, DataSize, NumPixels, Unorm16, Mip.Planes);
+		break;
+	case(EPixelFormat::PF_R16F):
+		Mip.NumChannels = 1;
+		bSuccess = MathVM::Texture::ConvertPixels<uint16, 0>(Data, DataSize, NumPixels, Half, Mip.Planes);
+		break;
+	case(EPixelFormat::PF_FloatRGBA):
+		Mip.NumChannels = 4;
+		bSuccess = MathVM::Texture::ConvertPixels<uint16, 0, 1, 2, 3>(Data, DataSize, NumPixels, Half, Mip.Planes);
+		break;
+	case(EPixelFormat::PF_R32_FLOAT):
+		Mip.NumChannels = 1;
+		bSuccess = MathVM::Texture::ConvertPixels<float, 0>(Data, DataSize, NumPixels, Float, Mip.Planes);
+		break;
+	case(EPixelFormat::PF_A32B32G32R32F):
+		Mip.NumChannels = 4;
+		bSuccess = MathVM::Texture::ConvertPixels<float, 0, 1, 2, 3>(Data, DataSize, NumPixels, Float, Mip.Planes);
+		break;
 	default:
 		break;
 	}
-	return 0;
+
+	if (!bSuccess)
+	{
+		return false;
+	}
+
+	Mips.Add(MoveTemp(Mip));
+	return true;
+}
+
+#if WITH_EDITORONLY_DATA
+bool FMathVMTexture2DResource::CacheSourceMip(UTexture2D* Texture)
+{
+	if (!Texture->Source.IsValid())
+	{
+		return false;
+	}
+
+	EPixelFormat Format = EPixelFormat::PF_Unknown;
+	switch (Texture->Source.GetFormat())
+	{
+	case(ETextureSourceFormat::TSF_BGRA8):
+		Format = EPixelFormat::PF_B8G8R8A8;
+		break;
+	case(ETextureSourceFormat::TSF_G8):
+		Format = EPixelFormat::PF_G8;
+		break;
+	case(ETextureSourceFormat::TSF_G16):
+		Format = EPixelFormat::PF_G16;
+		break;
+	case(ETextureSourceFormat::TSF_RGBA16):
+		Format = EPixelFormat::PF_A16B16G16R16;
+		break;
+	case(ETextureSourceFormat::TSF_RGBA16F):
+		Format = EPixelFormat::PF_FloatRGBA;
+		break;
+	default:
+		return false;
+	}
+
+	TArray64<uint8> MipData;
+	if (!Texture->Source.GetMipData(MipData, 0, 0, 0))
+	{
+		return false;
+	}
+
+	return CacheMip(MipData.GetData(), MipData.Num(), Texture->Source.GetSizeX(), Texture->Source.GetSizeY(), Format);
+}
+#endif
+
+void FMathVMTexture2DResource::BuildMipChain()
+{
+	while (Mips.Num() > 0 && (Mips.Last().Width > 1 || Mips.Last().Height > 1))
+	{
+		const FMip& Source = Mips.Last();
+
+		FMip Mip;
+		Mip.Width = FMath::Max(Source.Width / 2, 1);
+		Mip.Height = FMath::Max(Source.Height / 2, 1);
+		Mip.NumChannels = Source.NumChannels;
+		Mip.Planes.SetNumUninitialized(Mip.Width * Mip.Height * Mip.NumChannels);
+
+		// 2x2 box filter (odd sizes repeat the last row/column)
+		float* Texel = Mip.Planes.GetData();
+		for (int32 Channel = 0; Channel < Mip.NumChannels; Channel++)
+		{
+			for (int32 Y = 0; Y < Mip.Height; Y++)
+			{
+				const int32 Y0 = FMath::Min(Y * 2, Source.Height - 1);
+				const int32 Y1 = FMath::Min(Y * 2 + 1, Source.Height - 1);
+				for (int32 X = 0; X < Mip.Width; X++)
+				{
+					const int32 X0 = FMath::Min(X * 2, Source.Width - 1);
+					const int32 X1 = FMath::Min(X * 2 + 1, Source.Width - 1);
+					*Texel++ = (Source.GetTexel(Channel, X0, Y0) + Source.GetTexel(Channel, X1, Y0) + Source.GetTexel(Channel, X0, Y1) + Source.GetTexel(Channel, X1, Y1)) * 0.25f;
+				}
+			}
+		}
+
+		Mips.Add(MoveTemp(Mip));
+	}
+}
+
+float FMathVMTexture2DResource::FMip::GetTexel(const int32 Channel, const int32 X, const int32 Y) const
+{
+	if (Channel < 0 || Channel > 3)
+	{
+		return 0;
+	}
+
+	if (Channel >= NumChannels)
+	{
+		// single channel textures are grayscale, missing alpha is opaque
+		if (Channel == 3)
+		{
+			return 1;
+		}
+		return NumChannels == 1 ? Planes[Y * Width + X] : 0;
+	}
+
+	return Planes[(Channel * Height + Y) * Width + X];
+}
+
+int32 FMathVMTexture2DResource::GetNumMips() const
+{
+	return Mips.Num();
+}
+
+int32 FMathVMTexture2DResource::AddressTexel(const int32 Coordinate, const int32 Size) const
+{
+	// coordinates are already addressed in normalized space, so they can only be one texel out of range
+	if (Address == EMathVMTextureAddress::Clamp)
+	{
+		return FMath::Clamp(Coordinate, 0, Size - 1);
+	}
+
+	if (Coordinate < 0)
+	{
+		return Coordinate + Size;
+	}
+
+	return Coordinate >= Size ? Coordinate - Size : Coordinate;
+}
+
+double FMathVMTexture2DResource::SampleBilinear(const FMip& Mip, const int32 Channel, const double U, const double V) const
+{
+	// texel centers are at half coordinates
+	const double X = MathVM::Texture::AddressCoordinate(U, Address) * Mip.Width - 0.5;
+	const double Y = MathVM::Texture::AddressCoordinate(V, Address) * Mip.Height - 0.5;
+
+	const double FloorX = FMath::Floor(X);
+	const double FloorY = FMath::Floor(Y);
+
+	const int32 X0 = AddressTexel(static_cast<int32>(FloorX), Mip.Width);
+	const int32 X1 = AddressTexel(static_cast<int32>(FloorX) + 1, Mip.Width);
+	const int32 Y0 = AddressTexel(static_cast<int32>(FloorY), Mip.Height);
+	const int32 Y1 = AddressTexel(static_cast<int32>(FloorY) + 1, Mip.Height);
+
+	const double Top = FMath::Lerp<double>(Mip.GetTexel(Channel, X0, Y0), Mip.GetTexel(Channel, X1, Y0), X - FloorX);
+	const double Bottom = FMath::Lerp<double>(Mip.GetTexel(Channel, X0, Y1), Mip.GetTexel(Channel, X1, Y1), X - FloorX);
+
+	return FMath::Lerp(Top, Bottom, Y - FloorY);
+}
+
+double FMathVMTexture2DResource::Read(const TArray<double>& Args) const
+{
+	if (Args.Num() < 1 || Mips.IsEmpty())
+	{
+		return 0;
+	}
+
+	const int32 Channel = static_cast<int32>(Args[0]);
+	const double U = Args.Num() > 1 ? Args[1] : 0;
+	const double V = Args.Num() > 2 ? Args[2] : 0;
+	const int32 MipIndex = Args.Num() > 3 && FMath::IsFinite(Args[3]) ? FMath::Clamp(static_cast<int32>(Args[3]), 0, Mips.Num() - 1) : 0;
+
+	const FMip& Mip = Mips[MipIndex];
+
+	const int32 X = FMath::Min(static_cast<int32>(MathVM::Texture::AddressCoordinate(U, Address) * Mip.Width), Mip.Width - 1);
+	const int32 Y = FMath::Min(static_cast<int32>(MathVM::Texture::AddressCoordinate(V, Address) * Mip.Height), Mip.Height - 1);
+
+	return Mip.GetTexel(Channel, X, Y);
+}
+
+double FMathVMTexture2DResource::Sample(const TArray<double>& Args) const
+{
+	if (Args.Num() < 1 || Mips.IsEmpty())
+	{
+		return 0;
+	}
+
+	const int32 Channel = static_cast<int32>(Args[0]);
+	const double U = Args.Num() > 1 ? Args[1] : 0;
+	const double V = Args.Num() > 2 ? Args[2] : 0;
+
+	if (Args.Num() < 4 || !FMath::IsFinite(Args[3]))
+	{
+		return SampleBilinear(Mips[0], Channel, U, V);
+	}
+
+	// trilinear
+	const double Lod = FMath::Clamp(Args[3], 0.0, static_cast<double>(Mips.Num() - 1));
+	const int32 Mip0 = static_cast<int32>(Lod);
+	const int32 Mip1 = FMath::Min(Mip0 + 1, Mips.Num() - 1);
+
+	const double Sample0 = SampleBilinear(Mips[Mip0], Channel, U, V);
+	if (Mip0 == Mip1)
+	{
+		return Sample0;
+	}
+
+	return FMath::Lerp(Sample0, SampleBilinear(Mips[Mip1], Channel, U, V), Lod - Mip0);
 }
 
 void FMathVMTexture2DResource::Write(const TArray<double>& Args)
@@ -98,9 +493,93 @@ void FMathVMTexture2DResource::Write(const TArray<double>& Args)
 
 }
 
-FMathVMCurveBaseResource::FMathVMCurveBaseResource(UCurveBase* Curve)
+FMathVMCurveBaseResource::FMathVMCurveBaseResource(UCurveBase* Curve, const int32 BakeResolution, const double BakeTolerance)
 {
 	Curves = Curve->GetCurves();
+
+	if (BakeResolution > 1)
+	{
+		BakedCurves.SetNum(Curves.Num());
+		for (int32 CurveIndex = 0; CurveIndex < Curves.Num(); CurveIndex++)
+		{
+			if (Curves[CurveIndex].CurveToEdit && !BakeCurve(*Curves[CurveIndex].CurveToEdit, BakeResolution, BakeTolerance, BakedCurves[CurveIndex]))
+			{
+				BakedCurves[CurveIndex] = FBakedCurve();
+			}
+		}
+	}
+}
+
+bool FMathVMCurveBaseResource::BakeCurve(const FRealCurve& Curve, const int32 BakeResolution, const double BakeTolerance, FBakedCurve& BakedCurve) const
+{
+	constexpr int32 MaxBakeResolution = 1 << 16;
+
+	float MinTime = 0;
+	float MaxTime = 0;
+	Curve.GetTimeRange(MinTime, MaxTime);
+	if (MaxTime <= MinTime)
+	{
+		return false;
+	}
+
+	BakedCurve.MinTime = MinTime;
+	BakedCurve.MaxTime = MaxTime;
+
+	for (int32 NumSamples = FMath::Min(BakeResolution, MaxBakeResolution); NumSamples <= MaxBakeResolution; NumSamples *= 2)
+	{
+		const double Step = (BakedCurve.MaxTime - BakedCurve.MinTime) / (NumSamples - 1);
+		BakedCurve.SamplesPerUnit = 1.0 / Step;
+		BakedCurve.Samples.SetNumUninitialized(NumSamples);
+		for (int32 SampleIndex = 0; SampleIndex < NumSamples; SampleIndex++)
+		{
+			BakedCurve.Samples[SampleIndex] = Curve.Eval(BakedCurve.MinTime + Step * SampleIndex, 0);
+		}
+
+		if (BakeTolerance <= 0)
+		{
+			return true;
+		}
+
+		// the worst error of linear interpolation is expected between samples
+		bool bValid = true;
+		for (int32 SampleIndex = 0; SampleIndex < NumSamples - 1; SampleIndex++)
+		{
+			const double Exact = Curve.Eval(BakedCurve.MinTime + Step * (SampleIndex + 0.5), 0);
+			if (FMath::Abs(Exact - (BakedCurve.Samples[SampleIndex] + BakedCurve.Samples[SampleIndex + 1]) * 0.5) > BakeTolerance)
+			{
+				bValid = false;
+				break;
+			}
+		}
+
+		if (bValid)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool FMathVMCurveBaseResource::IsBaked(const int32 CurveIndex) const
+{
+	return BakedCurves.IsValidIndex(CurveIndex) && BakedCurves[CurveIndex].Samples.Num() > 1;
+}
+
+double FMathVMCurveBaseResource::Evaluate(const int32 CurveIndex, const double Time) const
+{
+	if (IsBaked(CurveIndex))
+	{
+		const FBakedCurve& BakedCurve = BakedCurves[CurveIndex];
+		if (Time >= BakedCurve.MinTime && Time <= BakedCurve.MaxTime)
+		{
+			const double Position = (Time - BakedCurve.MinTime) * BakedCurve.SamplesPerUnit;
+			const int32 SampleIndex = FMath::Min(static_cast<int32>(Position), BakedCurve.Samples.Num() - 2);
+			return FMath::Lerp(BakedCurve.Samples[SampleIndex], BakedCurve.Samples[SampleIndex + 1], Position - SampleIndex);
+		}
+	}
+
+	return Curves[CurveIndex].CurveToEdit->Eval(Time, 0);
 }
 
 double FMathVMCurveBaseResource::Read(const TArray<double>& Args) const
@@ -112,99 +591,213 @@ double FMathVMCurveBaseResource::Read(const TArray<double>& Args) const
 
 	if (Curves.IsValidIndex(Args[0]))
 	{
-		return Curves[Args[0]].CurveToEdit->Eval(Args[1], 0);
+		return Evaluate(Args[0], Args[1]);
 	}
 
 	return 0;
 }
 
+void FMathVMCurveBaseResource::ReadBatch(TConstArrayView<double> Coordinates, const int32 NumCoordinates, TArrayView<double> Results) const
+{
+	if (NumCoordinates != 2)
+	{
+		IMathVMResource::ReadBatch(Coordinates, NumCoordinates, Results);
+		return;
+	}
+
+	const int32 NumElements = FMath::Min(Results.Num(), Coordinates.Num() / 2);
+	for (int32 ElementIndex = 0; ElementIndex < NumElements; ElementIndex++)
+	{
+		const int32 CurveIndex = static_cast<int32>(Coordinates[ElementIndex * 2]);
+		Results[ElementIndex] = Curves.IsValidIndex(CurveIndex) ? Evaluate(CurveIndex, Coordinates[ElementIndex * 2 + 1]) : 0;
+	}
+}
+
 void FMathVMCurveBaseResource::Write(const TArray<double>& Args)
 {
 
 }
 
-FMathVMDoubleArrayResource::FMathVMDoubleArrayResource(const int32 ArraySize)
+int32 FMathVMCurveBaseResource::GetNumReadArgs() const
+{
+	return 2;
+}
+
+FMathVMPrivatizedBuffers::FMathVMPrivatizedBuffers()
+{
+	Reset(0);
+}
+
+void FMathVMPrivatizedBuffers::Reset(const int32 InNumElements)
+{
+	static std::atomic<uint64> NextId = 1;
+
+	FScopeLock ScopeLock(&BuffersLock);
+	Id = NextId++;
+	NumElements = InNumElements;
+	Buffers.Empty();
+	BufferThreadIds.Empty();
+}
+
+bool FMathVMPrivatizedBuffers::IsEnabled() const
 {
-	Data.AddZeroed(ArraySize);
+	return NumElements > 0;
 }
 
-double FMathVMDoubleArrayResource::Read(const TArray<double>& Args) const
+double* FMathVMPrivatizedBuffers::GetThreadBuffer()
 {
-	if (Args.Num() < 1)
+	// small direct mapped cache (ids are never reused, so stale entries of destroyed buffers are never matched and get overwritten)
+	struct FThreadBufferCacheEntry
 	{
-		return 0;
+		uint64 Id = 0;
+		double* Buffer = nullptr;
+	};
+	constexpr int32 CacheSize = 8;
+	static thread_local FThreadBufferCacheEntry ThreadBuffers[CacheSize];
+
+	FThreadBufferCacheEntry& CacheEntry = ThreadBuffers[Id % CacheSize];
+	if (CacheEntry.Id == Id)
+	{
+		return CacheEntry.Buffer;
 	}
 
-	if (Data.IsValidIndex(Args[0]))
+	const uint32 ThreadId = FPlatformTLS::GetCurrentThreadId();
+
+	FScopeLock ScopeLock(&BuffersLock);
+	int32 BufferIndex = BufferThreadIds.IndexOfByKey(ThreadId);
+	if (BufferIndex == INDEX_NONE)
 	{
-		return Data[Args[0]];
+		TUniquePtr<TArray<double>> NewBuffer = MakeUnique<TArray<double>>();
+		NewBuffer->SetNumZeroed(NumElements);
+		BufferIndex = Buffers.Add(MoveTemp(NewBuffer));
+		BufferThreadIds.Add(ThreadId);
 	}
 
-	return 0;
+	CacheEntry.Id = Id;
+	CacheEntry.Buffer = Buffers[BufferIndex]->GetData();
+	return CacheEntry.Buffer;
 }
 
-void FMathVMDoubleArrayResource::Write(const TArray<double>& Args)
+void FMathVMPrivatizedBuffers::Flush(TFunctionRef<void(const int32 Index, const double Value)> Merge)
 {
-	if (Args.Num() < 2)
+	FScopeLock ScopeLock(&BuffersLock);
+	for (TUniquePtr<TArray<double>>& Buffer : Buffers)
 	{
-		return;
+		double* Values = Buffer->GetData();
+		for (int32 Index = 0; Index < NumElements; Index++)
+		{
+			if (Values[Index] != 0)
+			{
+				Merge(Index, Values[Index]);
+				Values[Index] = 0;
+			}
+		}
 	}
+}
 
-	if (Data.IsValidIndex(Args[0]))
+FMathVMDoubleArrayResource::FMathVMDoubleArrayResource(const int32 ArraySize) : TMathVMArrayResource<double>(ArraySize)
+{
+}
+
+TConstArrayView<double> FMathVMDoubleArrayResource::GetLinearView() const
+{
+	return Data;
+}
+
+bool FMathVMDoubleArrayResource::Reduce(const EMathVMResourceReduction Reduction, const int32 From, const int32 To, const TArray<double>& Args, double& Result) const
+{
+	// no conversion is required, so the linear view is reduced in place
+	return IMathVMResource::Reduce(Reduction, From, To, Args, Result);
+}
+
+bool FMathVMMappedFile::Open(const FString& Filename)
+{
+	Region.Reset();
+	Handle.Reset(FPlatformFileManager::Get().GetPlatformFile().OpenMapped(*Filename));
+	if (!Handle || Handle->GetFileSize() <= 0)
+	{
+		Handle.Reset();
+		return false;
+	}
+
+	Region.Reset(Handle->MapRegion(0, Handle->GetFileSize()));
+	if (!Region)
+	{
+		Handle.Reset();
+		return false;
+	}
+
+	return true;
+}
+
+const uint8* FMathVMMappedFile::GetData() const
+{
+	return Region ? Region->GetMappedPtr() : nullptr;
+}
+
+int64 FMathVMMappedFile::GetSize() const
+{
+	return Region ? Region->GetMappedSize() : 0;
+}
+
+void FMathVMMappedFile::PreloadHint(const int64 Offset, const int64 Size) const
+{
+	if (Region)
 	{
-		Data[Args[0]] = Args[1];
+		Region->PreloadHint(Offset, Size);
 	}
 }
 
 FMathVMDataTableResource::FMathVMDataTableResource(UDataTable* DataTable, const TArray<FString>& FieldNames)
 {
-	bool bFailed = false;
-	for (auto RowIt = DataTable->GetRowMap().CreateConstIterator(); RowIt; ++RowIt)
+	// properties are resolved only once
+	TArray<FNumericProperty*> Properties;
+	for (const FString& FieldName : FieldNames)
 	{
-		if (bFailed)
+		FNumericProperty* NumericProperty = CastField<FNumericProperty>(DataTable->FindTableProperty(*FieldName));
+		if (!NumericProperty)
 		{
 			return;
 		}
+		Properties.Add(NumericProperty);
+	}
 
-		TArray<double> Fields;
-		Fields.AddZeroed(FieldNames.Num());
+	const TMap<FName, uint8*>& RowMap = DataTable->GetRowMap();
+	NumRows = RowMap.Num();
+	RowIndices.Reserve(NumRows);
 
-		for (int32 FieldIndex = 0; FieldIndex < FieldNames.Num(); FieldIndex++)
-		{
-			const FString& FieldName = FieldNames[FieldIndex];
-
-			FProperty* Property = DataTable->FindTableProperty(*FieldName);
-			if (!Property)
-			{
-				bFailed = true;
-				break;
-			}
+	Columns.SetNum(Properties.Num());
+	for (TArray<double>& Column : Columns)
+	{
+		Column.SetNumZeroed(NumRows);
+	}
 
-			FNumericProperty* NumericProperty = CastField<FNumericProperty>(Property);
-			if (!NumericProperty)
-			{
-				bFailed = true;
-				break;
-			}
+	int32 RowIndex = 0;
+	for (const TPair<FName, uint8*>& Pair : RowMap)
+	{
+		RowIndices.Add(Pair.Key, RowIndex);
 
-			uint8* RowData = NumericProperty->ContainerPtrToValuePtr<uint8>(RowIt.Value());
+		for (int32 FieldIndex = 0; FieldIndex < Properties.Num(); FieldIndex++)
+		{
+			const FNumericProperty* NumericProperty = Properties[FieldIndex];
+			const uint8* RowData = NumericProperty->ContainerPtrToValuePtr<uint8>(Pair.Value);
 
 			if (NumericProperty->IsFloatingPoint())
 			{
-				Fields[FieldIndex] = NumericProperty->GetFloatingPointPropertyValue(RowData);
+				Columns[FieldIndex][RowIndex] = NumericProperty->GetFloatingPointPropertyValue(RowData);
 			}
 			else if (NumericProperty->IsInteger())
 			{
-				Fields[FieldIndex] = static_cast<double>(NumericProperty->GetSignedIntPropertyValue(RowData));
+				Columns[FieldIndex][RowIndex] = static_cast<double>(NumericProperty->GetSignedIntPropertyValue(RowData));
 			}
 		}
 
-		if (bFailed)
-		{
-			return;
-		}
+		RowIndex++;
+	}
 
-		Data.Add(MoveTemp(Fields));
+	for (int32 FieldIndex = 0; FieldIndex < FieldNames.Num(); FieldIndex++)
+	{
+		FieldIndices.FindOrAdd(FieldNames[FieldIndex], FieldIndex);
 	}
 }
 
@@ -215,9 +808,12 @@ double FMathVMDataTableResource::Read(const TArray<double>& Args) const
 		return 0;
 	}
 
-	if (Data.IsValidIndex(Args[0]) && Data[Args[0]].IsValidIndex(Args[1]))
+	const int32 Row = static_cast<int32>(Args[0]);
+	const int32 Column = static_cast<int32>(Args[1]);
+
+	if (Columns.IsValidIndex(Column) && Columns[Column].IsValidIndex(Row))
 	{
-		return Data[Args[0]][Args[1]];
+		return Columns[Column][Row];
 	}
 
 	return 0;
@@ -225,4 +821,96 @@ double FMathVMDataTableResource::Read(const TArray<double>& Args) const
 
 void FMathVMDataTableResource::Write(const TArray<double>& Args)
 {
+}
+
+int32 FMathVMDataTableResource::GetNumReadArgs() const
+{
+	return 2;
+}
+
+void FMathVMDataTableResource::ReadBatch(TConstArrayView<double> Coordinates, const int32 NumCoordinates, TArrayView<double> Results) const
+{
+	if (NumCoordinates != 2)
+	{
+		IMathVMResource::ReadBatch(Coordinates, NumCoordinates, Results);
+		return;
+	}
+
+	const int32 NumElements = FMath::Min(Results.Num(), Coordinates.Num() / 2);
+	for (int32 ElementIndex = 0; ElementIndex < NumElements; ElementIndex++)
+	{
+		const int32 Row = static_cast<int32>(Coordinates[ElementIndex * 2]);
+		const int32 Column = static_cast<int32>(Coordinates[ElementIndex * 2 + 1]);
+		Results[ElementIndex] = Columns.IsValidIndex(Column) && Columns[Column].IsValidIndex(Row) ? Columns[Column][Row] : 0;
+	}
+}
+
+bool FMathVMDataTableResource::Reduce(const EMathVMResourceReduction Reduction, const int32 From, const int32 To, const TArray<double>& Args, double& Result) const
+{
+	if (Args.Num() != 1)
+	{
+		return false;
+	}
+
+	TConstArrayView<double> Column = GetColumn(static_cast<int32>(Args[0]));
+	if (From < 0 || To > Column.Num() || From >= To)
+	{
+		return false;
+	}
+
+	return MathVM::Utils::Reduce(Reduction, Column.Slice(From, To - From), Result);
+}
+
+bool FMathVMDataTableResource::ResolveArgument(const int32 Coordinate, const FString& Name, double& Value) const
+{
+	int32 Index = -1;
+	if (Coordinate == 0)
+	{
+		// FNAME_Find avoids adding unknown symbols to the names table
+		Index = GetRowIndex(FName(*Name, FNAME_Find));
+	}
+	else if (Coordinate == 1)
+	{
+		Index = GetFieldIndex(Name);
+	}
+
+	if (Index < 0)
+	{
+		return false;
+	}
+
+	Value = Index;
+	return true;
+}
+
+int32 FMathVMDataTableResource::GetNumRows() const
+{
+	return NumRows;
+}
+
+int32 FMathVMDataTableResource::GetRowIndex(const FName& RowName) const
+{
+	if (RowName.IsNone())
+	{
+		return -1;
+	}
+
+	const int32* RowIndex = RowIndices.Find(RowName);
+	return RowIndex ? *RowIndex : -1;
+}
+
+int32 FMathVMDataTableResource::GetFieldIndex(const FString& FieldName) const
+{
+	const int32* FieldIndex = FieldIndices.Find(FieldName);
+	return FieldIndex ? *FieldIndex : -1;
+}
+
+TConstArrayView<double> FMathVMDataTableResource::GetColumn(const int32 FieldIndex) const
+{
+	if (!Columns.IsValidIndex(FieldIndex))
+	{
+		return TConstArrayView<double>();
+	}
+
+	return Columns[FieldIndex];
 }
\ No newline at end of file
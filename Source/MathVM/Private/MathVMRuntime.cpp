@@ -12,42 +12,126 @@ bool FMathVMBase::TokenizeAndCompile(const FString& Code)
 	return Compile();
 }
 
-bool FMathVMBase::ExecuteStatement(FMathVMCallContext& CallContext, const TArray<const FMathVMToken*> Statement, FString& Error)
+bool FMathVMBase::ExecuteStatement(FMathVMCallContext& CallContext, TConstArrayView<FMathVMToken> Statement, FString& Error)
 {
-	for (const FMathVMToken* Token : Statement)
+	// end token and starting stack depth of every select() arm being executed
+	TArray<TPair<int32, int32>, TInlineAllocator<4>> PendingArms;
+
+	auto CheckArms = [&CallContext, &PendingArms, &Error](const int32 TokenIndex)
+		{
+			while (!PendingArms.IsEmpty() && PendingArms.Last().Key == TokenIndex)
+			{
+				if (CallContext.Stack.Num() != MATHVM_POP(PendingArms).Value + 1)
+				{
+					Error = TEXT("The arms of select() must produce a single value");
+					return false;
+				}
+			}
+			return true;
+		};
+
+	for (int32 TokenIndex = 0; TokenIndex < Statement.Num(); TokenIndex++)
 	{
-		if (Token->TokenType == EMathVMTokenType::Operator)
+		if (!CheckArms(TokenIndex))
 		{
-			if (!Token->Operator(CallContext))
+			return false;
+		}
+
+		const FMathVMToken& Token = Statement[TokenIndex];
+
+		if (Token.TokenType == EMathVMTokenType::Operator)
+		{
+			if (!CallOperator(CallContext, Token.GetOperator()))
 			{
 				Error = CallContext.LastError;
 				return false;
 			}
 		}
-		else if (Token->TokenType == EMathVMTokenType::Function)
+		else if (Token.TokenType == EMathVMTokenType::Function)
 		{
+			const FMathVMProgramFunction& Function = ProgramFunctions[Token.Index];
+
 			TArray<double> Args;
-			Args.AddUninitialized(Token->DetectedNumArgs);
+			Args.AddUninitialized(Token.DetectedNumArgs);
 
-			for (int32 ArgIndex = 0; ArgIndex < Token->DetectedNumArgs; ArgIndex++)
+			bool bHasVectors = false;
+			for (int32 ArgIndex = 0; ArgIndex < Token.DetectedNumArgs; ArgIndex++)
 			{
-				if (!CallContext.PopArgument(Args[(Token->DetectedNumArgs - 1) - ArgIndex]))
+				FMathVMVector Value;
+				if (!CallContext.PopVector(Value))
 				{
 					Error = CallContext.LastError;
 					return false;
 				}
+
+				const int32 Slot = (Token.DetectedNumArgs - 1) - ArgIndex;
+				Args[Slot] = Value.Value.X;
+				// vectors are flattened into their components
+				if (Value.NumComponents > 1)
+				{
+					Args.Insert(&Value.Value.Y, Value.NumComponents - 1, Slot + 1);
+					bHasVectors = true;
+				}
+			}
+
+			if (bHasVectors && Function.NumArgs >= 0 && Args.Num() != Function.NumArgs)
+			{
+				Error = FString::Printf(TEXT("Function %s expects %d argument%s (detected %d after vectors expansion)"), *Function.Name, Function.NumArgs, Function.NumArgs == 1 ? TEXT("") : TEXT("s"), Args.Num());
+				return false;
 			}
-			if (!Token->Function(CallContext, Args))
+
+			if (!Function.Function(CallContext, Args))
 			{
 				Error = CallContext.LastError;
 				return false;
 			}
 		}
-		else if (Token->TokenType == EMathVMTokenType::Lock)
+		else if (Token.TokenType == EMathVMTokenType::Swizzle)
+		{
+			if (!CallContext.Swizzle(Symbols.GetName(Token.Index)))
+			{
+				Error = CallContext.LastError;
+				return false;
+			}
+		}
+		else if (Token.TokenType == EMathVMTokenType::JumpIfZero)
+		{
+			double Condition = 0;
+			if (!CallContext.PopArgument(Condition))
+			{
+				Error = CallContext.LastError;
+				return false;
+			}
+
+			// condition JumpIfZero(a + 1) a Jump(b) b
+			const int32 JumpIndex = TokenIndex + Token.Index;
+			if (Condition == 0)
+			{
+				PendingArms.Add({ JumpIndex + 1 + Statement[JumpIndex].Index, CallContext.Stack.Num() });
+				TokenIndex = JumpIndex;
+			}
+			else
+			{
+				PendingArms.Add({ JumpIndex, CallContext.Stack.Num() });
+			}
+		}
+		else if (Token.TokenType == EMathVMTokenType::Jump)
+		{
+			TokenIndex += Token.Index;
+		}
+		else if (Token.TokenType == EMathVMTokenType::RangeSum || Token.TokenType == EMathVMTokenType::RangeProduct)
+		{
+			if (!ExecuteRange(CallContext, Token, Statement.Slice(TokenIndex + 1, Token.Index), Error))
+			{
+				return false;
+			}
+			TokenIndex += Token.Index;
+		}
+		else if (Token.TokenType == EMathVMTokenType::Lock)
 		{
 			Lock.Lock();
 		}
-		else if (Token->TokenType == EMathVMTokenType::Unlock)
+		else if (Token.TokenType == EMathVMTokenType::Unlock)
 		{
 			Lock.Unlock();
 		}
@@ -57,10 +141,77 @@ bool FMathVMBase::ExecuteStatement(FMathVMCallContext& CallContext, const TArray
 		}
 	}
 
-	return true;
+	return CheckArms(Statement.Num());
+}
+
+bool FMathVMBase::ExecuteRange(FMathVMCallContext& CallContext, const FMathVMToken& RangeToken, TConstArrayView<FMathVMToken> Expression, FString& Error)
+{
+	double From = 0;
+	double To = 0;
+	int32 SymbolIndex = -1;
+	if (!CallContext.PopArgument(To) || !CallContext.PopArgument(From) || !CallContext.PopSymbol(SymbolIndex))
+	{
+		Error = CallContext.LastError;
+		return false;
+	}
+
+	// both bounds are included
+	const double NumIterations = To >= From ? FMath::FloorToDouble(To - From) + 1 : 0;
+	if (NumIterations > MaxRangeIterations)
+	{
+		Error = FString::Printf(TEXT("Range of %.0f steps exceeds the limit of %d"), NumIterations, MaxRangeIterations);
+		return false;
+	}
+
+	// the variable is scoped to the expression
+	const int32 Slot = SymbolBindings[SymbolIndex].Variable;
+	const FMathVMVector PreviousValue = CallContext.Locals.Values[Slot];
+
+	const bool bSum = RangeToken.TokenType == EMathVMTokenType::RangeSum;
+	double Result = bSum ? 0 : 1;
+
+	bool bSuccess = true;
+	for (int32 Step = 0; Step < static_cast<int32>(NumIterations); Step++)
+	{
+		CallContext.Locals.Values[Slot] = FMathVMVector(From + Step);
+
+		double Value = 0;
+		const int32 StackDepth = CallContext.Stack.Num();
+		if (!ExecuteStatement(CallContext, Expression, Error))
+		{
+			bSuccess = false;
+			break;
+		}
+
+		if (CallContext.Stack.Num() != StackDepth + 1)
+		{
+			Error = TEXT("The expression of sum() and prod() must produce a single value");
+			bSuccess = false;
+			break;
+		}
+
+		if (!CallContext.PopArgument(Value))
+		{
+			Error = CallContext.LastError;
+			bSuccess = false;
+			break;
+		}
+
+		Result = bSum ? Result + Value : Result * Value;
+	}
+
+	CallContext.Locals.Values[Slot] = PreviousValue;
+
+	return bSuccess && CallContext.PushResult(Result);
 }
 
 bool FMathVMBase::Execute(TMap<FString, double>& LocalVariables, const int32 PopResults, TArray<double>& Results, FString& Error, void* LocalContext)
+{
+	TMap<FString, FMathVMVector> LocalVectors;
+	return Execute(LocalVariables, LocalVectors, PopResults, Results, Error, LocalContext);
+}
+
+bool FMathVMBase::Execute(TMap<FString, double>& LocalVariables, TMap<FString, FMathVMVector>& LocalVectors, const int32 PopResults, TArray<double>& Results, FString& Error, void* LocalContext)
 {
 	for (const TPair<FString, double>& LocalVariable : LocalVariables)
 	{
@@ -71,17 +222,107 @@ bool FMathVMBase::Execute(TMap<FString, double>& LocalVariables, const int32 Pop
 		}
 	}
 
-	FMathVMCallContext CallContext(*this, LocalVariables, LocalContext);
+	for (const TPair<FString, FMathVMVector>& LocalVector : LocalVectors)
+	{
+		if (!MathVM::Utils::SanitizeName(LocalVector.Key))
+		{
+			Error = FString::Printf(TEXT("Invalid local vector name \"%s\""), *LocalVector.Key);
+			return false;
+		}
+	}
 
-	int32 TempTokensToReserve = 0;
-	for (const TArray<const FMathVMToken*>& Statement : Statements)
+	// names are resolved once, the program runs over the local slots
+	FMathVMLocals Locals;
+	Locals.Init(GetNumVariables());
+
+	for (const TPair<FString, double>& LocalVariable : LocalVariables)
 	{
-		TempTokensToReserve += Statement.Num();
+		Locals.SetVariable(GetVariableIndex(LocalVariable.Key), LocalVariable.Value);
 	}
-	// this ensures no dangling pointers (no reallocation)
-	CallContext.TempTokens.Reserve(TempTokensToReserve);
 
-	for (const TArray<const FMathVMToken*>& Statement : Statements)
+	for (const TPair<FString, FMathVMVector>& LocalVector : LocalVectors)
+	{
+		Locals.SetVector(GetVariableIndex(LocalVector.Key), LocalVector.Value);
+	}
+
+	const bool bSuccess = Execute(Locals, PopResults, Results, Error, LocalContext);
+
+	// assignments are reported back even on failure
+	for (const TPair<FString, int32>& VariableIndex : VariableIndices)
+	{
+		const FMathVMVector& Value = Locals.Values[VariableIndex.Value];
+		if (Value.NumComponents == 1)
+		{
+			LocalVariables.FindOrAdd(VariableIndex.Key) = Value.Value.X;
+		}
+		else if (Value.NumComponents > 1)
+		{
+			LocalVectors.FindOrAdd(VariableIndex.Key) = Value;
+		}
+	}
+
+	return bSuccess;
+}
+
+bool FMathVMBase::Execute(FMathVMLocals& Locals, const int32 PopResults, TArray<double>& Results, FString& Error, void* LocalContext)
+{
+	if (const FMathVMPromotedProgram* Promoted = GetPromotedProgram())
+	{
+		if (IsPromotedProgramValid(*Promoted, &Locals))
+		{
+			return ExecuteProgram(Promoted->Statements, Locals, PopResults, Results, Error, LocalContext);
+		}
+
+		// deoptimized: the original program runs until the globals are baked again
+		if (PromotionThreshold > 0 && Promoted->NumFailedGuards.fetch_add(1, std::memory_order_relaxed) + 1 == PromotionThreshold)
+		{
+			StartPromotion();
+		}
+	}
+	// only the execution crossing the threshold starts the optimization, the others keep running the original program
+	else if (PromotionThreshold > 0 && NumExecutions.fetch_add(1, std::memory_order_relaxed) + 1 == PromotionThreshold && SymbolBindings.Num() == Symbols.Num())
+	{
+		StartPromotion();
+	}
+
+	return ExecuteProgram(Statements, Locals, PopResults, Results, Error, LocalContext);
+}
+
+bool FMathVMBase::ExecuteVariant(const int32 Variant, FMathVMLocals& Locals, const int32 PopResults, TArray<double>& Results, FString& Error, void* LocalContext)
+{
+	if (!ProgramVariants.IsValidIndex(Variant))
+	{
+		Error = FString::Printf(TEXT("Invalid program variant %d"), Variant);
+		return false;
+	}
+
+	return ExecuteProgram(ProgramVariants[Variant], Locals, PopResults, Results, Error, LocalContext);
+}
+
+bool FMathVMBase::ExecuteProgram(const TArray<TArray<FMathVMToken>>& Program, FMathVMLocals& Locals, const int32 PopResults, TArray<double>& Results, FString& Error, void* LocalContext)
+{
+	// a failed compilation can leave symbols without a binding
+	if (SymbolBindings.Num() != Symbols.Num())
+	{
+		Error = "Program not compiled";
+		return false;
+	}
+
+	if (Locals.Values.Num() < GetNumVariables())
+	{
+		Locals.Values.SetNum(GetNumVariables());
+	}
+
+	FMathVMCallContext CallContext(*this, Locals, LocalContext);
+
+	int32 MaxStatementSize = 0;
+	for (const TArray<FMathVMToken>& Statement : Program)
+	{
+		MaxStatementSize = FMath::Max(MaxStatementSize, Statement.Num());
+	}
+	CallContext.Stack.Reserve(MaxStatementSize);
+
+	for (const TArray<FMathVMToken>& Statement : Program)
 	{
 		if (!ExecuteStatement(CallContext, Statement, Error))
 		{
@@ -89,7 +330,28 @@ bool FMathVMBase::Execute(TMap<FString, double>& LocalVariables, const int32 Pop
 		}
 	}
 
-	for (int32 PopIndex = 0; PopIndex < PopResults; PopIndex++)
+	return PopStackResults(CallContext, PopResults, Results, Error);
+}
+
+bool FMathVMBase::ExecuteStatement(const int32 StatementIndex, FMathVMCallContext& CallContext, FString& Error)
+{
+	if (!Statements.IsValidIndex(StatementIndex) || SymbolBindings.Num() != Symbols.Num())
+	{
+		Error = FString::Printf(TEXT("Invalid statement %d"), StatementIndex);
+		return false;
+	}
+
+	if (CallContext.Locals.Values.Num() < GetNumVariables())
+	{
+		CallContext.Locals.Values.SetNum(GetNumVariables());
+	}
+
+	return ExecuteStatement(CallContext, Statements[StatementIndex], Error);
+}
+
+bool FMathVMBase::PopStackResults(FMathVMCallContext& CallContext, const int32 NumResults, TArray<double>& Results, FString& Error) const
+{
+	for (int32 PopIndex = 0; PopIndex < NumResults; PopIndex++)
 	{
 		if (CallContext.Stack.IsEmpty())
 		{
@@ -97,25 +359,38 @@ bool FMathVMBase::Execute(TMap<FString, double>& LocalVariables, const int32 Pop
 			return false;
 		}
 
-		const FMathVMToken* LastToken = MATHVM_POP(CallContext.Stack);
+		const FMathVMToken LastToken = MATHVM_POP(CallContext.Stack);
 
-		if (LastToken->TokenType == EMathVMTokenType::Number)
+		if (LastToken.TokenType == EMathVMTokenType::Number)
 		{
-			Results.Add(LastToken->NumericValue);
+			Results.Add(LastToken.NumericValue);
 		}
-		else if (LastToken->TokenType == EMathVMTokenType::Variable)
+		else if (LastToken.TokenType == EMathVMTokenType::Vector)
 		{
-			if (LocalVariables.Contains(LastToken->Value))
+			// vector results are expanded into their components
+			const FMathVMVector& Vector = CallContext.TempVectors[LastToken.Index];
+			Results.Append(&Vector.Value.X, Vector.NumComponents);
+		}
+		else if (LastToken.TokenType == EMathVMTokenType::Variable)
+		{
+			const FMathVMSymbolBinding& Binding = SymbolBindings[LastToken.Index];
+			const FMathVMVector& Local = CallContext.Locals.Values[Binding.Variable];
+			if (Local.NumComponents > 0)
+			{
+				Results.Append(&Local.Value.X, Local.NumComponents);
+			}
+			else if (Binding.GlobalVariable >= 0)
 			{
-				Results.Add(LocalVariables[LastToken->Value]);
+				Results.Add(GlobalVariables[Binding.GlobalVariable]);
 			}
-			else if (HasGlobalVariable(LastToken->Value))
+			else if (Binding.GlobalVector >= 0)
 			{
-				Results.Add(GetGlobalVariable(LastToken->Value));
+				const FMathVMVector Vector = GlobalVectors[Binding.GlobalVector];
+				Results.Append(&Vector.Value.X, Vector.NumComponents);
 			}
 			else
 			{
-				Error = FString::Printf(TEXT("Unset variable %s for result %d"), *(LastToken->Value), PopIndex);
+				Error = FString::Printf(TEXT("Unset variable %s for result %d"), *Symbols.GetName(LastToken.Index), PopIndex);
 				return false;
 			}
 		}
@@ -135,6 +410,12 @@ bool FMathVMBase::ExecuteAndDiscard(TMap<FString, double>& LocalVariables, FStri
 	return Execute(LocalVariables, 0, EmptyResults, Error, LocalContext);
 }
 
+bool FMathVMBase::ExecuteAndDiscard(FMathVMLocals& Locals, FString& Error, void* LocalContext)
+{
+	TArray<double> EmptyResults;
+	return Execute(Locals, 0, EmptyResults, Error, LocalContext);
+}
+
 bool FMathVMBase::ExecuteOne(TMap<FString, double>& LocalVariables, double& Result, FString& Error, void* LocalContext)
 {
 	TArray<double> SingleResult;
@@ -165,42 +446,103 @@ bool FMathVMCallContext::PopArgument(double& Value)
 		return false;
 	}
 
-	const FMathVMToken* Token = MATHVM_POP(Stack);
+	const FMathVMToken Token = MATHVM_POP(Stack);
 
-	if (Token->TokenType == EMathVMTokenType::Variable)
+	if (Token.TokenType == EMathVMTokenType::Variable)
 	{
-		if (LocalVariables.Contains(Token->Value))
+		const FMathVMSymbolBinding& Binding = MathVM.GetSymbolBinding(Token.Index);
+		const FMathVMVector& Local = Locals.Values[Binding.Variable];
+
+		if (Local.NumComponents == 1)
 		{
-			Value = LocalVariables[Token->Value];
+			Value = Local.Value.X;
 			return true;
 		}
 
-		if (MathVM.HasConst(Token->Value))
+		if (Binding.bIsConst)
 		{
-			Value = MathVM.GetConst(Token->Value);
+			Value = Binding.ConstValue;
 			return true;
 		}
 
-		if (MathVM.HasGlobalVariable(Token->Value))
+		if (Binding.GlobalVariable >= 0)
 		{
-			Value = MathVM.GetGlobalVariable(Token->Value);
+			Value = MathVM.GetGlobalVariable(Binding.GlobalVariable);
 			return true;
 		}
 
-		SetError(FString::Printf(TEXT("Unknown symbol \"%s\""), *Token->Value));
+		if (Local.NumComponents > 1 || Binding.GlobalVector >= 0)
+		{
+			SetError(FString::Printf(TEXT("Expected a scalar value, \"%s\" is a vector"), *MathVM.GetSymbolName(Token.Index)));
+			return false;
+		}
+
+		SetError(FString::Printf(TEXT("Unknown symbol \"%s\""), *MathVM.GetSymbolName(Token.Index)));
 		return false;
 	}
 
-	if (Token->TokenType == EMathVMTokenType::Number)
+	if (Token.TokenType == EMathVMTokenType::Number)
 	{
-		Value = Token->NumericValue;
+		Value = Token.NumericValue;
 		return true;
 	}
 
+	if (Token.TokenType == EMathVMTokenType::Vector)
+	{
+		SetError("Expected a scalar value, got a vector");
+		return false;
+	}
+
 	SetError("Stack corruption detected");
 	return false;
 }
 
+bool FMathVMCallContext::PopVector(FMathVMVector& Value)
+{
+	if (Stack.IsEmpty())
+	{
+		return false;
+	}
+
+	const FMathVMToken& Token = Stack.Last();
+
+	if (Token.TokenType == EMathVMTokenType::Vector)
+	{
+		Value = TempVectors[Token.Index];
+		MATHVM_POP(Stack);
+		return true;
+	}
+
+	if (Token.TokenType == EMathVMTokenType::Variable)
+	{
+		const FMathVMSymbolBinding& Binding = MathVM.GetSymbolBinding(Token.Index);
+		const FMathVMVector& Local = Locals.Values[Binding.Variable];
+
+		if (Local.NumComponents > 1)
+		{
+			MATHVM_POP(Stack);
+			Value = Local;
+			return true;
+		}
+
+		if (Local.NumComponents == 0 && Binding.GlobalVector >= 0)
+		{
+			MATHVM_POP(Stack);
+			Value = MathVM.GetGlobalVector(Binding.GlobalVector);
+			return true;
+		}
+	}
+
+	double ScalarValue = 0;
+	if (!PopArgument(ScalarValue))
+	{
+		return false;
+	}
+
+	Value = FMathVMVector(ScalarValue);
+	return true;
+}
+
 bool FMathVMCallContext::PopName(FString& Name)
 {
 	if (Stack.IsEmpty())
@@ -208,11 +550,30 @@ bool FMathVMCallContext::PopName(FString& Name)
 		return false;
 	}
 
-	const FMathVMToken* Token = MATHVM_POP(Stack);
+	const FMathVMToken Token = MATHVM_POP(Stack);
 
-	if (Token->TokenType == EMathVMTokenType::Variable)
+	if (Token.TokenType == EMathVMTokenType::Variable)
 	{
-		Name = Token->Value;
+		Name = MathVM.GetSymbolName(Token.Index);
+		return true;
+	}
+
+	SetError("Stack corruption detected");
+	return false;
+}
+
+bool FMathVMCallContext::PopSymbol(int32& Index)
+{
+	if (Stack.IsEmpty())
+	{
+		return false;
+	}
+
+	const FMathVMToken Token = MATHVM_POP(Stack);
+
+	if (Token.TokenType == EMathVMTokenType::Variable)
+	{
+		Index = Token.Index;
 		return true;
 	}
 
@@ -222,14 +583,53 @@ bool FMathVMCallContext::PopName(FString& Name)
 
 bool FMathVMCallContext::PushResult(const double Value)
 {
-	const int32 NewTempToken = TempTokens.Add(FMathVMToken(Value));
-	Stack.Add(&(TempTokens[NewTempToken]));
+	Stack.Add(FMathVMToken(Value));
+	return true;
+}
+
+bool FMathVMCallContext::PushResult(const FMathVMVector& Value)
+{
+	if (Value.NumComponents == 1)
+	{
+		return PushResult(Value.Value.X);
+	}
+
+	Stack.Add(FMathVMToken(EMathVMTokenType::Vector, TempVectors.Add(Value)));
 	return true;
 }
 
+bool FMathVMCallContext::Swizzle(const FString& Components)
+{
+	FMathVMVector Value;
+	if (!PopVector(Value))
+	{
+		return false;
+	}
+
+	if (Components.Len() < 1 || Components.Len() > 4)
+	{
+		return SetError(FString::Printf(TEXT("Invalid swizzle .%s (max 4 components)"), *Components));
+	}
+
+	FMathVMVector Result;
+	Result.NumComponents = Components.Len();
+
+	for (int32 ComponentIndex = 0; ComponentIndex < Components.Len(); ComponentIndex++)
+	{
+		const int32 SourceComponentIndex = MathVM::Utils::GetSwizzleComponent(Components[ComponentIndex]);
+		if (SourceComponentIndex < 0 || SourceComponentIndex >= Value.NumComponents)
+		{
+			return SetError(FString::Printf(TEXT("Invalid swizzle component %c for a %d component%s value"), Components[ComponentIndex], Value.NumComponents, Value.NumComponents == 1 ? TEXT("") : TEXT("s")));
+		}
+		Result.Value[ComponentIndex] = Value.Value[SourceComponentIndex];
+	}
+
+	return PushResult(Result);
+}
+
 double FMathVMCallContext::ReadResource(const int32 Index, const TArray<double>& Args)
 {
-	TSharedPtr<IMathVMResource> Resource = MathVM.GetResource(Index);
+	IMathVMResource* Resource = MathVM.GetRawResource(Index);
 	if (!Resource)
 	{
 		return 0;
@@ -237,9 +637,19 @@ double FMathVMCallContext::ReadResource(const int32 Index, const TArray<double>&
 	return Resource->Read(Args);
 }
 
+double FMathVMCallContext::SampleResource(const int32 Index, const TArray<double>& Args)
+{
+	IMathVMResource* Resource = MathVM.GetRawResource(Index);
+	if (!Resource)
+	{
+		return 0;
+	}
+	return Resource->Sample(Args);
+}
+
 void FMathVMCallContext::WriteResource(const int32 Index, const TArray<double>& Args)
 {
-	TSharedPtr<IMathVMResource> Resource = MathVM.GetResource(Index);
+	IMathVMResource* Resource = MathVM.GetRawResource(Index);
 	if (!Resource)
 	{
 		return;
@@ -0,0 +1,342 @@
+// Copyright 2024, Roberto De Ioris.
+
+#include "MathVM.h"
+
+namespace MathVM
+{
+	namespace Serialization
+	{
+		// "MVMP"
+		constexpr uint32 Magic = 0x504D564D;
+		constexpr uint32 Version = 1;
+
+		// fixed size record, operands are indices in the strings table or in the constant pool
+		struct FInstruction
+		{
+			uint8 TokenType = 0;
+			int32 Operand = -1;
+			int32 NumArgs = 0;
+			int32 ResourceIndex = -1;
+
+			friend FArchive& operator<<(FArchive& Archive, FInstruction& Instruction)
+			{
+				Archive << Instruction.TokenType;
+				Archive << Instruction.Operand;
+				Archive << Instruction.NumArgs;
+				Archive << Instruction.ResourceIndex;
+				return Archive;
+			}
+		};
+	}
+}
+
+bool FMathVMBase::SaveProgram(FArchive& Archive)
+{
+	if (!Archive.IsSaving())
+	{
+		return SetError("Archive is not in saving mode");
+	}
+
+	TArray<FString> Strings;
+	TMap<FString, int32> StringIndices;
+	TArray<double> ConstantPool;
+	TArray<int32> StatementSizes;
+	TArray<MathVM::Serialization::FInstruction> Instructions;
+
+	auto AddString = [&Strings, &StringIndices](const FString& String) -> int32
+		{
+			if (const int32* Index = StringIndices.Find(String))
+			{
+				return *Index;
+			}
+			const int32 NewIndex = Strings.Add(String);
+			StringIndices.Add(String, NewIndex);
+			return NewIndex;
+		};
+
+	for (const TArray<FMathVMToken>& Statement : Statements)
+	{
+		StatementSizes.Add(Statement.Num());
+
+		for (const FMathVMToken& Token : Statement)
+		{
+			MathVM::Serialization::FInstruction Instruction;
+			Instruction.TokenType = static_cast<uint8>(Token.TokenType);
+
+			switch (Token.TokenType)
+			{
+			case(EMathVMTokenType::Number):
+				Instruction.Operand = ConstantPool.Add(Token.NumericValue);
+				break;
+			case(EMathVMTokenType::Variable):
+			case(EMathVMTokenType::Swizzle):
+				Instruction.Operand = AddString(Symbols.GetName(Token.Index));
+				break;
+			case(EMathVMTokenType::Operator):
+				Instruction.Operand = AddString(MathVM::Utils::GetOperatorSymbol(Token.GetOperator()));
+				break;
+			case(EMathVMTokenType::Function):
+			{
+				const FMathVMProgramFunction& Function = ProgramFunctions[Token.Index];
+				Instruction.Operand = AddString(Function.Name);
+				Instruction.NumArgs = Token.DetectedNumArgs;
+				Instruction.ResourceIndex = Function.ResourceIndex;
+			}
+			break;
+			case(EMathVMTokenType::JumpIfZero):
+			case(EMathVMTokenType::Jump):
+			case(EMathVMTokenType::RangeSum):
+			case(EMathVMTokenType::RangeProduct):
+				Instruction.Operand = Token.Index;
+				break;
+			case(EMathVMTokenType::Lock):
+			case(EMathVMTokenType::Unlock):
+				break;
+			default:
+				return SetError("Unable to serialize token");
+			}
+
+			Instructions.Add(Instruction);
+		}
+	}
+
+	uint32 Magic = MathVM::Serialization::Magic;
+	uint32 Version = MathVM::Serialization::Version;
+
+	Archive << Magic;
+	Archive << Version;
+	Archive << Strings;
+	Archive << ConstantPool;
+	Archive << StatementSizes;
+	Archive << Instructions;
+
+	if (Archive.IsError())
+	{
+		return SetError("Unable to write program");
+	}
+
+	return true;
+}
+
+bool FMathVMBase::LoadProgram(FArchive& Archive)
+{
+	if (!Archive.IsLoading())
+	{
+		return SetError("Archive is not in loading mode");
+	}
+
+	uint32 Magic = 0;
+	uint32 Version = 0;
+
+	Archive << Magic;
+	if (Archive.IsError() || Magic != MathVM::Serialization::Magic)
+	{
+		return SetError("Invalid program");
+	}
+
+	Archive << Version;
+	if (Version != MathVM::Serialization::Version)
+	{
+		return SetError(FString::Printf(TEXT("Unsupported program version %u (expected %u)"), Version, MathVM::Serialization::Version));
+	}
+
+	TArray<FString> Strings;
+	TArray<double> ConstantPool;
+	TArray<int32> StatementSizes;
+	TArray<MathVM::Serialization::FInstruction> Instructions;
+
+	Archive << Strings;
+	Archive << ConstantPool;
+	Archive << StatementSizes;
+	Archive << Instructions;
+
+	if (Archive.IsError())
+	{
+		return SetError("Truncated program");
+	}
+
+	int64 NumInstructions = 0;
+	for (const int32 StatementSize : StatementSizes)
+	{
+		if (StatementSize < 0)
+		{
+			return SetError("Invalid statement size");
+		}
+		NumInstructions += StatementSize;
+	}
+
+	if (NumInstructions != Instructions.Num())
+	{
+		return SetError("Invalid number of instructions");
+	}
+
+	// the program is built in local arrays so that a failure does not leave a partial program
+	FMathVMSymbolTable LoadedSymbols;
+	TArray<FMathVMProgramFunction> LoadedProgramFunctions;
+	TMap<FString, int32> LoadedProgramFunctionIndices;
+	TArray<FMathVMToken> Program;
+	Program.Reserve(Instructions.Num());
+
+	int32 StatementIndex = 0;
+	int32 StatementEnd = StatementSizes.IsEmpty() ? 0 : StatementSizes[0];
+
+	for (const MathVM::Serialization::FInstruction& Instruction : Instructions)
+	{
+		const EMathVMTokenType TokenType = static_cast<EMathVMTokenType>(Instruction.TokenType);
+
+		while (Program.Num() >= StatementEnd && StatementIndex < StatementSizes.Num() - 1)
+		{
+			StatementEnd += StatementSizes[++StatementIndex];
+		}
+
+		if (TokenType == EMathVMTokenType::JumpIfZero || TokenType == EMathVMTokenType::Jump || TokenType == EMathVMTokenType::RangeSum || TokenType == EMathVMTokenType::RangeProduct)
+		{
+			// jumps (and range expressions) cannot leave the statement
+			if (Instruction.Operand < 0 || static_cast<int64>(Program.Num()) + 1 + Instruction.Operand > StatementEnd)
+			{
+				return SetError("Invalid jump");
+			}
+			Program.Add(FMathVMToken(TokenType, Instruction.Operand));
+			continue;
+		}
+
+		if (TokenType == EMathVMTokenType::Number)
+		{
+			if (!ConstantPool.IsValidIndex(Instruction.Operand))
+			{
+				return SetError("Invalid constant index");
+			}
+			Program.Add(FMathVMToken(ConstantPool[Instruction.Operand]));
+			continue;
+		}
+
+		if (TokenType == EMathVMTokenType::Lock || TokenType == EMathVMTokenType::Unlock)
+		{
+			Program.Add(FMathVMToken(TokenType));
+			continue;
+		}
+
+		if (!Strings.IsValidIndex(Instruction.Operand))
+		{
+			return SetError("Invalid string index");
+		}
+
+		const FString& Value = Strings[Instruction.Operand];
+
+		if (TokenType == EMathVMTokenType::Variable || TokenType == EMathVMTokenType::Swizzle)
+		{
+			// the runtime writes a component for each char of the swizzle
+			FString SwizzleError;
+			if (TokenType == EMathVMTokenType::Swizzle && !MathVM::Utils::ValidateSwizzle(Value, SwizzleError))
+			{
+				return SetError(SwizzleError);
+			}
+			Program.Add(FMathVMToken(TokenType, LoadedSymbols.Intern(Value)));
+		}
+		else if (TokenType == EMathVMTokenType::Operator)
+		{
+			EMathVMOperator Operator = EMathVMOperator::Add;
+			int32 Precedence = 0;
+			if (!MathVM::Utils::ParseOperator(Value, Operator, Precedence))
+			{
+				return SetError(FString::Printf(TEXT("Unknown operator %s"), *Value));
+			}
+			Program.Add(FMathVMToken(Operator, Precedence));
+		}
+		else if (TokenType == EMathVMTokenType::Function)
+		{
+			if (Instruction.NumArgs < 0 || Instruction.NumArgs > MAX_uint16)
+			{
+				return SetError(FString::Printf(TEXT("Invalid number of arguments for function %s"), *Value));
+			}
+
+			FMathVMProgramFunction ProgramFunction;
+			ProgramFunction.Name = Value;
+
+			if (Instruction.ResourceIndex >= 0)
+			{
+				// resource functions are bound again to the currently registered resource
+				const EMathVMResourceFunction* ResourceFunction = ResourceFunctions.Find(Value);
+				if (!ResourceFunction)
+				{
+					return SetError(FString::Printf(TEXT("Unknown resource function %s"), *Value));
+				}
+
+				IMathVMResource* Resource = GetRawResource(Instruction.ResourceIndex);
+				if (!Resource)
+				{
+					return SetError(FString::Printf(TEXT("Invalid resource %d for function %s"), Instruction.ResourceIndex, *Value));
+				}
+
+				if (!MakeResourceFunction(Value, *ResourceFunction, Resource, ProgramFunction.Function))
+				{
+					return SetError(FString::Printf(TEXT("Unable to bind function %s"), *Value));
+				}
+
+				ProgramFunction.ResourceIndex = Instruction.ResourceIndex;
+			}
+			else
+			{
+				const TPair<FMathVMFunction, int32>* Function = Functions.Find(Value);
+				if (!Function)
+				{
+					return SetError(FString::Printf(TEXT("Unknown function %s"), *Value));
+				}
+
+				if (Function->Value >= 0 && Instruction.NumArgs != Function->Value)
+				{
+					return SetError(FString::Printf(TEXT("Function %s expects %d argument%s (program has %d)"), *Value, Function->Value, Function->Value == 1 ? TEXT("") : TEXT("s"), Instruction.NumArgs));
+				}
+
+				ProgramFunction.Function = Function->Key;
+				ProgramFunction.NumArgs = Function->Value;
+			}
+
+			ProgramFunction.bPure = PureFunctions.Contains(Value);
+
+			int32 FunctionIndex = -1;
+			if (ProgramFunction.ResourceIndex < 0)
+			{
+				if (const int32* ExistingIndex = LoadedProgramFunctionIndices.Find(Value))
+				{
+					FunctionIndex = *ExistingIndex;
+				}
+			}
+
+			if (FunctionIndex < 0)
+			{
+				const bool bBound = ProgramFunction.ResourceIndex >= 0;
+				FunctionIndex = LoadedProgramFunctions.Add(MoveTemp(ProgramFunction));
+				if (!bBound)
+				{
+					LoadedProgramFunctionIndices.Add(Value, FunctionIndex);
+				}
+			}
+
+			FMathVMToken& FunctionToken = Program.Add_GetRef(FMathVMToken(EMathVMTokenType::Function, FunctionIndex));
+			FunctionToken.DetectedNumArgs = static_cast<uint16>(Instruction.NumArgs);
+		}
+		else
+		{
+			return SetError(FString::Printf(TEXT("Invalid token type %u"), Instruction.TokenType));
+		}
+	}
+
+	Reset();
+
+	int32 Offset = 0;
+	for (const int32 StatementSize : StatementSizes)
+	{
+		Statements.Emplace(Program.GetData() + Offset, StatementSize);
+		Offset += StatementSize;
+	}
+
+	Symbols = MoveTemp(LoadedSymbols);
+	NumCompiledSymbols = Symbols.Num();
+	ProgramFunctions = MoveTemp(LoadedProgramFunctions);
+	ProgramFunctionIndices = MoveTemp(LoadedProgramFunctionIndices);
+
+	BindSymbols();
+
+	return true;
+}
@@ -0,0 +1,508 @@
+// Copyright 2024, Roberto De Ioris.
+
+#include "MathVMStream.h"
+#include "Async/Async.h"
+#include "Async/ParallelFor.h"
+#include "HAL/PlatformFileManager.h"
+#include <atomic>
+
+namespace MathVM
+{
+	namespace Stream
+	{
+		class FReader
+		{
+		public:
+			virtual ~FReader() = default;
+
+			virtual bool Open(const FMathVMStreamConfig& Config, FString& Error) = 0;
+
+			// fills up to MaxRows rows of row-major values (0 rows at the end of the stream)
+			virtual bool ReadChunk(TArray<double>& Values, const int32 MaxRows, int32& NumRows, FString& Error) = 0;
+
+			const TArray<FString>& GetColumns() const
+			{
+				return Columns;
+			}
+
+		protected:
+			TUniquePtr<IFileHandle> FileHandle;
+			TArray<FString> Columns;
+		};
+
+		class FCsvReader : public FReader
+		{
+		public:
+			virtual bool Open(const FMathVMStreamConfig& Config, FString& Error) override
+			{
+				FileHandle.Reset(FPlatformFileManager::Get().GetPlatformFile().OpenRead(*Config.InputFilename));
+				if (!FileHandle)
+				{
+					Error = FString::Printf(TEXT("Unable to open %s"), *Config.InputFilename);
+					return false;
+				}
+
+				Remaining = FileHandle->Size();
+				Buffer.SetNumUninitialized(1024 * 1024);
+
+				FAnsiStringView Line;
+				if (!ReadLine(Line))
+				{
+					Error = TEXT("Missing csv header");
+					return false;
+				}
+
+				SplitLine(Line, [this](FAnsiStringView Field)
+					{
+						FString Column(Field);
+						Column.TrimStartAndEndInline();
+						Column.TrimQuotesInline();
+						Columns.Add(Column);
+					});
+
+				return true;
+			}
+
+			virtual bool ReadChunk(TArray<double>& Values, const int32 MaxRows, int32& NumRows, FString& Error) override
+			{
+				const int32 NumColumns = Columns.Num();
+				Values.SetNumUninitialized(MaxRows * NumColumns);
+				NumRows = 0;
+
+				FAnsiStringView Line;
+				while (NumRows < MaxRows && ReadLine(Line))
+				{
+					if (Line.IsEmpty())
+					{
+						continue;
+					}
+
+					double* RowValues = Values.GetData() + NumRows * NumColumns;
+					int32 ColumnIndex = 0;
+					SplitLine(Line, [&](FAnsiStringView Field)
+						{
+							if (ColumnIndex < NumColumns)
+							{
+								RowValues[ColumnIndex++] = ParseValue(Field);
+							}
+						});
+
+					// missing values are zeroed
+					for (; ColumnIndex < NumColumns; ColumnIndex++)
+					{
+						RowValues[ColumnIndex] = 0;
+					}
+
+					NumRows++;
+				}
+
+				return true;
+			}
+
+		protected:
+			// the returned view is valid until the next call
+			bool ReadLine(FAnsiStringView& Line)
+			{
+				for (;;)
+				{
+					for (int32 Index = Position; Index < BufferSize; Index++)
+					{
+						if (Buffer[Index] == '\n')
+						{
+							Line = FAnsiStringView(Buffer.GetData() + Position, Index - Position);
+							Position = Index + 1;
+							if (Line.Len() > 0 && Line[Line.Len() - 1] == '\r')
+							{
+								Line.RemoveSuffix(1);
+							}
+							return true;
+						}
+					}
+
+					if (Remaining <= 0)
+					{
+						if (Position < BufferSize)
+						{
+							Line = FAnsiStringView(Buffer.GetData() + Position, BufferSize - Position);
+							Position = BufferSize;
+							return true;
+						}
+						return false;
+					}
+
+					// move the partial line to the start of the buffer and refill it
+					BufferSize -= Position;
+					FMemory::Memmove(Buffer.GetData(), Buffer.GetData() + Position, BufferSize);
+					Position = 0;
+
+					if (BufferSize == Buffer.Num())
+					{
+						Buffer.SetNumUninitialized(Buffer.Num() * 2);
+					}
+
+					const int64 BytesToRead = FMath::Min<int64>(Buffer.Num() - BufferSize, Remaining);
+					if (!FileHandle->Read(reinterpret_cast<uint8*>(Buffer.GetData() + BufferSize), BytesToRead))
+					{
+						Remaining = 0;
+						continue;
+					}
+					BufferSize += static_cast<int32>(BytesToRead);
+					Remaining -= BytesToRead;
+				}
+			}
+
+			template<typename CallbackType>
+			static void SplitLine(FAnsiStringView Line, CallbackType Callback)
+			{
+				int32 FieldStart = 0;
+				for (int32 Index = 0; Index <= Line.Len(); Index++)
+				{
+					if (Index == Line.Len() || Line[Index] == ',')
+					{
+						Callback(Line.Mid(FieldStart, Index - FieldStart));
+						FieldStart = Index + 1;
+					}
+				}
+			}
+
+			static double ParseValue(FAnsiStringView Field)
+			{
+				ANSICHAR Value[128];
+				const int32 Len = FMath::Min(Field.Len(), static_cast<int32>(UE_ARRAY_COUNT(Value)) - 1);
+				FMemory::Memcpy(Value, Field.GetData(), Len);
+				Value[Len] = 0;
+				return FCStringAnsi::Atod(Value);
+			}
+
+			TArray<ANSICHAR> Buffer;
+			int32 BufferSize = 0;
+			int32 Position = 0;
+			int64 Remaining = 0;
+		};
+
+		class FBinaryReader : public FReader
+		{
+		public:
+			virtual bool Open(const FMathVMStreamConfig& Config, FString& Error) override
+			{
+				Columns = Config.InputColumns;
+				if (Columns.IsEmpty())
+				{
+					Error = TEXT("Binary input requires the list of columns");
+					return false;
+				}
+
+				FileHandle.Reset(FPlatformFileManager::Get().GetPlatformFile().OpenRead(*Config.InputFilename));
+				if (!FileHandle)
+				{
+					Error = FString::Printf(TEXT("Unable to open %s"), *Config.InputFilename);
+					return false;
+				}
+
+				const int64 RowSize = Columns.Num() * sizeof(double);
+				if (FileHandle->Size() % RowSize != 0)
+				{
+					Error = FString::Printf(TEXT("Invalid binary input size for %d columns"), Columns.Num());
+					return false;
+				}
+
+				TotalRows = FileHandle->Size() / RowSize;
+				return true;
+			}
+
+			virtual bool ReadChunk(TArray<double>& Values, const int32 MaxRows, int32& NumRows, FString& Error) override
+			{
+				const int32 NumColumns = Columns.Num();
+				NumRows = static_cast<int32>(FMath::Min<int64>(MaxRows, TotalRows - CurrentRow));
+				Values.SetNumUninitialized(NumRows * NumColumns);
+				ColumnValues.SetNumUninitialized(NumRows);
+
+				for (int32 ColumnIndex = 0; ColumnIndex < NumColumns && NumRows > 0; ColumnIndex++)
+				{
+					if (!FileHandle->Seek((ColumnIndex * TotalRows + CurrentRow) * sizeof(double)) || !FileHandle->Read(reinterpret_cast<uint8*>(ColumnValues.GetData()), NumRows * sizeof(double)))
+					{
+						Error = FString::Printf(TEXT("Unable to read column %s"), *Columns[ColumnIndex]);
+						return false;
+					}
+
+					for (int32 RowIndex = 0; RowIndex < NumRows; RowIndex++)
+					{
+						Values[RowIndex * NumColumns + ColumnIndex] = ColumnValues[RowIndex];
+					}
+				}
+
+				CurrentRow += NumRows;
+				return true;
+			}
+
+		protected:
+			int64 TotalRows = 0;
+			int64 CurrentRow = 0;
+			TArray<double> ColumnValues;
+		};
+
+		class FWriter
+		{
+		public:
+			bool Open(const FMathVMStreamConfig& Config, FString& Error)
+			{
+				Format = Config.OutputFormat;
+				NumColumns = Config.OutputVariables.Num();
+
+				FileHandle.Reset(FPlatformFileManager::Get().GetPlatformFile().OpenWrite(*Config.OutputFilename));
+				if (!FileHandle)
+				{
+					Error = FString::Printf(TEXT("Unable to open %s"), *Config.OutputFilename);
+					return false;
+				}
+
+				if (Format == EMathVMStreamFormat::Csv)
+				{
+					const FTCHARToUTF8 Header(*(FString::Join(Config.OutputVariables, TEXT(",")) + TEXT("\n")));
+					return FileHandle->Write(reinterpret_cast<const uint8*>(Header.Get()), Header.Length());
+				}
+
+				return true;
+			}
+
+			bool Write(const TArray<double>& Values, const int32 NumRows)
+			{
+				if (Format == EMathVMStreamFormat::Binary)
+				{
+					return FileHandle->Write(reinterpret_cast<const uint8*>(Values.GetData()), NumRows * NumColumns * sizeof(double));
+				}
+
+				Text.Reset();
+				for (int32 RowIndex = 0; RowIndex < NumRows; RowIndex++)
+				{
+					for (int32 ColumnIndex = 0; ColumnIndex < NumColumns; ColumnIndex++)
+					{
+						ANSICHAR Value[64];
+						const int32 Len = FCStringAnsi::Snprintf(Value, UE_ARRAY_COUNT(Value), "%.17g", Values[RowIndex * NumColumns + ColumnIndex]);
+						Text.Append(Value, FMath::Clamp(Len, 0, static_cast<int32>(UE_ARRAY_COUNT(Value)) - 1));
+						Text.Add(ColumnIndex < NumColumns - 1 ? ',' : '\n');
+					}
+				}
+
+				return FileHandle->Write(reinterpret_cast<const uint8*>(Text.GetData()), Text.Num());
+			}
+
+		protected:
+			TUniquePtr<IFileHandle> FileHandle;
+			EMathVMStreamFormat Format = EMathVMStreamFormat::Csv;
+			int32 NumColumns = 0;
+			TArray<ANSICHAR> Text;
+		};
+	}
+}
+
+FMathVMStreamEvaluator::FMathVMStreamEvaluator(FMathVMBase& InMathVM, const FMathVMStreamConfig& InConfig) : MathVM(InMathVM), Config(InConfig)
+{
+}
+
+bool FMathVMStreamEvaluator::SetError(const FString& InError)
+{
+	Error = InError;
+	return false;
+}
+
+const FString& FMathVMStreamEvaluator::GetError() const
+{
+	return Error;
+}
+
+int64 FMathVMStreamEvaluator::GetNumRows() const
+{
+	return NumRows;
+}
+
+bool FMathVMStreamEvaluator::Run()
+{
+	NumRows = 0;
+	Error.Empty();
+
+	if (Config.ChunkSize < 1)
+	{
+		return SetError(TEXT("Invalid chunk size"));
+	}
+
+	if (Config.OutputVariables.IsEmpty())
+	{
+		return SetError(TEXT("No output variables specified"));
+	}
+
+	TUniquePtr<MathVM::Stream::FReader> Reader;
+	if (Config.InputFormat == EMathVMStreamFormat::Binary)
+	{
+		Reader = MakeUnique<MathVM::Stream::FBinaryReader>();
+	}
+	else
+	{
+		Reader = MakeUnique<MathVM::Stream::FCsvReader>();
+	}
+
+	if (!Reader->Open(Config, Error))
+	{
+		return false;
+	}
+
+	Columns = Reader->GetColumns();
+
+	for (const FString& Column : Columns)
+	{
+		if (!MathVM::Utils::SanitizeName(Column))
+		{
+			return SetError(FString::Printf(TEXT("Invalid column name \"%s\""), *Column));
+		}
+	}
+
+	MathVM::Stream::FWriter Writer;
+	if (!Writer.Open(Config, Error))
+	{
+		return false;
+	}
+
+	// while a chunk is evaluated the other one is being read (inputs) and written (outputs)
+	FChunk Chunks[2];
+	if (!Reader->ReadChunk(Chunks[0].Inputs, Config.ChunkSize, Chunks[0].NumRows, Error))
+	{
+		return false;
+	}
+
+	TFuture<bool> PendingWrite;
+	FString ReadError;
+
+	for (int32 ChunkIndex = 0; Chunks[ChunkIndex].NumRows > 0; ChunkIndex = 1 - ChunkIndex)
+	{
+		FChunk& Chunk = Chunks[ChunkIndex];
+		FChunk& NextChunk = Chunks[1 - ChunkIndex];
+
+		TFuture<bool> PendingRead = Async(EAsyncExecution::ThreadPool, [&Reader, &NextChunk, &ReadError, this]()
+			{
+				return Reader->ReadChunk(NextChunk.Inputs, Config.ChunkSize, NextChunk.NumRows, ReadError);
+			});
+
+		const bool bEvaluated = EvaluateChunk(Chunk);
+
+		// outputs are written in order
+		if (PendingWrite.IsValid() && !PendingWrite.Get())
+		{
+			PendingRead.Wait();
+			return SetError(FString::Printf(TEXT("Unable to write to %s"), *Config.OutputFilename));
+		}
+
+		if (!bEvaluated)
+		{
+			PendingRead.Wait();
+			return false;
+		}
+
+		NumRows += Chunk.NumRows;
+
+		// the next iteration reads into this chunk while it is being written: the writer only touches the outputs
+		// (the next evaluation waits for it) and gets its own copy of the number of rows
+		PendingWrite = Async(EAsyncExecution::ThreadPool, [&Writer, &Outputs = Chunk.Outputs, ChunkNumRows = Chunk.NumRows]()
+			{
+				return Writer.Write(Outputs, ChunkNumRows);
+			});
+
+		if (!PendingRead.Get())
+		{
+			PendingWrite.Wait();
+			return SetError(ReadError);
+		}
+	}
+
+	if (PendingWrite.IsValid() && !PendingWrite.Get())
+	{
+		return SetError(FString::Printf(TEXT("Unable to write to %s"), *Config.OutputFilename));
+	}
+
+	MathVM.FlushResources();
+
+	return true;
+}
+
+bool FMathVMStreamEvaluator::EvaluateChunk(FChunk& Chunk)
+{
+	constexpr int32 RowsPerTask = 256;
+
+	const int32 NumColumns = Columns.Num();
+	const int32 NumOutputs = Config.OutputVariables.Num();
+	Chunk.Outputs.SetNumUninitialized(Chunk.NumRows * NumOutputs);
+
+	std::atomic<bool> bFailed = false;
+	FCriticalSection ErrorLock;
+
+	// names are resolved once per chunk, rows are evaluated over local slots
+	TArray<int32> ColumnIndices;
+	for (const FString& Column : Columns)
+	{
+		ColumnIndices.Add(MathVM.GetVariableIndex(Column));
+	}
+
+	TArray<int32> OutputLocalIndices;
+	TArray<int32> OutputGlobalIndices;
+	for (const FString& OutputVariable : Config.OutputVariables)
+	{
+		OutputLocalIndices.Add(MathVM.GetVariableIndex(OutputVariable));
+		OutputGlobalIndices.Add(MathVM.GetGlobalVariableIndex(OutputVariable));
+	}
+
+	// statements not contributing to the outputs are skipped
+	const int32 Variant = MathVM.GetProgramVariant(Config.OutputVariables, 0);
+
+	ParallelFor(FMath::DivideAndRoundUp(Chunk.NumRows, RowsPerTask), [&](const int32 TaskIndex)
+		{
+			FMathVMLocals Locals;
+			FString RowError;
+
+			const int32 LastRow = FMath::Min((TaskIndex + 1) * RowsPerTask, Chunk.NumRows);
+			for (int32 RowIndex = TaskIndex * RowsPerTask; RowIndex < LastRow && !bFailed; RowIndex++)
+			{
+				// local variables assigned by the code must not leak to the next row
+				Locals.Init(MathVM.GetNumVariables());
+
+				const double* RowInputs = Chunk.Inputs.GetData() + RowIndex * NumColumns;
+				for (int32 ColumnIndex = 0; ColumnIndex < NumColumns; ColumnIndex++)
+				{
+					Locals.SetVariable(ColumnIndices[ColumnIndex], RowInputs[ColumnIndex]);
+				}
+
+				TArray<double> Results;
+				bool bSuccess = MathVM.ExecuteVariant(Variant, Locals, 0, Results, RowError);
+
+				double* RowOutputs = Chunk.Outputs.GetData() + RowIndex * NumOutputs;
+				for (int32 OutputIndex = 0; bSuccess && OutputIndex < NumOutputs; OutputIndex++)
+				{
+					if (Locals.GetVariable(OutputLocalIndices[OutputIndex], RowOutputs[OutputIndex]))
+					{
+						continue;
+					}
+
+					if (OutputGlobalIndices[OutputIndex] >= 0)
+					{
+						RowOutputs[OutputIndex] = MathVM.GetGlobalVariable(OutputGlobalIndices[OutputIndex]);
+					}
+					else
+					{
+						RowError = FString::Printf(TEXT("Unknown output variable %s"), *Config.OutputVariables[OutputIndex]);
+						bSuccess = false;
+					}
+				}
+
+				if (!bSuccess)
+				{
+					FScopeLock ScopeLock(&ErrorLock);
+					if (!bFailed)
+					{
+						Error = FString::Printf(TEXT("Row %lld: %s"), NumRows + RowIndex, *RowError);
+						bFailed = true;
+					}
+					return;
+				}
+			}
+		});
+
+	return !bFailed;
+}
@@ -0,0 +1,81 @@
+// Copyright 2024, Roberto De Ioris.
+
+#include "MathVMStreamCommandlet.h"
+#include "MathVMStream.h"
+#include "Misc/FileHelper.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogMathVMStream, Log, All);
+
+UMathVMStreamCommandlet::UMathVMStreamCommandlet()
+{
+	IsClient = false;
+	IsEditor = false;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UMathVMStreamCommandlet::Main(const FString& Params)
+{
+	FString Code;
+	FString CodeFilename;
+	if (FParse::Value(*Params, TEXT("Code="), CodeFilename))
+	{
+		if (!FFileHelper::LoadFileToString(Code, *CodeFilename))
+		{
+			UE_LOG(LogMathVMStream, Error, TEXT("Unable to load %s"), *CodeFilename);
+			return 1;
+		}
+	}
+	else if (!FParse::Value(*Params, TEXT("Expression="), Code, false))
+	{
+		UE_LOG(LogMathVMStream, Error, TEXT("-Code or -Expression is required"));
+		return 1;
+	}
+
+	FMathVMStreamConfig Config;
+	FString Outputs;
+	if (!FParse::Value(*Params, TEXT("Input="), Config.InputFilename) || !FParse::Value(*Params, TEXT("Output="), Config.OutputFilename) || !FParse::Value(*Params, TEXT("Outputs="), Outputs, false))
+	{
+		UE_LOG(LogMathVMStream, Error, TEXT("-Input, -Output and -Outputs are required"));
+		return 1;
+	}
+
+	Outputs.ParseIntoArray(Config.OutputVariables, TEXT(","));
+
+	FString Columns;
+	if (FParse::Value(*Params, TEXT("Columns="), Columns, false))
+	{
+		Columns.ParseIntoArray(Config.InputColumns, TEXT(","));
+	}
+
+	FString Format;
+	if (FParse::Value(*Params, TEXT("InputFormat="), Format))
+	{
+		Config.InputFormat = Format == TEXT("binary") ? EMathVMStreamFormat::Binary : EMathVMStreamFormat::Csv;
+	}
+
+	if (FParse::Value(*Params, TEXT("OutputFormat="), Format))
+	{
+		Config.OutputFormat = Format == TEXT("binary") ? EMathVMStreamFormat::Binary : EMathVMStreamFormat::Csv;
+	}
+
+	FParse::Value(*Params, TEXT("ChunkSize="), Config.ChunkSize);
+
+	FMathVM MathVM;
+	if (!MathVM.TokenizeAndCompile(Code))
+	{
+		UE_LOG(LogMathVMStream, Error, TEXT("%s"), *MathVM.GetError());
+		return 1;
+	}
+
+	FMathVMStreamEvaluator StreamEvaluator(MathVM, Config);
+	if (!StreamEvaluator.Run())
+	{
+		UE_LOG(LogMathVMStream, Error, TEXT("%s"), *StreamEvaluator.GetError());
+		return 1;
+	}
+
+	UE_LOG(LogMathVMStream, Display, TEXT("Evaluated %lld rows"), StreamEvaluator.GetNumRows());
+
+	return 0;
+}
@@ -2,10 +2,59 @@
 
 #include "MathVM.h"
 
+namespace MathVM
+{
+	namespace Tokenizer
+	{
+		FORCEINLINE bool IsDigit(const TCHAR Char)
+		{
+			return Char >= '0' && Char <= '9';
+		}
+
+		FORCEINLINE bool IsAlpha(const TCHAR Char)
+		{
+			return (Char >= 'A' && Char <= 'Z') || (Char >= 'a' && Char <= 'z');
+		}
+
+		FORCEINLINE bool IsIdentifierStart(const TCHAR Char)
+		{
+			return IsAlpha(Char) || Char == '_';
+		}
+
+		FORCEINLINE bool IsIdentifierChar(const TCHAR Char)
+		{
+			return IsIdentifierStart(Char) || IsDigit(Char);
+		}
+	}
+}
+
 bool FMathVMBase::Tokenize(const FString& Code)
 {
+	// the background optimization reads the symbols table
+	WaitForPromotion();
+
+	// symbols interned by tokenizations never compiled are dropped (a new program starts from an empty table, like after Reset())
+	const int32 NumReferencedSymbols = Statements.IsEmpty() ? 0 : NumCompiledSymbols;
+	if (Symbols.Num() > NumReferencedSymbols)
+	{
+		Symbols.Truncate(NumReferencedSymbols);
+		NumCompiledSymbols = NumReferencedSymbols;
+		if (SymbolBindings.Num() > Symbols.Num())
+		{
+			BindSymbols();
+		}
+	}
+
+	return TokenizeSource(Code);
+}
+
+bool FMathVMBase::TokenizeSource(const FString& Code)
+{
+	using namespace MathVM::Tokenizer;
+
+	// the source is sliced by index ranges, no string is built char by char
+	const TCHAR* Source = *Code;
 	const int32 CodeLen = Code.Len();
-	Accumulator = "";
 	double NumberMultiplier = 1;
 	bool bIsInComment = false;
 
@@ -15,7 +64,8 @@ bool FMathVMBase::Tokenize(const FString& Code)
 
 	while (CurrentOffset < CodeLen)
 	{
-		TCHAR Char = Code[CurrentOffset++];
+		const int32 TokenStart = CurrentOffset;
+		TCHAR Char = Source[CurrentOffset++];
 
 		if (Char == '\n')
 		{
@@ -31,94 +81,101 @@ bool FMathVMBase::Tokenize(const FString& Code)
 			continue;
 		}
 
-		const bool bStartsWithPoint = Char == '.';
-
-		if ((Char >= '0' && Char <= '9') || bStartsWithPoint)
+		// swizzle (.x, .xy, .rgba, ...) after a variable or a parenthesized expression
+		if (Char == '.' && CurrentOffset < CodeLen && IsAlpha(Source[CurrentOffset]))
 		{
-			// number after variable/function name?
-			if (!Accumulator.IsEmpty() && !bStartsWithPoint)
+			while (CurrentOffset < CodeLen && IsAlpha(Source[CurrentOffset]))
 			{
-				Accumulator += Char;
-				continue;
+				CurrentOffset++;
 			}
 
-			if (!CheckAndResetAccumulator())
+			const FStringView Components(Source + TokenStart + 1, CurrentOffset - TokenStart - 1);
+
+			FString SwizzleError;
+			if (!MathVM::Utils::ValidateSwizzle(Components, SwizzleError))
 			{
-				return false;
+				return SetError(SwizzleError);
 			}
 
-			FString NumberAccumulator = "";
-			NumberAccumulator += Char;
-
-			while (CurrentOffset < CodeLen)
+			if (!HasPreviousToken() || (GetPreviousToken().TokenType != EMathVMTokenType::Variable && GetPreviousToken().TokenType != EMathVMTokenType::CloseParenthesis && GetPreviousToken().TokenType != EMathVMTokenType::Swizzle))
 			{
-				Char = Code[CurrentOffset];
-				if (Char >= '0' && Char <= '9')
-				{
-					NumberAccumulator += Char;
-				}
-				else
-				{
-					break;
-				}
+				return SetError(FString::Printf(TEXT("Unexpected swizzle .%s"), *FString(Components)));
+			}
 
-				CurrentOffset++;
+			if (!AddToken(FMathVMToken(EMathVMTokenType::Swizzle, Symbols.Intern(Components))))
+			{
+				return false;
 			}
+			NumberMultiplier = 1;
+			continue;
+		}
 
-			if (Char == '.' && !bStartsWithPoint)
+		if (IsDigit(Char) || Char == '.')
+		{
+			// integer part (a leading point starts the fractional part)
+			if (Char != '.')
 			{
-				NumberAccumulator += Char;
-				CurrentOffset++;
-				while (CurrentOffset < CodeLen)
+				while (CurrentOffset < CodeLen && IsDigit(Source[CurrentOffset]))
 				{
-					Char = Code[CurrentOffset];
-					if (Char >= '0' && Char <= '9')
-					{
-						NumberAccumulator += Char;
-					}
-					else
-					{
-						break;
-					}
+					CurrentOffset++;
+				}
 
+				if (CurrentOffset < CodeLen && Source[CurrentOffset] == '.')
+				{
 					CurrentOffset++;
 				}
 			}
 
-			if (Char == 'e' || Char == 'E')
+			while (CurrentOffset < CodeLen && IsDigit(Source[CurrentOffset]))
 			{
-				NumberAccumulator += Char;
 				CurrentOffset++;
-				Char = Code[CurrentOffset];
+			}
 
-				if (Char == '+' || Char == '-')
+			// the exponent is consumed only when followed by digits
+			if (CurrentOffset < CodeLen && (Source[CurrentOffset] == 'e' || Source[CurrentOffset] == 'E'))
+			{
+				int32 ExponentOffset = CurrentOffset + 1;
+				if (ExponentOffset < CodeLen && (Source[ExponentOffset] == '+' || Source[ExponentOffset] == '-'))
 				{
-					NumberAccumulator += Char;
-					CurrentOffset++;
-					while (CurrentOffset < CodeLen)
-					{
-						Char = Code[CurrentOffset];
-						if (Char >= '0' && Char <= '9')
-						{
-							NumberAccumulator += Char;
-						}
-						else
-						{
-							break;
-						}
+					ExponentOffset++;
+				}
 
+				if (ExponentOffset < CodeLen && IsDigit(Source[ExponentOffset]))
+				{
+					CurrentOffset = ExponentOffset;
+					while (CurrentOffset < CodeLen && IsDigit(Source[CurrentOffset]))
+					{
 						CurrentOffset++;
 					}
 				}
 			}
 
-			const double NumericValue = FCString::Atod(*NumberAccumulator);
+			const FStringView Number(Source + TokenStart, CurrentOffset - TokenStart);
+			double NumericValue = 0;
+			if (!MathVM::Utils::ParseNumber(Number, NumericValue))
+			{
+				return SetError(FString::Printf(TEXT("Invalid number %s"), *FString(Number)));
+			}
+
 			if (!AddToken(FMathVMToken(NumericValue * NumberMultiplier)))
 			{
 				return false;
 			}
 			NumberMultiplier = 1;
 		}
+		else if (IsIdentifierStart(Char))
+		{
+			while (CurrentOffset < CodeLen && IsIdentifierChar(Source[CurrentOffset]))
+			{
+				CurrentOffset++;
+			}
+
+			if (!AddIdentifier(FStringView(Source + TokenStart, CurrentOffset - TokenStart)))
+			{
+				return false;
+			}
+			NumberMultiplier = 1;
+		}
 		else if (Char == '-')
 		{
 			if (!HasPreviousToken())
@@ -131,7 +188,7 @@ bool FMathVMBase::Tokenize(const FString& Code)
 			}
 			else
 			{
-				if (!AddToken(FMathVMToken(OperatorSub, 6)))
+				if (!AddToken(FMathVMToken(EMathVMOperator::Sub, 6)))
 				{
 					return false;
 				}
@@ -150,7 +207,7 @@ bool FMathVMBase::Tokenize(const FString& Code)
 			}
 			else
 			{
-				if (!AddToken(FMathVMToken(OperatorAdd, 6)))
+				if (!AddToken(FMathVMToken(EMathVMOperator::Add, 6)))
 				{
 					return false;
 				}
@@ -159,7 +216,7 @@ bool FMathVMBase::Tokenize(const FString& Code)
 		}
 		else if (Char == '*')
 		{
-			if (!CheckAndResetAccumulator() || !AddToken(FMathVMToken(OperatorMul, 5)))
+			if (!AddToken(FMathVMToken(EMathVMOperator::Mul, 5)))
 			{
 				return false;
 			}
@@ -167,7 +224,7 @@ bool FMathVMBase::Tokenize(const FString& Code)
 		}
 		else if (Char == '/')
 		{
-			if (!CheckAndResetAccumulator() || !AddToken(FMathVMToken(OperatorDiv, 5)))
+			if (!AddToken(FMathVMToken(EMathVMOperator::Div, 5)))
 			{
 				return false;
 			}
@@ -175,7 +232,7 @@ bool FMathVMBase::Tokenize(const FString& Code)
 		}
 		else if (Char == '%')
 		{
-			if (!CheckAndResetAccumulator() || !AddToken(FMathVMToken(OperatorMod, 5)))
+			if (!AddToken(FMathVMToken(EMathVMOperator::Mod, 5)))
 			{
 				return false;
 			}
@@ -183,7 +240,7 @@ bool FMathVMBase::Tokenize(const FString& Code)
 		}
 		else if (Char == '=')
 		{
-			if (!CheckAndResetAccumulator() || !AddToken(FMathVMToken(OperatorAssign, 17)))
+			if (!AddToken(FMathVMToken(EMathVMOperator::Assign, 17)))
 			{
 				return false;
 			}
@@ -191,7 +248,7 @@ bool FMathVMBase::Tokenize(const FString& Code)
 		}
 		else if (Char == '(')
 		{
-			if (!CheckAndResetAccumulator() || !AddToken(FMathVMToken(EMathVMTokenType::OpenParenthesis)))
+			if (!AddToken(FMathVMToken(EMathVMTokenType::OpenParenthesis)))
 			{
 				return false;
 			}
@@ -199,7 +256,7 @@ bool FMathVMBase::Tokenize(const FString& Code)
 		}
 		else if (Char == ')')
 		{
-			if (!CheckAndResetAccumulator() || !AddToken(FMathVMToken(EMathVMTokenType::CloseParenthesis)))
+			if (!AddToken(FMathVMToken(EMathVMTokenType::CloseParenthesis)))
 			{
 				return false;
 			}
@@ -207,7 +264,7 @@ bool FMathVMBase::Tokenize(const FString& Code)
 		}
 		else if (Char == '{')
 		{
-			if (!CheckAndResetAccumulator() || !AddToken(FMathVMToken(EMathVMTokenType::Lock)))
+			if (!AddToken(FMathVMToken(EMathVMTokenType::Lock)))
 			{
 				return false;
 			}
@@ -215,7 +272,7 @@ bool FMathVMBase::Tokenize(const FString& Code)
 		}
 		else if (Char == '}')
 		{
-			if (!CheckAndResetAccumulator() || !AddToken(FMathVMToken(EMathVMTokenType::Unlock)))
+			if (!AddToken(FMathVMToken(EMathVMTokenType::Unlock)))
 			{
 				return false;
 			}
@@ -223,7 +280,7 @@ bool FMathVMBase::Tokenize(const FString& Code)
 		}
 		else if (Char == ',')
 		{
-			if (!CheckAndResetAccumulator() || !AddToken(FMathVMToken(EMathVMTokenType::Comma)))
+			if (!AddToken(FMathVMToken(EMathVMTokenType::Comma)))
 			{
 				return false;
 			}
@@ -231,7 +288,7 @@ bool FMathVMBase::Tokenize(const FString& Code)
 		}
 		else if (Char == ';')
 		{
-			if (!CheckAndResetAccumulator() || !AddToken(FMathVMToken(EMathVMTokenType::Semicolon)))
+			if (!AddToken(FMathVMToken(EMathVMTokenType::Semicolon)))
 			{
 				return false;
 			}
@@ -239,72 +296,363 @@ bool FMathVMBase::Tokenize(const FString& Code)
 		}
 		else if (Char == ' ' || Char == '\t' || Char == '\r' || Char == '\n')
 		{
-			if (!CheckAndResetAccumulator())
-			{
-				return false;
-			}
 			NumberMultiplier = 1;
 		}
 		else if (Char == '#')
 		{
-			if (!CheckAndResetAccumulator())
-			{
-				return false;
-			}
 			NumberMultiplier = 1;
 			bIsInComment = true;
 		}
-		else if ((Char >= 'A' && Char <= 'Z') || (Char >= 'a' && Char <= 'z') || Char == '_')
-		{
-			Accumulator += Char;
-			NumberMultiplier = 1;
-		}
 		else
 		{
 			return SetError(FString::Printf(TEXT("Unexpected char: %c"), Char));
 		}
 	}
 
-	return CheckAccumulator(true);
+	if (HasPreviousToken() && GetPreviousToken().TokenType == EMathVMTokenType::Function)
+	{
+		return SetError(FString::Printf(TEXT("Expected open parenthesis after function %s"), *GetProgramFunction(GetPreviousToken().Index).Name));
+	}
+
+	if (!ExpandInlineFunctions())
+	{
+		return false;
+	}
+
+	// an identifier followed by a parenthesis is a call to a function that has not been registered
+	for (int32 TokenIndex = 0; TokenIndex + 1 < Tokens.Num(); TokenIndex++)
+	{
+		if (Tokens[TokenIndex].TokenType == EMathVMTokenType::Variable && Tokens[TokenIndex + 1].TokenType == EMathVMTokenType::OpenParenthesis)
+		{
+			return SetError(FString::Printf(TEXT("Unknown function %s"), *Symbols.GetName(Tokens[TokenIndex].Index)));
+		}
+	}
+
+	return true;
+}
+
+bool FMathVMBase::AddIdentifier(FStringView Identifier)
+{
+	const int32 SymbolIndex = Symbols.Intern(Identifier);
+	const FString& Name = Symbols.GetName(SymbolIndex);
+
+	if (Functions.Contains(Name))
+	{
+		return AddToken(FMathVMToken(EMathVMTokenType::Function, AddProgramFunction(Name)));
+	}
+
+	return AddToken(FMathVMToken(EMathVMTokenType::Variable, SymbolIndex));
 }
 
-bool FMathVMBase::CheckAndResetAccumulator()
+bool FMathVMBase::AddToken(const FMathVMToken& Token)
 {
-	bool bSuccess = CheckAccumulator(false);
-	Accumulator = "";
-	return bSuccess;
+	if (!Tokens.IsEmpty())
+	{
+		if (Tokens.Last().TokenType == EMathVMTokenType::Function && Token.TokenType != EMathVMTokenType::OpenParenthesis)
+		{
+			return SetError(FString::Printf(TEXT("Expected open parenthesis after function %s"), *GetProgramFunction(Tokens.Last().Index).Name));
+		}
+	}
+
+	Tokens.Add(Token);
+	return true;
 }
 
-bool FMathVMBase::CheckAccumulator(const bool bLastCheck)
+bool FMathVMBase::ExpandInlineFunctions()
 {
-	if (Accumulator.IsEmpty())
+	// fast path for programs without inline functions
+	if (InlineFunctions.IsEmpty() && Symbols.Find(TEXT("def")) < 0)
 	{
 		return true;
 	}
 
-	if (Functions.Contains(Accumulator))
+	TArray<FMathVMToken> ExpandedTokens;
+	ExpandedTokens.Reserve(Tokens.Num());
+
+	int32 StatementStart = 0;
+	while (StatementStart < Tokens.Num())
 	{
-		if (bLastCheck)
+		int32 StatementEnd = StatementStart;
+		while (StatementEnd < Tokens.Num() &&
+			Tokens[StatementEnd].TokenType != EMathVMTokenType::Semicolon &&
+			Tokens[StatementEnd].TokenType != EMathVMTokenType::Lock &&
+			Tokens[StatementEnd].TokenType != EMathVMTokenType::Unlock)
+		{
+			StatementEnd++;
+		}
+
+		TConstArrayView<FMathVMToken> Statement(Tokens.GetData() + StatementStart, StatementEnd - StatementStart);
+
+		if (Statement.Num() > 0 && Statement[0].TokenType == EMathVMTokenType::Variable && Symbols.GetName(Statement[0].Index).Equals(TEXT("def"), ESearchCase::CaseSensitive))
 		{
-			return SetError(FString::Printf(TEXT("Expected open parenthesis after function %s"), *Accumulator));
+			if (!DefineInlineFunction(Statement))
+			{
+				return false;
+			}
+
+			// the semicolon terminating the definition is removed too
+			if (StatementEnd < Tokens.Num() && Tokens[StatementEnd].TokenType != EMathVMTokenType::Semicolon)
+			{
+				ExpandedTokens.Add(Tokens[StatementEnd]);
+			}
 		}
+		else
+		{
+			if (!ExpandInlineCalls(Statement, ExpandedTokens))
+			{
+				return false;
+			}
 
-		return AddToken(FMathVMToken(Accumulator, Functions[Accumulator].Key, Functions[Accumulator].Value));
+			if (StatementEnd < Tokens.Num())
+			{
+				ExpandedTokens.Add(Tokens[StatementEnd]);
+			}
+		}
+
+		StatementStart = StatementEnd + 1;
 	}
 
-	return AddToken(FMathVMToken(EMathVMTokenType::Variable, Accumulator));
+	Tokens = MoveTemp(ExpandedTokens);
+	return true;
 }
 
-bool FMathVMBase::AddToken(const FMathVMToken& Token)
+bool FMathVMBase::DefineInlineFunction(TConstArrayView<FMathVMToken> Statement)
 {
-	if (!Tokens.IsEmpty())
+	if (Statement.Num() < 2 || Statement[1].TokenType != EMathVMTokenType::Variable)
 	{
-		if (Tokens.Last().TokenType == EMathVMTokenType::Function && Token.TokenType != EMathVMTokenType::OpenParenthesis)
+		if (Statement.Num() > 1 && Statement[1].TokenType == EMathVMTokenType::Function)
 		{
-			return SetError(FString::Printf(TEXT("Expected open parenthesis after function %s"), *Token.Value));
+			return SetError(FString::Printf(TEXT("Unable to redefine function %s"), *GetProgramFunction(Statement[1].Index).Name));
 		}
+		return SetError("Expected function name after def");
 	}
 
-	Tokens.Add(Token);
+	// copied, interning new symbols can move the names of the table
+	const FString Name = Symbols.GetName(Statement[1].Index);
+
+	if (Statement.Num() < 3 || Statement[2].TokenType != EMathVMTokenType::OpenParenthesis)
+	{
+		return SetError(FString::Printf(TEXT("Expected open parenthesis after def %s"), *Name));
+	}
+
+	FMathVMInlineFunction InlineFunction;
+
+	int32 TokenIndex = 3;
+	while (TokenIndex < Statement.Num() && Statement[TokenIndex].TokenType != EMathVMTokenType::CloseParenthesis)
+	{
+		if (!InlineFunction.Params.IsEmpty())
+		{
+			if (Statement[TokenIndex].TokenType != EMathVMTokenType::Comma)
+			{
+				return SetError(FString::Printf(TEXT("Expected comma between the parameters of %s"), *Name));
+			}
+			TokenIndex++;
+		}
+
+		if (TokenIndex >= Statement.Num() || Statement[TokenIndex].TokenType != EMathVMTokenType::Variable)
+		{
+			return SetError(FString::Printf(TEXT("Invalid parameter for function %s"), *Name));
+		}
+
+		const FString& Param = Symbols.GetName(Statement[TokenIndex].Index);
+		if (InlineFunction.Params.Contains(Param))
+		{
+			return SetError(FString::Printf(TEXT("Duplicate parameter %s for function %s"), *Param, *Name));
+		}
+
+		InlineFunction.Params.Add(Param);
+		TokenIndex++;
+	}
+
+	if (TokenIndex + 1 >= Statement.Num() || Statement[TokenIndex + 1].TokenType != EMathVMTokenType::Operator || Statement[TokenIndex + 1].GetOperator() != EMathVMOperator::Assign)
+	{
+		return SetError(FString::Printf(TEXT("Expected = after the parameters of %s"), *Name));
+	}
+
+	if (TokenIndex + 2 >= Statement.Num())
+	{
+		return SetError(FString::Printf(TEXT("Empty body for function %s"), *Name));
+	}
+
+	// calls to previously defined functions are expanded now (a function cannot call itself)
+	TArray<FMathVMToken> Body;
+	if (!ExpandInlineCalls(Statement.RightChop(TokenIndex + 2), Body))
+	{
+		return false;
+	}
+
+	// the variables of sum() and prod() are renamed, so that they cannot capture the variables passed as arguments
+	for (int32 BodyIndex = 0; BodyIndex + 2 < Body.Num(); BodyIndex++)
+	{
+		if (Body[BodyIndex].TokenType != EMathVMTokenType::Function || !RangeFunctions.Contains(GetProgramFunction(Body[BodyIndex].Index).Name) ||
+			Body[BodyIndex + 1].TokenType != EMathVMTokenType::OpenParenthesis || Body[BodyIndex + 2].TokenType != EMathVMTokenType::Variable)
+		{
+			continue;
+		}
+
+		const int32 RangeSymbol = Body[BodyIndex + 2].Index;
+		const FString& RangeVariable = Symbols.GetName(RangeSymbol);
+		if (InlineFunction.Params.Contains(RangeVariable))
+		{
+			continue;
+		}
+
+		const int32 ScopedSymbol = Symbols.Intern(FString::Printf(TEXT("__%s_%s"), *Name, *RangeVariable));
+
+		int32 Depth = 0;
+		for (int32 ScopeIndex = BodyIndex + 1; ScopeIndex < Body.Num(); ScopeIndex++)
+		{
+			FMathVMToken& Token = Body[ScopeIndex];
+			if (Token.TokenType == EMathVMTokenType::Variable && Token.Index == RangeSymbol)
+			{
+				Token.Index = ScopedSymbol;
+			}
+			else if (Token.TokenType == EMathVMTokenType::OpenParenthesis)
+			{
+				Depth++;
+			}
+			else if (Token.TokenType == EMathVMTokenType::CloseParenthesis && --Depth == 0)
+			{
+				break;
+			}
+		}
+	}
+
+	for (FMathVMToken& Token : Body)
+	{
+		if (Token.TokenType == EMathVMTokenType::Variable || Token.TokenType == EMathVMTokenType::Swizzle)
+		{
+			Token.Index = InlineFunction.Names.AddUnique(Symbols.GetName(Token.Index));
+		}
+		else if (Token.TokenType == EMathVMTokenType::Function)
+		{
+			Token.Index = InlineFunction.Names.AddUnique(GetProgramFunction(Token.Index).Name);
+		}
+	}
+
+	InlineFunction.Body = MoveTemp(Body);
+	InlineFunctions.Add(Name, MoveTemp(InlineFunction));
+
 	return true;
-}
\ No newline at end of file
+}
+
+bool FMathVMBase::ExpandInlineCalls(TConstArrayView<FMathVMToken> Input, TArray<FMathVMToken>& Output)
+{
+	for (int32 TokenIndex = 0; TokenIndex < Input.Num(); TokenIndex++)
+	{
+		const FMathVMToken& Token = Input[TokenIndex];
+
+		const FMathVMInlineFunction* InlineFunction = nullptr;
+		if (Token.TokenType == EMathVMTokenType::Variable && TokenIndex + 1 < Input.Num() && Input[TokenIndex + 1].TokenType == EMathVMTokenType::OpenParenthesis)
+		{
+			InlineFunction = InlineFunctions.Find(Symbols.GetName(Token.Index));
+		}
+
+		if (!InlineFunction)
+		{
+			Output.Add(Token);
+			continue;
+		}
+
+		const FString Name = Symbols.GetName(Token.Index);
+
+		// arguments are split at the commas of the call parenthesis (and expanded too)
+		TArray<TArray<FMathVMToken>> Args;
+		int32 Depth = 0;
+		int32 ArgStart = TokenIndex + 2;
+		int32 CallEnd = -1;
+		for (int32 ArgIndex = TokenIndex + 1; ArgIndex < Input.Num() && CallEnd < 0; ArgIndex++)
+		{
+			const EMathVMTokenType ArgTokenType = Input[ArgIndex].TokenType;
+			const bool bArgEnd = (ArgTokenType == EMathVMTokenType::Comma && Depth == 1) || (ArgTokenType == EMathVMTokenType::CloseParenthesis && Depth == 1);
+
+			if (bArgEnd)
+			{
+				const bool bEmptyCall = ArgTokenType == EMathVMTokenType::CloseParenthesis && Args.IsEmpty() && ArgIndex == ArgStart;
+				if (!bEmptyCall)
+				{
+					if (ArgIndex == ArgStart)
+					{
+						return SetError(FString::Printf(TEXT("Empty argument in call to %s"), *Name));
+					}
+
+					if (!ExpandInlineCalls(Input.Slice(ArgStart, ArgIndex - ArgStart), Args.AddDefaulted_GetRef()))
+					{
+						return false;
+					}
+				}
+				ArgStart = ArgIndex + 1;
+			}
+
+			if (ArgTokenType == EMathVMTokenType::OpenParenthesis)
+			{
+				Depth++;
+			}
+			else if (ArgTokenType == EMathVMTokenType::CloseParenthesis)
+			{
+				if (--Depth == 0)
+				{
+					CallEnd = ArgIndex;
+				}
+			}
+		}
+
+		if (CallEnd < 0)
+		{
+			return SetError(FString::Printf(TEXT("Expected close parenthesis in call to %s"), *Name));
+		}
+
+		if (Args.Num() != InlineFunction->Params.Num())
+		{
+			return SetError(FString::Printf(TEXT("Function %s expects %d argument%s (got %d)"), *Name, InlineFunction->Params.Num(), InlineFunction->Params.Num() == 1 ? TEXT("") : TEXT("s"), Args.Num()));
+		}
+
+		// parameters are substituted by their (parenthesized) arguments, so lazy functions keep working on them
+		Output.Add(FMathVMToken(EMathVMTokenType::OpenParenthesis));
+		for (const FMathVMToken& BodyToken : InlineFunction->Body)
+		{
+			if (BodyToken.TokenType == EMathVMTokenType::Variable)
+			{
+				const int32 ParamIndex = InlineFunction->Params.IndexOfByKey(InlineFunction->Names[BodyToken.Index]);
+				if (ParamIndex != INDEX_NONE)
+				{
+					Output.Add(FMathVMToken(EMathVMTokenType::OpenParenthesis));
+					Output.Append(Args[ParamIndex]);
+					Output.Add(FMathVMToken(EMathVMTokenType::CloseParenthesis));
+				}
+				else if (Functions.Contains(InlineFunction->Names[BodyToken.Index]))
+				{
+					// registered after the definition of the inline function
+					Output.Add(FMathVMToken(EMathVMTokenType::Function, AddProgramFunction(InlineFunction->Names[BodyToken.Index])));
+				}
+				else
+				{
+					Output.Add(FMathVMToken(EMathVMTokenType::Variable, Symbols.Intern(InlineFunction->Names[BodyToken.Index])));
+				}
+			}
+			else if (BodyToken.TokenType == EMathVMTokenType::Swizzle)
+			{
+				Output.Add(FMathVMToken(EMathVMTokenType::Swizzle, Symbols.Intern(InlineFunction->Names[BodyToken.Index])));
+			}
+			else if (BodyToken.TokenType == EMathVMTokenType::Function)
+			{
+				const FString& FunctionName = InlineFunction->Names[BodyToken.Index];
+				if (!Functions.Contains(FunctionName))
+				{
+					return SetError(FString::Printf(TEXT("Unknown function %s in the body of %s"), *FunctionName, *Name));
+				}
+				FMathVMToken& FunctionToken = Output.Add_GetRef(BodyToken);
+				FunctionToken.Index = AddProgramFunction(FunctionName);
+			}
+			else
+			{
+				Output.Add(BodyToken);
+			}
+		}
+		Output.Add(FMathVMToken(EMathVMTokenType::CloseParenthesis));
+
+		TokenIndex = CallEnd;
+	}
+
+	return true;
+}
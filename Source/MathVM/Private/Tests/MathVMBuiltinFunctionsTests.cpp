@@ -1109,4 +1109,62 @@ bool MathVMBuiltinFunctions_Hue2R::RunTest(const FString& Parameters)
 
 	return true;
 }
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(MathVMBuiltinFunctions_Vec3, "MathVMBuiltinFunctions.Vec3", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool MathVMBuiltinFunctions_Vec3::RunTest(const FString& Parameters)
+{
+	FMathVM MathVM;
+	MathVM.TokenizeAndCompile("vec3(vec2(1, 2), 3)");
+
+	TMap<FString, double> LocalVariables;
+	TArray<double> Results;
+	FString Error;
+
+	TestTrue(TEXT("bSuccess"), MathVM.Execute(LocalVariables, 1, Results, Error));
+
+	TestEqual(TEXT("Results"), Results.Num(), 3);
+
+	TestEqual(TEXT("Results[0]"), Results[0], 1.0);
+	TestEqual(TEXT("Results[1]"), Results[1], 2.0);
+	TestEqual(TEXT("Results[2]"), Results[2], 3.0);
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(MathVMBuiltinFunctions_Cross, "MathVMBuiltinFunctions.Cross", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool MathVMBuiltinFunctions_Cross::RunTest(const FString& Parameters)
+{
+	FMathVM MathVM;
+	MathVM.TokenizeAndCompile("cross(vec3(1, 0, 0), vec3(0, 1, 0)).z");
+
+	TMap<FString, double> LocalVariables;
+	double Result = 0;
+	FString Error;
+
+	TestTrue(TEXT("bSuccess"), MathVM.ExecuteOne(LocalVariables, Result, Error));
+
+	TestNearlyEqual(TEXT("Result"), Result, 1.0);
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(MathVMBuiltinFunctions_Normalize, "MathVMBuiltinFunctions.Normalize", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool MathVMBuiltinFunctions_Normalize::RunTest(const FString& Parameters)
+{
+	FMathVM MathVM;
+	MathVM.TokenizeAndCompile("length(normalize(vec3(3, 4, 5)))");
+
+	TMap<FString, double> LocalVariables;
+	double Result = 0;
+	FString Error;
+
+	TestTrue(TEXT("bSuccess"), MathVM.ExecuteOne(LocalVariables, Result, Error));
+
+	TestNearlyEqual(TEXT("Result"), Result, 1.0);
+
+	return true;
+}
+
 #endif
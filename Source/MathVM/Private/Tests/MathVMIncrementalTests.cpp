@@ -0,0 +1,63 @@
+// Copyright 2024 - Roberto De Ioris.
+
+#if WITH_DEV_AUTOMATION_TESTS
+#include "MathVM.h"
+#include "MathVMIncremental.h"
+#include "Misc/AutomationTest.h"
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMIncrementalTest_OnlyChanged, "MathVMIncremental.OnlyChanged", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FMathVMIncrementalTest_OnlyChanged::RunTest(const FString& Parameters)
+{
+	FMathVM MathVM;
+	MathVM.TokenizeAndCompile("a = x * 2; b = y + 1; c = a + b; c");
+
+	FMathVMIncrementalEvaluator Evaluator(MathVM);
+	Evaluator.SetVariable("x", 1);
+	Evaluator.SetVariable("y", 1);
+
+	TestTrue(TEXT("Evaluate"), Evaluator.Evaluate());
+	TestEqual(TEXT("NumExecutedStatements"), Evaluator.GetNumExecutedStatements(), 4);
+
+	TArray<double> Results;
+	TestTrue(TEXT("GetResults"), Evaluator.GetResults(1, Results));
+	TestEqual(TEXT("Results"), Results, TArray<double>({ 4 }));
+
+	TestTrue(TEXT("Evaluate"), Evaluator.Evaluate());
+	TestEqual(TEXT("NumExecutedStatements (unchanged)"), Evaluator.GetNumExecutedStatements(), 0);
+
+	Evaluator.SetVariable("y", 1);
+	TestTrue(TEXT("Evaluate"), Evaluator.Evaluate());
+	TestEqual(TEXT("NumExecutedStatements (same value)"), Evaluator.GetNumExecutedStatements(), 0);
+
+	Evaluator.SetVariable("y", 3);
+	TestTrue(TEXT("Evaluate"), Evaluator.Evaluate());
+	TestEqual(TEXT("NumExecutedStatements (y changed)"), Evaluator.GetNumExecutedStatements(), 3);
+
+	double Value = 0;
+	TestTrue(TEXT("GetVariable"), Evaluator.GetVariable("c", Value));
+	TestEqual(TEXT("c"), Value, 6.0);
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMIncrementalTest_SideEffects, "MathVMIncremental.SideEffects", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FMathVMIncrementalTest_SideEffects::RunTest(const FString& Parameters)
+{
+	FMathVM MathVM;
+	MathVM.RegisterGlobalVariable("frames", 0);
+	MathVM.TokenizeAndCompile("frames = frames + 1; a = x * 2");
+
+	FMathVMIncrementalEvaluator Evaluator(MathVM);
+	Evaluator.SetVariable("x", 1);
+
+	TestTrue(TEXT("Evaluate"), Evaluator.Evaluate());
+	TestTrue(TEXT("Evaluate"), Evaluator.Evaluate());
+	TestEqual(TEXT("NumExecutedStatements"), Evaluator.GetNumExecutedStatements(), 1);
+	TestEqual(TEXT("frames"), MathVM.GetGlobalVariable("frames"), 2.0);
+
+	return true;
+}
+
+#endif
@@ -1,9 +1,13 @@
 // Copyright 2024 - Roberto De Ioris.
 
 #if WITH_DEV_AUTOMATION_TESTS
+#include "Async/ParallelFor.h"
+#include "Curves/CurveFloat.h"
 #include "MathVM.h"
 #include "MathVMResources.h"
 #include "Misc/AutomationTest.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
 
 IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMResourcesTest_WriteDoubles, "MathVMResources.WriteDoubles", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
 
@@ -29,4 +33,496 @@ bool FMathVMResourcesTest_WriteDoubles::RunTest(const FString& Parameters)
 	return true;
 }
 
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMResourcesTest_ReduceDoubles, "MathVMResources.ReduceDoubles", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FMathVMResourcesTest_ReduceDoubles::RunTest(const FString& Parameters)
+{
+	FMathVM MathVM;
+	MathVM.RegisterResource(MakeShared<FMathVMDoubleArrayResource>(10));
+	MathVM.RegisterResource(MakeShared<FMathVMDoubleArrayResource>(10));
+	MathVM.TokenizeAndCompile("write(0, 0, 1); write(0, 1, 2); write(0, 5, 100); write(0, 9, -200); write(1, 1, 3); write(1, 5, 2); sum_of(0, 0, 10); min_of(0, 0, 10); max_of(0, 1, 9); mean_of(0, 0, 2); dot_of(0, 1, 0, 10); sum_of(0, 0, 20)");
+
+	TMap<FString, double> LocalVariables;
+	TArray<double> Results;
+	FString Error;
+
+	TestTrue(TEXT("bSuccess"), MathVM.Execute(LocalVariables, 6, Results, Error));
+
+	TestEqual(TEXT("Results"), Results.Num(), 6);
+
+	TestEqual(TEXT("Results[0]"), Results[0], -97.0);
+	TestEqual(TEXT("Results[1]"), Results[1], 206.0);
+	TestEqual(TEXT("Results[2]"), Results[2], 1.5);
+	TestEqual(TEXT("Results[3]"), Results[3], 100.0);
+	TestEqual(TEXT("Results[4]"), Results[4], -200.0);
+	TestEqual(TEXT("Results[5]"), Results[5], -97.0);
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMResourcesTest_ReduceNotFolded, "MathVMResources.ReduceNotFolded", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FMathVMResourcesTest_ReduceNotFolded::RunTest(const FString& Parameters)
+{
+	TSharedPtr<FMathVMDoubleArrayResource> Array = MakeShared<FMathVMDoubleArrayResource>(4);
+	Array->Write(TArray<double>({ 0, 2 }));
+
+	FMathVM MathVM;
+	MathVM.RegisterResource(Array);
+	MathVM.RegisterResource(Array);
+	MathVM.TokenizeAndCompile("dot_of(0, 1, 0, 4)");
+
+	FMathVMLocals Locals;
+	TArray<double> Results;
+	FString Error;
+
+	const int32 Variant = MathVM.Specialize({}, {}, 1);
+	TestTrue(TEXT("bSuccess"), MathVM.ExecuteVariant(Variant, Locals, 1, Results, Error));
+	TestEqual(TEXT("Results"), Results, TArray<double>({ 4 }));
+
+	MathVM.SetPromotionThreshold(1);
+	Results.Empty();
+	TestTrue(TEXT("bSuccess"), MathVM.Execute(Locals, 1, Results, Error));
+	MathVM.WaitForPromotion();
+	TestTrue(TEXT("IsPromoted"), MathVM.IsPromoted());
+
+	// the specialized and the promoted programs must see the new contents
+	Array->Write(TArray<double>({ 1, 3 }));
+
+	Results.Empty();
+	TestTrue(TEXT("bSuccess"), MathVM.ExecuteVariant(Variant, Locals, 1, Results, Error));
+	TestEqual(TEXT("Results (specialized)"), Results, TArray<double>({ 13 }));
+
+	Results.Empty();
+	TestTrue(TEXT("bSuccess"), MathVM.Execute(Locals, 1, Results, Error));
+	TestEqual(TEXT("Results (promoted)"), Results, TArray<double>({ 13 }));
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMResourcesTest_ReduceRanges, "MathVMResources.ReduceRanges", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FMathVMResourcesTest_ReduceRanges::RunTest(const FString& Parameters)
+{
+	TSharedPtr<FMathVMDoubleArrayResource> Array = MakeShared<FMathVMDoubleArrayResource>(10);
+	Array->Write(TArray<double>({ 1, 2 }));
+
+	const TCHAR* InvalidRanges[] = {
+		TEXT("sum_of(0, 0, 1e9)"),
+		TEXT("min_of(0, 0, 1e300)"),
+		TEXT("mean_of(0, -2e9, 2e9)"),
+		TEXT("max_of(0, sqrt(-1), 10)"),
+		TEXT("sum_of(0, 0, sqrt(-1))"),
+		TEXT("dot_of(0, 0, 0, 1e9)"),
+		TEXT("dot_of(0, 0, sqrt(-1), 4)")
+	};
+
+	FMathVMLocals Locals;
+	TArray<double> Results;
+	FString Error;
+
+	for (const TCHAR* InvalidRange : InvalidRanges)
+	{
+		FMathVM MathVM;
+		MathVM.RegisterResource(Array);
+		TestTrue(InvalidRange, MathVM.TokenizeAndCompile(InvalidRange));
+		TestFalse(InvalidRange, MathVM.Execute(Locals, 1, Results, Error));
+	}
+
+	// ranges past the end of the array within the limit still fall back to Read()
+	FMathVM MathVM;
+	MathVM.RegisterResource(Array);
+	MathVM.SetMaxRangeIterations(32);
+	TestTrue(TEXT("bSuccess"), MathVM.TokenizeAndCompile("sum_of(0, 0, 20); dot_of(0, 0, 0, 32)"));
+	TestTrue(TEXT("bSuccess"), MathVM.Execute(Locals, 2, Results, Error));
+	TestEqual(TEXT("Results"), Results, TArray<double>({ 5, 3 }));
+
+	return true;
+}
+
+class FMathVMTestSymbolicResource : public IMathVMResource
+{
+public:
+	virtual double Read(const TArray<double>& Args) const override
+	{
+		return Args.Num() > 0 ? Args[0] : 0;
+	}
+
+	virtual void Write(const TArray<double>& Args) override
+	{
+	}
+
+	virtual bool ResolveArgument(const int32 Coordinate, const FString& Name, double& Value) const override
+	{
+		if (Name == TEXT("row"))
+		{
+			Value = 7;
+			return true;
+		}
+		return false;
+	}
+};
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMResourcesTest_SymbolicArguments, "MathVMResources.SymbolicArguments", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FMathVMResourcesTest_SymbolicArguments::RunTest(const FString& Parameters)
+{
+	FMathVM MathVM;
+	MathVM.RegisterResource("table", MakeShared<FMathVMTestSymbolicResource>());
+	MathVM.TokenizeAndCompile("read(table, row)");
+
+	TMap<FString, double> LocalVariables;
+	double Result = 0;
+	FString Error;
+
+	TestTrue(TEXT("bSuccess"), MathVM.ExecuteOne(LocalVariables, Result, Error));
+	TestEqual(TEXT("Result"), Result, 7.0);
+
+	// assigned variables keep their meaning
+	FMathVM MathVM2;
+	MathVM2.RegisterResource("table", MakeShared<FMathVMTestSymbolicResource>());
+	MathVM2.TokenizeAndCompile("row = 2; read(table, row) + sum(row, 0, 1, read(table, row))");
+
+	TestTrue(TEXT("bSuccess"), MathVM2.ExecuteOne(LocalVariables, Result, Error));
+	TestEqual(TEXT("Result"), Result, 3.0);
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMResourcesTest_ReduceEmptyRange, "MathVMResources.ReduceEmptyRange", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FMathVMResourcesTest_ReduceEmptyRange::RunTest(const FString& Parameters)
+{
+	FMathVM MathVM;
+	MathVM.RegisterResource(MakeShared<FMathVMDoubleArrayResource>(10));
+	MathVM.TokenizeAndCompile("min_of(0, 5, 5)");
+
+	TMap<FString, double> LocalVariables;
+	double Result = 0;
+	FString Error;
+
+	TestFalse(TEXT("bSuccess"), MathVM.ExecuteOne(LocalVariables, Result, Error));
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMResourcesTest_BatchDoubles, "MathVMResources.BatchDoubles", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FMathVMResourcesTest_BatchDoubles::RunTest(const FString& Parameters)
+{
+	FMathVMDoubleArrayResource Resource(4);
+
+	const TArray<double> Coordinates = { 0, 1, 2, 3 };
+	const TArray<double> Values = { 10, 20, 30, 40 };
+	Resource.WriteBatch(Coordinates, 1, Values);
+
+	const TArray<double> ReadCoordinates = { 3, 0, 100 };
+	TArray<double> Results;
+	Results.AddZeroed(3);
+	Resource.ReadBatch(ReadCoordinates, 1, Results);
+
+	TestEqual(TEXT("Results[0]"), Results[0], 40.0);
+	TestEqual(TEXT("Results[1]"), Results[1], 10.0);
+	TestEqual(TEXT("Results[2]"), Results[2], 0.0);
+
+	TestEqual(TEXT("LinearView"), Resource.GetLinearView().Num(), 4);
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMResourcesTest_LateRegistration, "MathVMResources.LateRegistration", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FMathVMResourcesTest_LateRegistration::RunTest(const FString& Parameters)
+{
+	FMathVM MathVM;
+	MathVM.RegisterResource(MakeShared<FMathVMDoubleArrayResource>(10));
+	// resource 1 is not registered yet, so it cannot be bound at compile time
+	MathVM.TokenizeAndCompile("write(0, 2, 17); write(1, 3, 22); read(0, 2) + read(1, 3)");
+	MathVM.RegisterResource(MakeShared<FMathVMDoubleArrayResource>(10));
+
+	TMap<FString, double> LocalVariables;
+	double Result = 0;
+	FString Error;
+
+	TestTrue(TEXT("bSuccess"), MathVM.ExecuteOne(LocalVariables, Result, Error));
+
+	TestEqual(TEXT("Result"), Result, 39.0);
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMResourcesTest_NamedResource, "MathVMResources.NamedResource", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FMathVMResourcesTest_NamedResource::RunTest(const FString& Parameters)
+{
+	FMathVM MathVM;
+	MathVM.RegisterResource(MakeShared<FMathVMDoubleArrayResource>(10));
+	TestEqual(TEXT("Index"), MathVM.RegisterResource("values", MakeShared<FMathVMDoubleArrayResource>(10)), 1);
+	TestEqual(TEXT("Duplicate"), MathVM.RegisterResource("values", MakeShared<FMathVMDoubleArrayResource>(10)), -1);
+	MathVM.TokenizeAndCompile("write(values, 2, 17); write(values, 3, 22); sum_of(values, 0, 10) + read(values, 3)");
+
+	TMap<FString, double> LocalVariables;
+	double Result = 0;
+	FString Error;
+
+	TestTrue(TEXT("bSuccess"), MathVM.ExecuteOne(LocalVariables, Result, Error));
+
+	TestEqual(TEXT("Result"), Result, 61.0);
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMResourcesTest_NamedResourceArity, "MathVMResources.NamedResourceArity", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FMathVMResourcesTest_NamedResourceArity::RunTest(const FString& Parameters)
+{
+	FMathVM MathVM;
+	MathVM.RegisterResource("values", MakeShared<FMathVMDoubleArrayResource>(10));
+
+	TestFalse(TEXT("bSuccess"), MathVM.TokenizeAndCompile("read(values, 1, 2)"));
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMResourcesTest_SampleTexture, "MathVMResources.SampleTexture", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FMathVMResourcesTest_SampleTexture::RunTest(const FString& Parameters)
+{
+	UTexture2D* Texture = UTexture2D::CreateTransient(2, 2, EPixelFormat::PF_B8G8R8A8);
+	uint8* Pixels = static_cast<uint8*>(Texture->GetPlatformMips()[0].BulkData.Lock(LOCK_READ_WRITE));
+	const uint8 Red[4] = { 0, 255, 0, 255 };
+	for (int32 PixelIndex = 0; PixelIndex < 4; PixelIndex++)
+	{
+		Pixels[PixelIndex * 4] = 0;
+		Pixels[PixelIndex * 4 + 1] = 0;
+		Pixels[PixelIndex * 4 + 2] = Red[PixelIndex];
+		Pixels[PixelIndex * 4 + 3] = 255;
+	}
+	Texture->GetPlatformMips()[0].BulkData.Unlock();
+
+	TSharedPtr<FMathVMTexture2DResource> WrapTexture = MakeShared<FMathVMTexture2DResource>(Texture);
+	TestTrue(TEXT("IsValid"), WrapTexture->IsValid());
+	TestEqual(TEXT("GetNumMips"), WrapTexture->GetNumMips(), 2);
+
+	FMathVM MathVM;
+	MathVM.RegisterResource("wrap", WrapTexture);
+	MathVM.RegisterResource("clamp", MakeShared<FMathVMTexture2DResource>(Texture, EMathVMTextureAddress::Clamp));
+	MathVM.TokenizeAndCompile("read(wrap, 0, 0.75, 0.25); sample(wrap, 0, 0.5, 0.5); sample(wrap, 0, 0, 0.5); sample(clamp, 0, 0, 0.5); sample(clamp, 0, 0.75, 0.75, 1); read(clamp, 3, 0.5, 0.5)");
+
+	TMap<FString, double> LocalVariables;
+	TArray<double> Results;
+	FString Error;
+
+	TestTrue(TEXT("bSuccess"), MathVM.Execute(LocalVariables, 6, Results, Error));
+
+	TestEqual(TEXT("Results"), Results.Num(), 6);
+
+	TestEqual(TEXT("Results[0]"), Results[0], 1.0);
+	TestEqual(TEXT("Results[1]"), Results[1], 0.5);
+	TestEqual(TEXT("Results[2]"), Results[2], 0.0);
+	TestEqual(TEXT("Results[3]"), Results[3], 0.5);
+	TestEqual(TEXT("Results[4]"), Results[4], 0.5);
+	TestEqual(TEXT("Results[5]"), Results[5], 1.0);
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMResourcesTest_BakedCurve, "MathVMResources.BakedCurve", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FMathVMResourcesTest_BakedCurve::RunTest(const FString& Parameters)
+{
+	UCurveFloat* Curve = NewObject<UCurveFloat>();
+	Curve->FloatCurve.AddKey(0, 0);
+	Curve->FloatCurve.AddKey(1, 10);
+	Curve->FloatCurve.AddKey(2, 5);
+
+	TSharedPtr<FMathVMCurveBaseResource> BakedCurve = MakeShared<FMathVMCurveBaseResource>(Curve, 4, 0.001);
+	TestTrue(TEXT("IsBaked"), BakedCurve->IsBaked(0));
+
+	FMathVM MathVM;
+	MathVM.RegisterResource("curve", BakedCurve);
+	MathVM.TokenizeAndCompile("read(curve, 0, 0.3); read(curve, 0, 1.7); read(curve, 0, 3)");
+
+	TMap<FString, double> LocalVariables;
+	TArray<double> Results;
+	FString Error;
+
+	TestTrue(TEXT("bSuccess"), MathVM.Execute(LocalVariables, 3, Results, Error));
+
+	TestEqual(TEXT("Results"), Results.Num(), 3);
+
+	TestEqual(TEXT("Results[0]"), Results[0], static_cast<double>(Curve->FloatCurve.Eval(3)));
+	TestEqual(TEXT("Results[1]"), Results[1], static_cast<double>(Curve->FloatCurve.Eval(1.7)), 0.002);
+	TestEqual(TEXT("Results[2]"), Results[2], static_cast<double>(Curve->FloatCurve.Eval(0.3)), 0.002);
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMResourcesTest_TypedArrays, "MathVMResources.TypedArrays", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FMathVMResourcesTest_TypedArrays::RunTest(const FString& Parameters)
+{
+	FMathVM MathVM;
+	MathVM.RegisterResource("floats", MakeShared<FMathVMFloatArrayResource>(1000));
+	MathVM.RegisterResource("halves", MakeShared<FMathVMHalfArrayResource>(10));
+	MathVM.RegisterResource("ints", MakeShared<FMathVMIntArrayResource>(10));
+	MathVM.RegisterResource("bytes", MakeShared<FMathVMByteArrayResource>(10));
+	MathVM.TokenizeAndCompile("write(floats, 1, 0.5); write(floats, 999, 2); write(halves, 2, 1.5); write(ints, 3, -7.9); write(bytes, 4, 2); sum_of(floats, 0, 1000); read(halves, 2); read(ints, 3); read(bytes, 4); min_of(ints, 0, 10)");
+
+	TMap<FString, double> LocalVariables;
+	TArray<double> Results;
+	FString Error;
+
+	TestTrue(TEXT("bSuccess"), MathVM.Execute(LocalVariables, 5, Results, Error));
+
+	TestEqual(TEXT("Results"), Results.Num(), 5);
+
+	TestEqual(TEXT("Results[0]"), Results[0], -7.0);
+	TestEqual(TEXT("Results[1]"), Results[1], 1.0);
+	TestEqual(TEXT("Results[2]"), Results[2], -7.0);
+	TestEqual(TEXT("Results[3]"), Results[3], 1.5);
+	TestEqual(TEXT("Results[4]"), Results[4], 2.5);
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMResourcesTest_AtomicHistogram, "MathVMResources.AtomicHistogram", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FMathVMResourcesTest_AtomicHistogram::RunTest(const FString& Parameters)
+{
+	TSharedPtr<FMathVMDoubleArrayResource> Histogram = MakeShared<FMathVMDoubleArrayResource>(4);
+	TSharedPtr<FMathVMIntArrayResource> Privatized = MakeShared<FMathVMIntArrayResource>(4);
+	Privatized->SetPrivatized(true);
+	TSharedPtr<FMathVMFloatArrayResource> Extremes = MakeShared<FMathVMFloatArrayResource>(2);
+
+	FMathVM MathVM;
+	MathVM.RegisterResource("histogram", Histogram);
+	MathVM.RegisterResource("privatized", Privatized);
+	MathVM.RegisterResource("extremes", Extremes);
+	MathVM.TokenizeAndCompile("atomic_add(histogram, mod(i, 4), 1); atomic_add(privatized, mod(i, 4), 2); atomic_min(extremes, 0, i); atomic_max(extremes, 1, i)");
+
+	ParallelFor(1000, [&](const int32 Index)
+		{
+			TMap<FString, double> LocalVariables;
+			LocalVariables.Add("i", Index);
+
+			MathVM.ExecuteStealth(LocalVariables);
+		});
+
+	MathVM.FlushResources();
+
+	FMathVM ReaderMathVM;
+	ReaderMathVM.RegisterResource("histogram", Histogram);
+	ReaderMathVM.RegisterResource("privatized", Privatized);
+	ReaderMathVM.RegisterResource("extremes", Extremes);
+	ReaderMathVM.TokenizeAndCompile("read(histogram, 3); read(privatized, 2); read(extremes, 0); read(extremes, 1)");
+
+	TMap<FString, double> LocalVariables;
+	TArray<double> Results;
+	FString Error;
+
+	TestTrue(TEXT("bSuccess"), ReaderMathVM.Execute(LocalVariables, 4, Results, Error));
+
+	TestEqual(TEXT("Results"), Results.Num(), 4);
+
+	TestEqual(TEXT("Results[0]"), Results[0], 999.0);
+	TestEqual(TEXT("Results[1]"), Results[1], 0.0);
+	TestEqual(TEXT("Results[2]"), Results[2], 500.0);
+	TestEqual(TEXT("Results[3]"), Results[3], 250.0);
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMResourcesTest_MappedFile, "MathVMResources.MappedFile", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FMathVMResourcesTest_MappedFile::RunTest(const FString& Parameters)
+{
+	TArray<float> Values;
+	for (int32 Index = 0; Index < 10000; Index++)
+	{
+		Values.Add(Index * 0.5f);
+	}
+
+	const FString Filename = FPaths::CreateTempFilename(*FPaths::ProjectIntermediateDir(), TEXT("MathVM"), TEXT(".bin"));
+	TestTrue(TEXT("Save"), FFileHelper::SaveArrayToFile(TArrayView<const uint8>(reinterpret_cast<const uint8*>(Values.GetData()), Values.Num() * sizeof(float)), *Filename));
+
+	{
+		TSharedPtr<FMathVMMappedFloatFileResource> MappedFile = MakeShared<FMathVMMappedFloatFileResource>(Filename, true);
+		TestTrue(TEXT("IsValid"), MappedFile->IsValid());
+		TestEqual(TEXT("Num"), MappedFile->Num(), 10000LL);
+
+		FMathVM MathVM;
+		MathVM.RegisterResource("samples", MappedFile);
+		MathVM.TokenizeAndCompile("max_of(samples, 0, 10000); read(samples, 3); write(samples, 3, 100); read(samples, 3); read(samples, 10000)");
+
+		TMap<FString, double> LocalVariables;
+		TArray<double> Results;
+		FString Error;
+
+		TestTrue(TEXT("bSuccess"), MathVM.Execute(LocalVariables, 4, Results, Error));
+
+		TestEqual(TEXT("Results"), Results.Num(), 4);
+
+		TestEqual(TEXT("Results[0]"), Results[0], 0.0);
+		TestEqual(TEXT("Results[1]"), Results[1], 100.0);
+		TestEqual(TEXT("Results[2]"), Results[2], 1.5);
+		TestEqual(TEXT("Results[3]"), Results[3], 4999.5);
+	}
+
+	IFileManager::Get().Delete(*Filename);
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMResourcesTest_MappedFileConcurrentWrites, "MathVMResources.MappedFileConcurrentWrites", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FMathVMResourcesTest_MappedFileConcurrentWrites::RunTest(const FString& Parameters)
+{
+	constexpr int32 NumValues = 100000;
+
+	TArray<float> Values;
+	for (int32 Index = 0; Index < NumValues; Index++)
+	{
+		Values.Add(Index);
+	}
+
+	const FString Filename = FPaths::CreateTempFilename(*FPaths::ProjectIntermediateDir(), TEXT("MathVM"), TEXT(".bin"));
+	TestTrue(TEXT("Save"), FFileHelper::SaveArrayToFile(TArrayView<const uint8>(reinterpret_cast<const uint8*>(Values.GetData()), Values.Num() * sizeof(float)), *Filename));
+
+	{
+		TSharedPtr<FMathVMMappedFloatFileResource> MappedFile = MakeShared<FMathVMMappedFloatFileResource>(Filename, true);
+		TestTrue(TEXT("IsValid"), MappedFile->IsValid());
+
+		// every element is either the original value or its negation
+		std::atomic<int32> NumInvalidReads = 0;
+		ParallelFor(NumValues, [&](const int32 Index)
+			{
+				MappedFile->Write({ static_cast<double>(Index), -static_cast<double>(Index) });
+
+				const int32 OtherIndex = (Index * 7919) % NumValues;
+				const double Value = MappedFile->Read({ static_cast<double>(OtherIndex) });
+				if (FMath::Abs(Value) != OtherIndex)
+				{
+					NumInvalidReads++;
+				}
+			});
+
+		TestEqual(TEXT("NumInvalidReads"), NumInvalidReads.load(), 0);
+
+		int32 NumWrongValues = 0;
+		for (int32 Index = 0; Index < NumValues; Index++)
+		{
+			if (MappedFile->Read({ static_cast<double>(Index) }) != -Index)
+			{
+				NumWrongValues++;
+			}
+		}
+		TestEqual(TEXT("NumWrongValues"), NumWrongValues, 0);
+	}
+
+	IFileManager::Get().Delete(*Filename);
+
+	return true;
+}
+
 #endif
@@ -0,0 +1,72 @@
+// Copyright 2024 - Roberto De Ioris.
+
+#if WITH_DEV_AUTOMATION_TESTS
+#include "MathVM.h"
+#include "MathVMStream.h"
+#include "Misc/AutomationTest.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMStreamTest_Csv, "MathVMStream.Csv", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FMathVMStreamTest_Csv::RunTest(const FString& Parameters)
+{
+	FString Input = TEXT("a, b\n");
+	for (int32 Row = 0; Row < 1000; Row++)
+	{
+		Input += FString::Printf(TEXT("%d,%d\r\n"), Row, Row * 2);
+	}
+
+	FMathVMStreamConfig Config;
+	Config.InputFilename = FPaths::CreateTempFilename(*FPaths::ProjectIntermediateDir(), TEXT("MathVM"), TEXT(".csv"));
+	Config.OutputFilename = FPaths::CreateTempFilename(*FPaths::ProjectIntermediateDir(), TEXT("MathVM"), TEXT(".csv"));
+	Config.OutputVariables = { TEXT("sum"), TEXT("b") };
+	Config.ChunkSize = 100;
+
+	TestTrue(TEXT("Save"), FFileHelper::SaveStringToFile(Input, *Config.InputFilename));
+
+	FMathVM MathVM;
+	MathVM.TokenizeAndCompile("sum = a + b");
+
+	FMathVMStreamEvaluator StreamEvaluator(MathVM, Config);
+	TestTrue(TEXT("bSuccess"), StreamEvaluator.Run());
+	TestEqual(TEXT("NumRows"), StreamEvaluator.GetNumRows(), 1000LL);
+
+	TArray<FString> Lines;
+	TestTrue(TEXT("Load"), FFileHelper::LoadFileToStringArray(Lines, *Config.OutputFilename));
+
+	TestEqual(TEXT("Lines"), Lines.Num(), 1001);
+	TestEqual(TEXT("Lines[0]"), Lines[0], TEXT("sum,b"));
+	TestEqual(TEXT("Lines[1]"), Lines[1], TEXT("0,0"));
+	TestEqual(TEXT("Lines[1000]"), Lines[1000], TEXT("2997,1998"));
+
+	IFileManager::Get().Delete(*Config.InputFilename);
+	IFileManager::Get().Delete(*Config.OutputFilename);
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMStreamTest_UnknownOutput, "MathVMStream.UnknownOutput", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FMathVMStreamTest_UnknownOutput::RunTest(const FString& Parameters)
+{
+	FMathVMStreamConfig Config;
+	Config.InputFilename = FPaths::CreateTempFilename(*FPaths::ProjectIntermediateDir(), TEXT("MathVM"), TEXT(".csv"));
+	Config.OutputFilename = FPaths::CreateTempFilename(*FPaths::ProjectIntermediateDir(), TEXT("MathVM"), TEXT(".csv"));
+	Config.OutputVariables = { TEXT("c") };
+
+	TestTrue(TEXT("Save"), FFileHelper::SaveStringToFile(TEXT("a\n1\n2\n"), *Config.InputFilename));
+
+	FMathVM MathVM;
+	MathVM.TokenizeAndCompile("b = a * 2");
+
+	FMathVMStreamEvaluator StreamEvaluator(MathVM, Config);
+	TestFalse(TEXT("bSuccess"), StreamEvaluator.Run());
+
+	IFileManager::Get().Delete(*Config.InputFilename);
+	IFileManager::Get().Delete(*Config.OutputFilename);
+
+	return true;
+}
+
+#endif
@@ -2,8 +2,12 @@
 
 #if WITH_DEV_AUTOMATION_TESTS
 #include "MathVM.h"
+#include "MathVMProgram.h"
+#include "MathVMResources.h"
 #include "Async/ParallelFor.h"
 #include "Misc/AutomationTest.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
 
 
 IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMTest_Empty, "MathVM.Empty", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
@@ -71,6 +75,43 @@ bool FMathVMTest_Precedence::RunTest(const FString& Parameters)
 	return true;
 }
 
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMTest_ProgramAssetCustomFunction, "MathVM.ProgramAssetCustomFunction", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FMathVMTest_ProgramAssetCustomFunction::RunTest(const FString& Parameters)
+{
+	FMathVM UnknownMathVM;
+	TestFalse(TEXT("bSuccess"), UnknownMathVM.TokenizeAndCompile("twice(3)"));
+	TestEqual(TEXT("Error"), UnknownMathVM.GetError(), TEXT("Unknown function twice"));
+
+	// the asset does not know the functions registered by the game, nothing is stored
+	UMathVMProgram* Program = NewObject<UMathVMProgram>();
+	Program->Code = "twice(x) + 1";
+	TestFalse(TEXT("bCompiled"), Program->Compile());
+	TestEqual(TEXT("CompiledProgram"), Program->GetCompiledProgram().Num(), 0);
+
+	FMathVM MathVM;
+	MathVM.RegisterFunction("twice", MATHVM_LAMBDA{ MATHVM_RETURN(Args[0] * 2); }, 1);
+
+	FString Error;
+	TestTrue(TEXT("bLoaded"), Program->Load(MathVM, Error));
+
+	TMap<FString, double> LocalVariables;
+	LocalVariables.Add("x", 3);
+	double Result = 0;
+	TestTrue(TEXT("bSuccess"), MathVM.ExecuteOne(LocalVariables, Result, Error));
+	TestEqual(TEXT("Result"), Result, 7.0);
+
+	// functions registered after the definition of an inline function
+	FMathVM InlineMathVM;
+	TestTrue(TEXT("Library"), InlineMathVM.RegisterInlineFunctions("def quad(v) = twice(twice(v));"));
+	InlineMathVM.RegisterFunction("twice", MATHVM_LAMBDA{ MATHVM_RETURN(Args[0] * 2); }, 1);
+	TestTrue(TEXT("bSuccess"), InlineMathVM.TokenizeAndCompile("quad(x)"));
+	TestTrue(TEXT("bSuccess"), InlineMathVM.ExecuteOne(LocalVariables, Result, Error));
+	TestEqual(TEXT("Result"), Result, 12.0);
+
+	return true;
+}
+
 IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMTest_Assignment, "MathVM.Assignment", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
 
 bool FMathVMTest_Assignment::RunTest(const FString& Parameters)
@@ -218,4 +259,671 @@ bool FMathVMTest_ParallelWithLock::RunTest(const FString& Parameters)
 	return true;
 }
 
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMTest_VectorArithmetic, "MathVM.VectorArithmetic", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FMathVMTest_VectorArithmetic::RunTest(const FString& Parameters)
+{
+	FMathVM MathVM;
+	MathVM.TokenizeAndCompile("v = vec3(1, 2, 3) * 2 + vec3(1, 1, 1); v.z");
+
+	TMap<FString, double> LocalVariables;
+	double Result = 0;
+	FString Error;
+
+	TestTrue(TEXT("bSuccess"), MathVM.ExecuteOne(LocalVariables, Result, Error));
+
+	TestEqual(TEXT("Result"), Result, 7.0);
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMTest_VectorSwizzle, "MathVM.VectorSwizzle", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FMathVMTest_VectorSwizzle::RunTest(const FString& Parameters)
+{
+	FMathVM MathVM;
+	MathVM.TokenizeAndCompile("(vec4(1, 2, 3, 4) + 1).wzy");
+
+	TMap<FString, double> LocalVariables;
+	TArray<double> Results;
+	FString Error;
+
+	TestTrue(TEXT("bSuccess"), MathVM.Execute(LocalVariables, 1, Results, Error));
+
+	TestEqual(TEXT("Results"), Results.Num(), 3);
+
+	TestEqual(TEXT("Results[0]"), Results[0], 5.0);
+	TestEqual(TEXT("Results[1]"), Results[1], 4.0);
+	TestEqual(TEXT("Results[2]"), Results[2], 3.0);
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMTest_VectorSizeMismatch, "MathVM.VectorSizeMismatch", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FMathVMTest_VectorSizeMismatch::RunTest(const FString& Parameters)
+{
+	FMathVM MathVM;
+	MathVM.TokenizeAndCompile("vec2(1, 2) + vec3(1, 2, 3)");
+
+	TMap<FString, double> LocalVariables;
+	double Result = 0;
+	FString Error;
+
+	TestFalse(TEXT("bSuccess"), MathVM.ExecuteOne(LocalVariables, Result, Error));
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMTest_VectorGlobalsAndLocals, "MathVM.VectorGlobalsAndLocals", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FMathVMTest_VectorGlobalsAndLocals::RunTest(const FString& Parameters)
+{
+	FMathVM MathVM;
+	MathVM.RegisterGlobalVector("velocity", FMathVMVector(FVector(1, 0, 0)));
+	MathVM.TokenizeAndCompile("position = position + velocity * dt; velocity = velocity * 0.5; dot(position, velocity)");
+
+	TMap<FString, double> LocalVariables;
+	LocalVariables.Add("dt", 2);
+	TMap<FString, FMathVMVector> LocalVectors;
+	LocalVectors.Add("position", FMathVMVector(FVector(10, 20, 30)));
+	TArray<double> Results;
+	FString Error;
+
+	TestTrue(TEXT("bSuccess"), MathVM.Execute(LocalVariables, LocalVectors, 1, Results, Error));
+
+	TestEqual(TEXT("Results"), Results.Num(), 1);
+	TestEqual(TEXT("Results[0]"), Results[0], 6.0);
+	TestEqual(TEXT("position"), LocalVectors["position"].ToVector(), FVector(12, 20, 30));
+	TestEqual(TEXT("velocity"), MathVM.GetGlobalVector("velocity").ToVector(), FVector(0.5, 0, 0));
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMTest_SaveAndLoadProgram, "MathVM.SaveAndLoadProgram", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FMathVMTest_SaveAndLoadProgram::RunTest(const FString& Parameters)
+{
+	TSharedPtr<FMathVMDoubleArrayResource> Resource = MakeShared<FMathVMDoubleArrayResource>(4);
+
+	FMathVM MathVM;
+	MathVM.RegisterResource("data", Resource);
+	TestTrue(TEXT("bCompiled"), MathVM.TokenizeAndCompile("{write(data, 1, x * 2);} y = (read(data, 1) - sin(x)) % 4; vec2(y, 1).yx"));
+
+	TArray<uint8> Bytes;
+	FMemoryWriter Writer(Bytes);
+	TestTrue(TEXT("bSaved"), MathVM.SaveProgram(Writer));
+
+	FMathVM LoadedMathVM;
+	LoadedMathVM.RegisterResource("data", Resource);
+	FMemoryReader Reader(Bytes);
+	TestTrue(TEXT("bLoaded"), LoadedMathVM.LoadProgram(Reader));
+
+	TMap<FString, double> LocalVariables;
+	LocalVariables.Add("x", 5);
+	TArray<double> Results;
+	FString Error;
+
+	TestTrue(TEXT("bSuccess"), LoadedMathVM.Execute(LocalVariables, 1, Results, Error));
+
+	const double ExpectedY = static_cast<int64>(10.0 - FMath::Sin(5.0)) % 4;
+
+	TestEqual(TEXT("Results"), Results.Num(), 2);
+	TestEqual(TEXT("Results[0]"), Results[0], 1.0);
+	TestEqual(TEXT("Results[1]"), Results[1], ExpectedY);
+	TestEqual(TEXT("y"), LocalVariables["y"], ExpectedY);
+	TestEqual(TEXT("data[1]"), Resource->Read({ 1 }), 10.0);
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMTest_LoadProgramUnknownFunction, "MathVM.LoadProgramUnknownFunction", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FMathVMTest_LoadProgramUnknownFunction::RunTest(const FString& Parameters)
+{
+	FMathVM MathVM;
+	MathVM.RegisterFunction("twice", MATHVM_LAMBDA{ MATHVM_RETURN(Args[0] * 2); }, 1);
+	MathVM.TokenizeAndCompile("twice(2)");
+
+	TArray<uint8> Bytes;
+	FMemoryWriter Writer(Bytes);
+	TestTrue(TEXT("bSaved"), MathVM.SaveProgram(Writer));
+
+	FMathVM LoadedMathVM;
+	FMemoryReader Reader(Bytes);
+	TestFalse(TEXT("bLoaded"), LoadedMathVM.LoadProgram(Reader));
+	TestEqual(TEXT("Error"), LoadedMathVM.GetError(), TEXT("Unknown function twice"));
+
+	TArray<uint8> Garbage = { 1, 2, 3 };
+	FMemoryReader GarbageReader(Garbage);
+	TestFalse(TEXT("bLoaded"), LoadedMathVM.LoadProgram(GarbageReader));
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMTest_LoadProgramInvalidSwizzle, "MathVM.LoadProgramInvalidSwizzle", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FMathVMTest_LoadProgramInvalidSwizzle::RunTest(const FString& Parameters)
+{
+	// a tampered "v.xxxxxx" program (the instructions are written with the layout of SaveProgram())
+	auto WriteProgram = [](const FString& Swizzle)
+		{
+			TArray<uint8> Bytes;
+			FMemoryWriter Writer(Bytes);
+
+			uint32 Magic = 0x504D564D;
+			uint32 Version = 1;
+			TArray<FString> Strings = { TEXT("v"), Swizzle };
+			TArray<double> ConstantPool;
+			TArray<int32> StatementSizes = { 2 };
+			Writer << Magic << Version << Strings << ConstantPool << StatementSizes;
+
+			int32 NumInstructions = 2;
+			Writer << NumInstructions;
+			for (int32 InstructionIndex = 0; InstructionIndex < NumInstructions; InstructionIndex++)
+			{
+				uint8 TokenType = static_cast<uint8>(InstructionIndex == 0 ? EMathVMTokenType::Variable : EMathVMTokenType::Swizzle);
+				int32 Operand = InstructionIndex;
+				int32 NumArgs = 0;
+				int32 ResourceIndex = -1;
+				Writer << TokenType << Operand << NumArgs << ResourceIndex;
+			}
+
+			return Bytes;
+		};
+
+	FMathVM MathVM;
+
+	TArray<uint8> Valid = WriteProgram(TEXT("zyx"));
+	FMemoryReader ValidReader(Valid);
+	TestTrue(TEXT("bLoaded"), MathVM.LoadProgram(ValidReader));
+
+	TArray<uint8> TooLong = WriteProgram(TEXT("xxxxxx"));
+	FMemoryReader TooLongReader(TooLong);
+	TestFalse(TEXT("bLoaded"), MathVM.LoadProgram(TooLongReader));
+
+	TArray<uint8> InvalidComponent = WriteProgram(TEXT("xq"));
+	FMemoryReader InvalidComponentReader(InvalidComponent);
+	TestFalse(TEXT("bLoaded"), MathVM.LoadProgram(InvalidComponentReader));
+
+	TArray<uint8> Empty = WriteProgram(TEXT(""));
+	FMemoryReader EmptyReader(Empty);
+	TestFalse(TEXT("bLoaded"), MathVM.LoadProgram(EmptyReader));
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMTest_ProgramAsset, "MathVM.ProgramAsset", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FMathVMTest_ProgramAsset::RunTest(const FString& Parameters)
+{
+	UMathVMProgram* Program = NewObject<UMathVMProgram>();
+	Program->Code = "y = x * 2; y + 1";
+
+	TestTrue(TEXT("bCompiled"), Program->Compile());
+	TestTrue(TEXT("CompiledProgram"), Program->GetCompiledProgram().Num() > 0);
+
+	FMathVM MathVM;
+	FString Error;
+	TestTrue(TEXT("bLoaded"), Program->Load(MathVM, Error));
+
+	TMap<FString, double> LocalVariables;
+	LocalVariables.Add("x", 3);
+	double Result = 0;
+
+	TestTrue(TEXT("bSuccess"), MathVM.ExecuteOne(LocalVariables, Result, Error));
+	TestEqual(TEXT("Result"), Result, 7.0);
+	TestEqual(TEXT("y"), LocalVariables["y"], 6.0);
+
+	Program->Code = "sin(";
+	TestFalse(TEXT("bCompiled"), Program->Compile());
+	TestFalse(TEXT("CompileError"), Program->CompileError.IsEmpty());
+	TestEqual(TEXT("CompiledProgram"), Program->GetCompiledProgram().Num(), 0);
+
+	// a compiled program is stale when one of its libraries changes
+	UMathVMProgram* Library = NewObject<UMathVMProgram>();
+	Library->Code = "def scale(v) = v * 2;";
+	Program->Code = "scale(x)";
+	Program->Libraries.Add(Library);
+	TestTrue(TEXT("bCompiled"), Program->Compile());
+
+	Library->Code = "def scale(v) = v * 3;";
+
+	FMathVM MathVM2;
+	TestTrue(TEXT("bLoaded"), Program->Load(MathVM2, Error));
+	TestTrue(TEXT("bSuccess"), MathVM2.ExecuteOne(LocalVariables, Result, Error));
+	TestEqual(TEXT("Result"), Result, 9.0);
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMTest_ParseNumber, "MathVM.ParseNumber", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FMathVMTest_ParseNumber::RunTest(const FString& Parameters)
+{
+	const TCHAR* Numbers[] = { TEXT("0"), TEXT("17"), TEXT("0.1"), TEXT(".5"), TEXT("3.14159265358979"), TEXT("1e3"), TEXT("2.5E-3"), TEXT("1e+22"), TEXT("123456789012345678901234567890"), TEXT("0.000000000000000000000000001"), TEXT("1.7976931348623157e308") };
+
+	for (const TCHAR* Number : Numbers)
+	{
+		double Value = 0;
+		TestTrue(Number, MathVM::Utils::ParseNumber(Number, Value));
+		TestEqual(Number, Value, FCString::Atod(Number));
+	}
+
+	double Value = 0;
+	TestFalse(TEXT("Empty"), MathVM::Utils::ParseNumber(TEXT(""), Value));
+	TestFalse(TEXT("Point"), MathVM::Utils::ParseNumber(TEXT("."), Value));
+	TestFalse(TEXT("Exponent"), MathVM::Utils::ParseNumber(TEXT("1e"), Value));
+	TestFalse(TEXT("Garbage"), MathVM::Utils::ParseNumber(TEXT("1.2.3"), Value));
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMTest_TokenizeWithoutSpaces, "MathVM.TokenizeWithoutSpaces", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FMathVMTest_TokenizeWithoutSpaces::RunTest(const FString& Parameters)
+{
+	FMathVM MathVM;
+	TestTrue(TEXT("bCompiled"), MathVM.TokenizeAndCompile("x1=2;x1-1+2e2*.5"));
+
+	TMap<FString, double> LocalVariables;
+	double Result = 0;
+	FString Error;
+
+	TestTrue(TEXT("bSuccess"), MathVM.ExecuteOne(LocalVariables, Result, Error));
+	TestEqual(TEXT("Result"), Result, 101.0);
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMTest_TokenizeDropsUnusedSymbols, "MathVM.TokenizeDropsUnusedSymbols", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FMathVMTest_TokenizeDropsUnusedSymbols::RunTest(const FString& Parameters)
+{
+	FMathVM MathVM;
+	TestTrue(TEXT("Tokenize"), MathVM.Tokenize("x1 + x2 + x3"));
+	TestTrue(TEXT("bSuccess"), MathVM.TokenizeAndCompile("a + 1"));
+	TestEqual(TEXT("GetNumVariables"), MathVM.GetNumVariables(), 1);
+
+	// compiled statements keep their symbols
+	TestTrue(TEXT("Tokenize"), MathVM.Tokenize("y1 + y2"));
+	TestTrue(TEXT("bSuccess"), MathVM.TokenizeAndCompile("b + 2"));
+	TestEqual(TEXT("GetNumVariables"), MathVM.GetNumVariables(), 2);
+
+	TMap<FString, double> LocalVariables;
+	LocalVariables.Add("a", 10);
+	LocalVariables.Add("b", 20);
+	TArray<double> Results;
+	FString Error;
+	TestTrue(TEXT("bSuccess"), MathVM.Execute(LocalVariables, 2, Results, Error));
+	TestEqual(TEXT("Results"), Results, TArray<double>({ 22, 11 }));
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMTest_ExecuteWithLocals, "MathVM.ExecuteWithLocals", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FMathVMTest_ExecuteWithLocals::RunTest(const FString& Parameters)
+{
+	FMathVM MathVM;
+	MathVM.RegisterGlobalVariable("total", 0);
+	MathVM.TokenizeAndCompile("y = x * 2; total = total + Y; y");
+
+	const int32 X = MathVM.GetVariableIndex("x");
+	const int32 Y = MathVM.GetVariableIndex("y");
+	const int32 Total = MathVM.GetGlobalVariableIndex("total");
+
+	TestTrue(TEXT("X"), X >= 0);
+	TestEqual(TEXT("Y (case insensitive)"), MathVM.GetVariableIndex("Y"), Y);
+	TestEqual(TEXT("Unknown"), MathVM.GetVariableIndex("z"), -1);
+
+	FMathVMLocals Locals;
+	TArray<double> Results;
+	FString Error;
+
+	for (int32 Index = 1; Index <= 3; Index++)
+	{
+		Locals.Init(MathVM.GetNumVariables());
+		Locals.SetVariable(X, Index);
+		TestTrue(TEXT("bSuccess"), MathVM.Execute(Locals, 1, Results, Error));
+	}
+
+	double Value = 0;
+	TestTrue(TEXT("GetVariable"), Locals.GetVariable(Y, Value));
+	TestEqual(TEXT("y"), Value, 6.0);
+	TestEqual(TEXT("Results"), Results, TArray<double>({ 2, 4, 6 }));
+	TestEqual(TEXT("total"), MathVM.GetGlobalVariable(Total), 12.0);
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMTest_ProgramVariant, "MathVM.ProgramVariant", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FMathVMTest_ProgramVariant::RunTest(const FString& Parameters)
+{
+	FMathVM MathVM;
+	MathVM.RegisterGlobalVariable("counter", 0);
+	MathVM.TokenizeAndCompile("a = x * 2; b = sin(x); c = a + 1; counter = counter + 1; unused = b * 3; c");
+
+	TestEqual(TEXT("Statements"), MathVM.GetNumStatements(), 6);
+
+	const int32 VariantC = MathVM.GetProgramVariant({ TEXT("c") }, 0);
+	const int32 VariantB = MathVM.GetProgramVariant({ TEXT("b") }, 0);
+	const int32 VariantResult = MathVM.GetProgramVariant({}, 1);
+
+	TestEqual(TEXT("Cached"), MathVM.GetProgramVariant({ TEXT("C") }, 0), VariantC);
+	TestEqual(TEXT("VariantC"), MathVM.GetNumStatements(VariantC), 3);
+	TestEqual(TEXT("VariantB"), MathVM.GetNumStatements(VariantB), 2);
+	TestEqual(TEXT("VariantResult"), MathVM.GetNumStatements(VariantResult), 4);
+
+	FMathVMLocals Locals;
+	Locals.Init(MathVM.GetNumVariables());
+	Locals.SetVariable(MathVM.GetVariableIndex("x"), 1);
+
+	TArray<double> Results;
+	FString Error;
+	TestTrue(TEXT("bSuccess"), MathVM.ExecuteVariant(VariantResult, Locals, 1, Results, Error));
+	TestEqual(TEXT("Results"), Results, TArray<double>({ 3 }));
+	TestFalse(TEXT("b"), Locals.IsSet(MathVM.GetVariableIndex("b")));
+	TestEqual(TEXT("counter"), MathVM.GetGlobalVariable("counter"), 1.0);
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMTest_Specialize, "MathVM.Specialize", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FMathVMTest_Specialize::RunTest(const FString& Parameters)
+{
+	FMathVM MathVM;
+	MathVM.TokenizeAndCompile("a = sqrt(k) * 2 + 1; b = x + a; unused = b * 3; c = b * k; c");
+
+	const int32 Variant = MathVM.Specialize({ {TEXT("k"), 4} }, {}, 1);
+	TestTrue(TEXT("Variant"), Variant >= 0);
+	TestEqual(TEXT("Statements"), MathVM.GetNumStatements(Variant), 4);
+
+	FMathVMLocals Locals;
+	Locals.Init(MathVM.GetNumVariables());
+	Locals.SetVariable(MathVM.GetVariableIndex("x"), 1);
+
+	TArray<double> Results;
+	FString Error;
+	TestTrue(TEXT("bSuccess"), MathVM.ExecuteVariant(Variant, Locals, 1, Results, Error));
+	TestEqual(TEXT("Results"), Results, TArray<double>({ 24 }));
+	TestFalse(TEXT("k"), Locals.IsSet(MathVM.GetVariableIndex("k")));
+
+	FMathVM MathVM2;
+	MathVM2.TokenizeAndCompile("y = x * 2; x = x + 1; z = x * 2");
+
+	// the known value is not passed to the variant, the reads preceding the assignment are baked
+	const int32 AssignedVariant = MathVM2.Specialize({ {TEXT("x"), 1} }, { TEXT("y"), TEXT("z") }, 0);
+	Locals.Init(MathVM2.GetNumVariables());
+
+	TestTrue(TEXT("bSuccess"), MathVM2.ExecuteVariant(AssignedVariant, Locals, 0, Results, Error));
+
+	double Value = 0;
+	TestTrue(TEXT("y"), Locals.GetVariable(MathVM2.GetVariableIndex("y"), Value));
+	TestEqual(TEXT("y"), Value, 2.0);
+	TestTrue(TEXT("z"), Locals.GetVariable(MathVM2.GetVariableIndex("z"), Value));
+	TestEqual(TEXT("z"), Value, 4.0);
+
+	FMathVM MathVM3;
+	MathVM3.TokenizeAndCompile("level = clamp(level, 1, 10); x = x + 1; level * x");
+
+	const int32 SelfAssignedVariant = MathVM3.Specialize({ {TEXT("level"), 20}, {TEXT("x"), 2} }, {}, 1);
+	Locals.Init(MathVM3.GetNumVariables());
+
+	Results.Empty();
+	TestTrue(TEXT("bSuccess"), MathVM3.ExecuteVariant(SelfAssignedVariant, Locals, 1, Results, Error));
+	TestEqual(TEXT("Results"), Results, TArray<double>({ 30 }));
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMTest_Promotion, "MathVM.Promotion", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FMathVMTest_Promotion::RunTest(const FString& Parameters)
+{
+	FMathVM MathVM;
+	MathVM.SetPromotionThreshold(2);
+	MathVM.TokenizeAndCompile("y = x * sqrt(16) + (2 * 3); y");
+
+	TMap<FString, double> LocalVariables;
+	LocalVariables.Add("x", 1);
+
+	double Result = 0;
+	FString Error;
+	TestTrue(TEXT("bSuccess"), MathVM.ExecuteOne(LocalVariables, Result, Error));
+	TestFalse(TEXT("IsPromoted"), MathVM.IsPromoted());
+	TestTrue(TEXT("bSuccess"), MathVM.ExecuteOne(LocalVariables, Result, Error));
+
+	MathVM.WaitForPromotion();
+	TestTrue(TEXT("IsPromoted"), MathVM.IsPromoted());
+
+	LocalVariables.Add("x", 2);
+	TestTrue(TEXT("bSuccess"), MathVM.ExecuteOne(LocalVariables, Result, Error));
+	TestEqual(TEXT("Result"), Result, 14.0);
+	TestEqual(TEXT("y"), LocalVariables["y"], 14.0);
+
+	MathVM.RegisterGlobalVariable("z", 0);
+	TestFalse(TEXT("IsPromoted"), MathVM.IsPromoted());
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMTest_SpecializeGlobals, "MathVM.SpecializeGlobals", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FMathVMTest_SpecializeGlobals::RunTest(const FString& Parameters)
+{
+	FMathVM MathVM;
+	MathVM.RegisterGlobalVariable("difficulty", 2);
+	MathVM.RegisterGlobalVariable("frames", 0);
+	MathVM.SetPromotionThreshold(1);
+	MathVM.SetSpecializeGlobals(true);
+	MathVM.TokenizeAndCompile("frames = frames + 1; x * sqrt(difficulty * 8)");
+
+	TMap<FString, double> LocalVariables;
+	LocalVariables.Add("x", 1);
+
+	double Result = 0;
+	FString Error;
+	TestTrue(TEXT("bSuccess"), MathVM.ExecuteOne(LocalVariables, Result, Error));
+	MathVM.WaitForPromotion();
+	TestTrue(TEXT("IsPromoted"), MathVM.IsPromoted());
+
+	TestTrue(TEXT("bSuccess"), MathVM.ExecuteOne(LocalVariables, Result, Error));
+	TestEqual(TEXT("Result"), Result, 4.0);
+	// assignments from the program do not fail the guard
+	TestTrue(TEXT("IsPromoted (frames)"), MathVM.IsPromoted());
+
+	MathVM.SetGlobalVariable("difficulty", 8);
+	TestFalse(TEXT("IsPromoted (difficulty)"), MathVM.IsPromoted());
+
+	// the fallback starts a new specialization
+	TestTrue(TEXT("bSuccess"), MathVM.ExecuteOne(LocalVariables, Result, Error));
+	TestEqual(TEXT("Result"), Result, 8.0);
+	MathVM.WaitForPromotion();
+	TestTrue(TEXT("IsPromoted (again)"), MathVM.IsPromoted());
+
+	TestTrue(TEXT("bSuccess"), MathVM.ExecuteOne(LocalVariables, Result, Error));
+	TestEqual(TEXT("Result"), Result, 8.0);
+	TestEqual(TEXT("frames"), MathVM.GetGlobalVariable("frames"), 4.0);
+
+	// locals shadowing baked globals use the original program
+	LocalVariables.Add("difficulty", 2);
+	TestTrue(TEXT("bSuccess"), MathVM.ExecuteOne(LocalVariables, Result, Error));
+	TestEqual(TEXT("Result"), Result, 4.0);
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMTest_SelectIsLazy, "MathVM.SelectIsLazy", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FMathVMTest_SelectIsLazy::RunTest(const FString& Parameters)
+{
+	int32 NumCalls = 0;
+
+	FMathVM MathVM;
+	MathVM.RegisterFunction("expensive", [&NumCalls](FMathVMCallContext& CallContext, const TArray<double>& Args) -> bool
+		{
+			NumCalls++;
+			MATHVM_RETURN(100);
+		}, 0);
+	MathVM.TokenizeAndCompile("y = select(greater(x, 0), x * 2, expensive()) + if(x, select(less(x, 0), 1, 2), 3); y");
+
+	TMap<FString, double> LocalVariables;
+	LocalVariables.Add("x", 1);
+
+	double Result = 0;
+	FString Error;
+	TestTrue(TEXT("bSuccess"), MathVM.ExecuteOne(LocalVariables, Result, Error));
+	TestEqual(TEXT("Result"), Result, 4.0);
+	TestEqual(TEXT("NumCalls"), NumCalls, 0);
+
+	LocalVariables.Add("x", -1);
+	TestTrue(TEXT("bSuccess"), MathVM.ExecuteOne(LocalVariables, Result, Error));
+	TestEqual(TEXT("Result"), Result, 101.0);
+	TestEqual(TEXT("NumCalls"), NumCalls, 1);
+
+	FMathVMLocals Locals;
+	Locals.Init(MathVM.GetNumVariables());
+	Locals.SetVariable(MathVM.GetVariableIndex("x"), 0);
+
+	// constant conditions keep only the selected arm
+	TArray<double> Results;
+	const int32 Variant = MathVM.Specialize({ {TEXT("x"), 0} }, {}, 1);
+	TestTrue(TEXT("bSuccess"), MathVM.ExecuteVariant(Variant, Locals, 1, Results, Error));
+	TestEqual(TEXT("Results"), Results, TArray<double>({ 103 }));
+	TestEqual(TEXT("NumCalls"), NumCalls, 2);
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMTest_RangeSumProd, "MathVM.RangeSumProd", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FMathVMTest_RangeSumProd::RunTest(const FString& Parameters)
+{
+	FMathVM MathVM;
+	MathVM.TokenizeAndCompile("sum(k, 1, 4, k * k); prod(k, 1, 5, k); sum(i, 0, 2, sum(j, 0, i, j)); sum(k, 0, 3, select(greater(k, 1), k, 0)) + prod(k, 2, 1, k); k");
+
+	TMap<FString, double> LocalVariables;
+	LocalVariables.Add("k", 7);
+
+	TArray<double> Results;
+	FString Error;
+	TestTrue(TEXT("bSuccess"), MathVM.Execute(LocalVariables, 5, Results, Error));
+	TestEqual(TEXT("Results"), Results, TArray<double>({ 7, 6, 4, 120, 30 }));
+
+	FMathVM MathVM2;
+	MathVM2.SetMaxRangeIterations(10);
+	MathVM2.TokenizeAndCompile("y = sum(k, 1, n, k * sqrt(4))");
+
+	FMathVMLocals Locals;
+	Locals.Init(MathVM2.GetNumVariables());
+	Results.Empty();
+
+	const int32 Variant = MathVM2.Specialize({ {TEXT("n"), 3} }, { TEXT("y") }, 0);
+	TestTrue(TEXT("bSuccess"), MathVM2.ExecuteVariant(Variant, Locals, 0, Results, Error));
+
+	double Value = 0;
+	TestTrue(TEXT("y"), Locals.GetVariable(MathVM2.GetVariableIndex("y"), Value));
+	TestEqual(TEXT("y"), Value, 12.0);
+
+	Locals.SetVariable(MathVM2.GetVariableIndex("n"), 100);
+	TestFalse(TEXT("bSuccess"), MathVM2.Execute(Locals, 0, Results, Error));
+
+	TestFalse(TEXT("Variable"), MathVM2.TokenizeAndCompile("sum(1, 1, 2, 3)"));
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMTest_SingleValueExpressions, "MathVM.SingleValueExpressions", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FMathVMTest_SingleValueExpressions::RunTest(const FString& Parameters)
+{
+	TMap<FString, double> LocalVariables;
+	TArray<double> Results;
+	FString Error;
+
+	// the assignment leaves nothing on the stack, the range must not consume x
+	FMathVM MathVM;
+	TestTrue(TEXT("bSuccess"), MathVM.TokenizeAndCompile("x = 1; x + sum(k, 0, 2, y = k)"));
+	TestFalse(TEXT("bSuccess"), MathVM.Execute(LocalVariables, 1, Results, Error));
+
+	FMathVM MathVM2;
+	TestTrue(TEXT("bSuccess"), MathVM2.TokenizeAndCompile("x = 1; x + select(x, y = 2, 3)"));
+	TestFalse(TEXT("bSuccess"), MathVM2.Execute(LocalVariables, 1, Results, Error));
+
+	FMathVM MathVM3;
+	TestTrue(TEXT("bSuccess"), MathVM3.TokenizeAndCompile("x = 0; x + select(x, 2, y = 3)"));
+	TestFalse(TEXT("bSuccess"), MathVM3.Execute(LocalVariables, 1, Results, Error));
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMTest_InlineFunctions, "MathVM.InlineFunctions", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FMathVMTest_InlineFunctions::RunTest(const FString& Parameters)
+{
+	FMathVM MathVM;
+	TestTrue(TEXT("bSuccess"), MathVM.TokenizeAndCompile("def sq(x) = x * x; def hyp(a, b) = sqrt(sq(a) + sq(b)); x = 2; hyp(3, 4) + sq(x + 1)"));
+
+	TMap<FString, double> LocalVariables;
+	TArray<double> Results;
+	FString Error;
+	TestTrue(TEXT("bSuccess"), MathVM.Execute(LocalVariables, 1, Results, Error));
+	TestEqual(TEXT("Results"), Results, TArray<double>({ 14 }));
+	TestEqual(TEXT("NumStatements"), MathVM.GetNumStatements(), 2);
+
+	FMathVM MathVM2;
+	TestTrue(TEXT("Library"), MathVM2.RegisterInlineFunctions("def twice(v) = v * 2; def clamp01(v) = min(max(v, 0), 1);"));
+	TestFalse(TEXT("Not a library"), MathVM2.RegisterInlineFunctions("y = 1"));
+
+	// inline functions survive Reset()
+	MathVM2.Reset();
+	TestTrue(TEXT("HasInlineFunction"), MathVM2.HasInlineFunction("twice"));
+	TestFalse(TEXT("Arguments"), MathVM2.TokenizeAndCompile("twice(1, 2)"));
+	TestTrue(TEXT("bSuccess"), MathVM2.TokenizeAndCompile("twice(clamp01(3))"));
+
+	Results.Empty();
+	TestTrue(TEXT("bSuccess"), MathVM2.Execute(LocalVariables, 1, Results, Error));
+	TestEqual(TEXT("Results"), Results, TArray<double>({ 2 }));
+
+	// libraries do not touch the compiled program or the pending tokens
+	FMathVM MathVM3;
+	TestTrue(TEXT("bSuccess"), MathVM3.TokenizeAndCompile("x = 3; x * 2"));
+	TestTrue(TEXT("Library"), MathVM3.RegisterInlineFunctions("def half(value) = value / 2; def scaled(value, factor) = value * factor;"));
+
+	Results.Empty();
+	TestTrue(TEXT("bSuccess"), MathVM3.Execute(LocalVariables, 1, Results, Error));
+	TestEqual(TEXT("Results"), Results, TArray<double>({ 6 }));
+
+	FMathVM MathVM4;
+	TestTrue(TEXT("Tokenize"), MathVM4.Tokenize("y = 4; y + 1"));
+	TestTrue(TEXT("Library"), MathVM4.RegisterInlineFunctions("def half(value) = value / 2;"));
+	TestTrue(TEXT("Compile"), MathVM4.Compile());
+
+	Results.Empty();
+	TestTrue(TEXT("bSuccess"), MathVM4.Execute(LocalVariables, 1, Results, Error));
+	TestEqual(TEXT("Results"), Results, TArray<double>({ 5 }));
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMathVMTest_InlineFunctionsHygiene, "MathVM.InlineFunctionsHygiene", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FMathVMTest_InlineFunctionsHygiene::RunTest(const FString& Parameters)
+{
+	// the range variable of the body does not capture the argument
+	FMathVM MathVM;
+	TestTrue(TEXT("bSuccess"), MathVM.TokenizeAndCompile("def f(x) = sum(k, 0, 3, x); k = 10; f(k); f(f(k)); k"));
+
+	TMap<FString, double> LocalVariables;
+	TArray<double> Results;
+	FString Error;
+	TestTrue(TEXT("bSuccess"), MathVM.Execute(LocalVariables, 3, Results, Error));
+	TestEqual(TEXT("Results"), Results, TArray<double>({ 10, 160, 40 }));
+
+	return true;
+}
+
 #endif
@@ -3,8 +3,11 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "Async/Future.h"
+#include "Containers/StringView.h"
 #include "Modules/ModuleManager.h"
 #include "Runtime/Launch/Resources/Version.h"
+#include <atomic>
 
 #define MATHVM_ARGS FMathVMCallContext& CallContext, const TArray<double>& Args
 #define MATHVM_LAMBDA [](MATHVM_ARGS) -> bool
@@ -29,64 +32,213 @@ enum class EMathVMTokenType : uint8
 	Variable,
 	Semicolon,
 	Lock,
-	Unlock
+	Unlock,
+	Vector,
+	Swizzle,
+	// Index is the number of following tokens to skip (forward only, within the statement)
+	JumpIfZero,
+	Jump,
+	// sum() and prod() over a range, Index is the number of following tokens (the expression) evaluated for each step
+	RangeSum,
+	RangeProduct
 };
 
 class FMathVMBase;
 struct FMathVMCallContext;
 
-struct MATHVM_API FMathVMToken
+struct MATHVM_API FMathVMVector
 {
-	FMathVMToken() = delete;
+	FMathVMVector() : Value(0, 0, 0, 0), NumComponents(0)
+	{
+
+	}
+
+	explicit FMathVMVector(const double InValue) : Value(InValue, 0, 0, 0), NumComponents(1)
+	{
 
-	FMathVMToken(const EMathVMTokenType InTokenType) : NumericValue(0), Operator(nullptr), Function(nullptr), Precedence(0), NumArgs(0), TokenType(InTokenType)
+	}
+
+	explicit FMathVMVector(const FVector2D& InValue) : Value(InValue.X, InValue.Y, 0, 0), NumComponents(2)
 	{
 
 	}
 
-	FMathVMToken(const EMathVMTokenType InTokenType, const FString& InValue) : NumericValue(0), Operator(nullptr), Function(nullptr), Precedence(0), NumArgs(0), Value(InValue), TokenType(InTokenType)
+	explicit FMathVMVector(const FVector& InValue) : Value(InValue.X, InValue.Y, InValue.Z, 0), NumComponents(3)
+	{
+
+	}
+
+	explicit FMathVMVector(const FVector4& InValue) : Value(InValue), NumComponents(4)
+	{
+
+	}
+
+	FVector2D ToVector2D() const
+	{
+		return FVector2D(Value.X, Value.Y);
+	}
+
+	FVector ToVector() const
+	{
+		return FVector(Value.X, Value.Y, Value.Z);
+	}
+
+	FVector4 ToVector4() const
+	{
+		return Value;
+	}
+
+	FVector4 Value;
+	int32 NumComponents;
+};
+
+enum class EMathVMOperator : uint8
+{
+	Add,
+	Sub,
+	Mul,
+	Div,
+	Mod,
+	Assign
+};
+
+// compact (16 bytes) POD token: names, functions and vectors live in side tables and are referenced by Index
+struct MATHVM_API FMathVMToken
+{
+	FMathVMToken() = delete;
+
+	// Variable and Swizzle (symbol index), Function (program function index), Vector (temp vector index), JumpIfZero, Jump, RangeSum
+	// and RangeProduct (offset) or a token without payload
+	explicit FMathVMToken(const EMathVMTokenType InTokenType, const int32 InIndex = -1) : NumericValue(0), Index(InIndex), DetectedNumArgs(0), Precedence(0), TokenType(InTokenType)
 	{
 
 	}
 
 	// Number
-	FMathVMToken(const double InNumericValue) : NumericValue(InNumericValue), Operator(nullptr), Function(nullptr), Precedence(0), NumArgs(0), TokenType(EMathVMTokenType::Number)
+	explicit FMathVMToken(const double InNumericValue) : NumericValue(InNumericValue), Index(-1), DetectedNumArgs(0), Precedence(0), TokenType(EMathVMTokenType::Number)
 	{
 
 	}
 
 	// Operator
-	FMathVMToken(TFunction<bool(FMathVMCallContext&)> Callable, const int32 InPrecedence) : NumericValue(0), Operator(Callable), Function(nullptr), Precedence(InPrecedence), NumArgs(0), TokenType(EMathVMTokenType::Operator)
+	FMathVMToken(const EMathVMOperator InOperator, const int32 InPrecedence) : NumericValue(0), Index(static_cast<int32>(InOperator)), DetectedNumArgs(0), Precedence(static_cast<uint8>(InPrecedence)), TokenType(EMathVMTokenType::Operator)
 	{
 
 	}
 
-	// Function
-	FMathVMToken(const FString& InValue, TFunction<bool(FMathVMCallContext& CallContext, const TArray<double>& Args)> Callable, const int32 InNumArgs) : NumericValue(0), Operator(nullptr), Function(Callable), Precedence(0), NumArgs(InNumArgs), Value(InValue), TokenType(EMathVMTokenType::Function)
+	EMathVMOperator GetOperator() const
 	{
-
+		return static_cast<EMathVMOperator>(Index);
 	}
 
-	const double NumericValue;
-	const TFunction<bool(FMathVMCallContext&)> Operator;
-	const TFunction<bool(FMathVMCallContext&, const TArray<double>& Args)> Function;
-	const int32 Precedence;
-	const int32 NumArgs;
-	int32 DetectedNumArgs = 0;
-	const FString Value;
-	const EMathVMTokenType TokenType;
+	double NumericValue;
+	int32 Index;
+	uint16 DetectedNumArgs;
+	uint8 Precedence;
+	EMathVMTokenType TokenType;
 };
 
-using FMathVMStack = TArray<const FMathVMToken*>;
+static_assert(sizeof(FMathVMToken) == 16, "FMathVMToken must be kept compact");
+
+using FMathVMStack = TArray<FMathVMToken>;
 using FMathVMFunction = TFunction<bool(FMathVMCallContext& CallContext, const TArray<double>& Args)>;
 using FMathVMOperator = TFunction<bool(FMathVMCallContext& CallContext)>;
 
+// function referenced by the tokens of a program (resource functions bound at compile time get their own entry)
+struct MATHVM_API FMathVMProgramFunction
+{
+	FString Name;
+	FMathVMFunction Function;
+	// expected number of arguments (-1 for variable number of arguments)
+	int32 NumArgs = -1;
+	int32 ResourceIndex = -1;
+	// no side effects (the result depends only on the arguments), calls can be removed when the result is not used
+	bool bPure = false;
+};
+
+enum class EMathVMResourceFunction : uint8
+{
+	Read,
+	Write,
+	Sample,
+	Reduce,
+	AtomicAdd,
+	AtomicMin,
+	AtomicMax
+};
+
+enum class EMathVMResourceReduction : uint8
+{
+	Sum,
+	Min,
+	Max
+};
+
+enum class EMathVMResourceAtomic : uint8
+{
+	Add,
+	Min,
+	Max
+};
+
 class MATHVM_API IMathVMResource
 {
 public:
 	virtual ~IMathVMResource() = default;
 	virtual double Read(const TArray<double>& Args) const = 0;
 	virtual void Write(const TArray<double>& Args) = 0;
+
+	// filtered version of Read() used by sample(), resources without filtering support just Read()
+	virtual double Sample(const TArray<double>& Args) const
+	{
+		return Read(Args);
+	}
+
+	// atomically combines the last argument with the element at the specified coordinates (Result gets the previous value).
+	// Returns false if the resource does not support atomic operations
+	virtual bool Atomic(const EMathVMResourceAtomic Operation, const TArray<double>& Args, double& Result)
+	{
+		return false;
+	}
+
+	// merges pending (privatized) updates, called after parallel executions
+	virtual void Flush()
+	{
+	}
+
+	// resolves a symbolic argument (like a row or a field name) for the specified coordinate, used by the compiler for named resources
+	virtual bool ResolveArgument(const int32 Coordinate, const FString& Name, double& Value) const
+	{
+		return false;
+	}
+
+	// number of arguments expected by read() and write() (-1 for variable number of arguments), used by the compiler for validating named resources
+	virtual int32 GetNumReadArgs() const
+	{
+		return -1;
+	}
+
+	virtual int32 GetNumWriteArgs() const
+	{
+		return -1;
+	}
+
+	// Coordinates contains NumCoordinates values for each element, Results gets a value for each element
+	virtual void ReadBatch(TConstArrayView<double> Coordinates, const int32 NumCoordinates, TArrayView<double> Results) const;
+
+	// Coordinates contains NumCoordinates values for each element, Values contains the value to write for each element
+	virtual void WriteBatch(TConstArrayView<double> Coordinates, const int32 NumCoordinates, TConstArrayView<double> Values);
+
+	// direct access to the data of linear (single coordinate) resources, an empty view if not supported
+	virtual TConstArrayView<double> GetLinearView() const
+	{
+		return TConstArrayView<double>();
+	}
+
+	// reduce the [From, To) range of elements (Args are the additional coordinates following the element index).
+	// Returns false if the resource has no native support for it (the VM will fallback to Read() for each element).
+	// The default implementation works over GetLinearView()
+	virtual bool Reduce(const EMathVMResourceReduction Reduction, const int32 From, const int32 To, const TArray<double>& Args, double& Result) const;
 };
 
 namespace MathVM
@@ -94,16 +246,180 @@ namespace MathVM
 	namespace Utils
 	{
 		bool MATHVM_API SanitizeName(const FString& Name);
+
+		// returns the vector component index (0-3) of a swizzle char (xyzw or rgba), -1 on invalid char
+		int32 MATHVM_API GetSwizzleComponent(const TCHAR Char);
+
+		// checks that a swizzle has 1 to 4 valid components, on failure Error describes the problem
+		bool MATHVM_API ValidateSwizzle(FStringView Components, FString& Error);
+
+		// maps an operator symbol (+, -, *, /, %, =) to the operator and its precedence
+		bool MATHVM_API ParseOperator(FStringView Symbol, EMathVMOperator& Operator, int32& Precedence);
+
+		const TCHAR* MATHVM_API GetOperatorSymbol(const EMathVMOperator Operator);
+
+		// parses a number literal (digits, optional fraction and exponent) with correct rounding, returns false on invalid syntax
+		bool MATHVM_API ParseNumber(FStringView Text, double& Value);
+
+		// vectorizable reduction of a non empty array of values
+		bool MATHVM_API Reduce(const EMathVMResourceReduction Reduction, TConstArrayView<double> Values, double& Result);
+
+		// vectorizable dot product of two arrays of values (the shortest length is used)
+		double MATHVM_API Dot(TConstArrayView<double> A, TConstArrayView<double> B);
 	}
 }
 
+// interned names: each distinct identifier is stored once and referenced by a dense index
+class MATHVM_API FMathVMSymbolTable
+{
+public:
+	// returns the index of the name, adding it if required
+	int32 Intern(FStringView Name);
+
+	// returns -1 if the name has not been interned
+	int32 Find(FStringView Name) const;
+
+	const FString& GetName(const int32 Index) const;
+
+	int32 Num() const;
+
+	void Empty();
+
+	// removes the symbols interned after the first NumSymbols ones (the remaining ones keep their indices)
+	void Truncate(const int32 NumSymbols);
+
+protected:
+	static uint32 Hash(FStringView Name);
+
+	TArray<FString> Names;
+	// chain of symbols with the same hash bucket
+	TArray<int32> NextInBucket;
+	TMap<uint32, int32> Buckets;
+};
+
+// what a symbol refers to at runtime, resolved once after compilation (and after registering constants and globals)
+struct MATHVM_API FMathVMSymbolBinding
+{
+	// slot in FMathVMLocals (symbols differing only by case share the same slot)
+	int32 Variable = -1;
+	int32 GlobalVariable = -1;
+	int32 GlobalVector = -1;
+	bool bIsConst = false;
+	double ConstValue = 0;
+};
+
+// local variables addressed by index (see FMathVMBase::GetVariableIndex()), no name lookup happens while executing.
+// The same object can be reused for multiple executions of the same program
+struct MATHVM_API FMathVMLocals
+{
+	// scalars are stored as single component vectors, NumComponents == 0 marks an unset variable
+	TArray<FMathVMVector> Values;
+
+	// unsets every variable
+	void Init(const int32 NumVariables)
+	{
+		Values.Reset();
+		Values.SetNum(NumVariables);
+	}
+
+	bool IsSet(const int32 Index) const
+	{
+		return Values.IsValidIndex(Index) && Values[Index].NumComponents > 0;
+	}
+
+	// invalid indices (variables not referenced by the program) are silently ignored
+	void SetVariable(const int32 Index, const double Value)
+	{
+		if (Values.IsValidIndex(Index))
+		{
+			Values[Index] = FMathVMVector(Value);
+		}
+	}
+
+	void SetVector(const int32 Index, const FMathVMVector& Value)
+	{
+		if (Values.IsValidIndex(Index))
+		{
+			Values[Index] = Value;
+		}
+	}
+
+	void Unset(const int32 Index)
+	{
+		if (Values.IsValidIndex(Index))
+		{
+			Values[Index].NumComponents = 0;
+		}
+	}
+
+	bool GetVariable(const int32 Index, double& Value) const
+	{
+		if (!Values.IsValidIndex(Index) || Values[Index].NumComponents != 1)
+		{
+			return false;
+		}
+		Value = Values[Index].Value.X;
+		return true;
+	}
+
+	bool GetVector(const int32 Index, FMathVMVector& Value) const
+	{
+		if (!IsSet(Index))
+		{
+			return false;
+		}
+		Value = Values[Index];
+		return true;
+	}
+};
+
+// variables read and written by a statement (see FMathVMBase::GetStatementInfo())
+struct MATHVM_API FMathVMStatementInfo
+{
+	// local slots assigned by the statement
+	TArray<int32> Defs;
+	// token of each def (the assignment or the range), parallel to Defs
+	TArray<int32> DefTokens;
+	// Variable tokens written by the statement (assignment targets and range variables)
+	TArray<int32> TargetTokens;
+	// local slots read by the statement
+	TArray<int32> Uses;
+	// values left on the stack
+	int32 NumResults = 0;
+	bool bHasSideEffects = false;
+	// NumResults is not reliable (impure functions can push any number of values)
+	bool bUnknownResults = false;
+};
+
+// optimized copy of the program swapped in once it gets hot (see FMathVMBase::SetPromotionThreshold())
+struct MATHVM_API FMathVMPromotedProgram
+{
+	TArray<TArray<FMathVMToken>> Statements;
+	// local slots of the global variables baked as constants (locals with the same name would shadow them)
+	TArray<int32> BakedSlots;
+	// globals version at the time the global variables have been baked
+	uint32 GlobalsVersion = 0;
+	bool bGuarded = false;
+	// executions falling back to the original program because of a failed guard
+	mutable std::atomic<int32> NumFailedGuards = 0;
+};
+
+// function defined by the code with "def name(a, b) = expression;" (its body is expanded at every call site)
+struct MATHVM_API FMathVMInlineFunction
+{
+	TArray<FString> Params;
+	// Variable, Swizzle and Function tokens reference Names (so that the definition survives Reset())
+	TArray<FMathVMToken> Body;
+	TArray<FString> Names;
+};
+
 class MATHVM_API FMathVMBase
 {
 
 public:
 	FMathVMBase();
 
-	virtual ~FMathVMBase() = default;
+	virtual ~FMathVMBase();
 
 	bool Tokenize(const FString& Code);
 
@@ -111,6 +427,12 @@ public:
 
 	bool TokenizeAndCompile(const FString& Code);
 
+	// stores the compiled program (functions are referenced by name, resources by index)
+	bool SaveProgram(FArchive& Archive);
+
+	// replaces the current program with a previously saved one (functions and resources must be already registered)
+	bool LoadProgram(FArchive& Archive);
+
 	bool Execute(TMap<FString, double>& LocalVariables, const int32 PopResults, TArray<double>& Results, FString& Error, void* LocalContext = nullptr);
 
 	bool ExecuteAndDiscard(TMap<FString, double>& LocalVariables, FString& Error, void* LocalContext = nullptr);
@@ -119,10 +441,75 @@ public:
 
 	bool ExecuteStealth(TMap<FString, double>& LocalVariables, void* LocalContext = nullptr);
 
+	bool Execute(TMap<FString, double>& LocalVariables, TMap<FString, FMathVMVector>& LocalVectors, const int32 PopResults, TArray<double>& Results, FString& Error, void* LocalContext = nullptr);
+
+	// like Execute() but local variables are addressed by index (Locals is grown to GetNumVariables() if required)
+	bool Execute(FMathVMLocals& Locals, const int32 PopResults, TArray<double>& Results, FString& Error, void* LocalContext = nullptr);
+
+	bool ExecuteAndDiscard(FMathVMLocals& Locals, FString& Error, void* LocalContext = nullptr);
+
+	// index of the local variable slot for the specified name, -1 if the program does not reference it
+	int32 GetVariableIndex(const FString& Name) const;
+
+	int32 GetNumVariables() const;
+
+	// returns a variant of the program running only the statements required for the specified outputs: the variables (local or global)
+	// read after the execution and the number of popped results. Statements with side effects (writes to resources, assignments to globals,
+	// impure functions and critical sections) are always kept. Variants are cached per output set and discarded by Reset() and by
+	// registering constants or globals (must not be called while the VM is executing)
+	int32 GetProgramVariant(const TArray<FString>& OutputVariables, const int32 PopResults);
+
+	// returns a variant of the program (see GetProgramVariant()) with the KnownValues variables baked as constants: the expressions depending
+	// only on constants are folded and the statements not required for the specified outputs are removed. A known variable is replaced only
+	// in the statements preceding its first assignment. Every call adds a new variant (returns -1 on error)
+	int32 Specialize(const TMap<FString, double>& KnownValues, const TArray<FString>& OutputVariables, const int32 PopResults);
+
+	// number of executions (through Execute()) after which the program is constant folded in the background and swapped in for the
+	// subsequent executions (0 disables the promotion)
+	void SetPromotionThreshold(const int32 NumExecutions);
+
+	// when enabled the promotion bakes the current values of the global variables not assigned by the program too. The optimized program
+	// is guarded by a version counter bumped by SetGlobalVariable() and RegisterGlobalVariable(): when the guard fails Execute() falls back
+	// to the original program, and the globals are baked again after PromotionThreshold fallbacks (must not be called while executing)
+	void SetSpecializeGlobals(const bool bEnabled);
+
+	// true when Execute() runs the optimized program (and its guard, if any, holds)
+	bool IsPromoted() const;
+
+	// blocks until a pending background optimization has been completed
+	void WaitForPromotion();
+
+	bool ExecuteVariant(const int32 Variant, FMathVMLocals& Locals, const int32 PopResults, TArray<double>& Results, FString& Error, void* LocalContext = nullptr);
+
+	// -1 for the whole program
+	int32 GetNumStatements(const int32 Variant = -1) const;
+
+	bool GetStatementInfo(const int32 StatementIndex, FMathVMStatementInfo& Info) const;
+
+	// runs a single statement of the program over the specified context (the values it produces are left on the context stack)
+	bool ExecuteStatement(const int32 StatementIndex, FMathVMCallContext& CallContext, FString& Error);
+
+	// pops the results from the context stack like Execute() does (variables are resolved with the context locals)
+	bool PopStackResults(FMathVMCallContext& CallContext, const int32 NumResults, TArray<double>& Results, FString& Error) const;
+
 	const FString& GetError() const;
 
+	// maximum number of steps of a sum() or prod() range (larger ranges raise a runtime error)
+	void SetMaxRangeIterations(const int32 NumIterations);
+
+	int32 GetMaxRangeIterations() const;
+
 	bool RegisterFunction(const FString& Name, FMathVMFunction Callable, const int32 NumArgs);
 
+	// registers the inline functions defined by Code (only def statements are allowed). Inline functions (including the ones
+	// defined by the tokenized programs) are kept by Reset() like the registered functions
+	bool RegisterInlineFunctions(const FString& Code);
+
+	bool HasInlineFunction(const FString& Name) const;
+
+	// like RegisterFunction() for functions without side effects (the optimizer can remove calls whose result is not used)
+	bool RegisterPureFunction(const FString& Name, FMathVMFunction Callable, const int32 NumArgs);
+
 	bool RegisterGlobalVariable(const FString& Name, const double Value);
 
 	bool RegisterConst(const FString& Name, const double Value);
@@ -136,11 +523,54 @@ public:
 	void SetGlobalVariable(const FString& Name, const double Value);
 	double GetGlobalVariable(const FString& Name) const;
 
+	// returns -1 if the global variable has not been registered
+	int32 GetGlobalVariableIndex(const FString& Name) const;
+
+	void SetGlobalVariable(const int32 Index, const double Value);
+	double GetGlobalVariable(const int32 Index) const;
+
+	bool RegisterGlobalVector(const FString& Name, const FMathVMVector& Value);
+
+	bool HasGlobalVector(const FString& Name) const;
+
+	void SetGlobalVector(const FString& Name, const FMathVMVector& Value);
+	FMathVMVector GetGlobalVector(const FString& Name) const;
+
+	// returns -1 if the global vector has not been registered
+	int32 GetGlobalVectorIndex(const FString& Name) const;
+
+	void SetGlobalVector(const int32 Index, const FMathVMVector& Value);
+	FMathVMVector GetGlobalVector(const int32 Index) const;
+
+	TMap<FString, FMathVMVector> GetGlobalVectors() const;
+
 	int32 RegisterResource(TSharedPtr<IMathVMResource> Resource);
 
+	// the resource can be addressed by name in the code (read(Name, ...)), returns -1 on error
+	int32 RegisterResource(const FString& Name, TSharedPtr<IMathVMResource> Resource);
+
+	int32 GetResourceIndex(const FString& Name) const;
+
 	TSharedPtr<IMathVMResource> GetResource(const int32 Index) const;
 
-	const TMap<FString, double>& GetGlobalVariables() const;
+	// like GetResource() but without touching the reference counter (the VM keeps its resources alive)
+	IMathVMResource* GetRawResource(const int32 Index) const;
+
+	// calls Flush() on every resource (must not be called while the VM is executing)
+	void FlushResources();
+
+	TMap<FString, double> GetGlobalVariables() const;
+
+	// names referenced by Variable and Swizzle tokens
+	const FString& GetSymbolName(const int32 Index) const;
+
+	const FMathVMSymbolBinding& GetSymbolBinding(const int32 Index) const
+	{
+		return SymbolBindings[Index];
+	}
+
+	// functions referenced by Function tokens
+	const FMathVMProgramFunction& GetProgramFunction(const int32 Index) const;
 
 	void Reset();
 
@@ -158,24 +588,102 @@ protected:
 		return Tokens.Last();
 	}
 
-	bool ExecuteStatement(FMathVMCallContext& CallContext, const TArray<const FMathVMToken*> Statement, FString& Error);
+	bool ExecuteStatement(FMathVMCallContext& CallContext, TConstArrayView<FMathVMToken> Statement, FString& Error);
 
-	bool CheckAndResetAccumulator();
+	// evaluates the Expression tokens for each step of the range (the variable and the bounds are on the stack)
+	bool ExecuteRange(FMathVMCallContext& CallContext, const FMathVMToken& RangeToken, TConstArrayView<FMathVMToken> Expression, FString& Error);
 
-	bool CheckAccumulator(const bool bLastCheck);
+	// fills Tokens from Code (the symbols table is only appended to)
+	bool TokenizeSource(const FString& Code);
+
+	bool AddIdentifier(FStringView Identifier);
 
 	bool AddToken(const FMathVMToken& Token);
 
+	// removes the def statements from Tokens and replaces the calls to inline functions with their body
+	bool ExpandInlineFunctions();
+
+	bool DefineInlineFunction(TConstArrayView<FMathVMToken> Statement);
+
+	// appends Input to Output expanding the calls to inline functions
+	bool ExpandInlineCalls(TConstArrayView<FMathVMToken> Input, TArray<FMathVMToken>& Output);
+
+	bool RegisterResourceFunction(const FString& Name, FMathVMFunction Callable, const int32 NumArgs, const EMathVMResourceFunction ResourceFunction);
+
+	bool BindResourceFunction(FMathVMToken& FunctionToken, TArray<FMathVMToken>& OutputQueue, const TArray<int32>& ArgsStarts, const TSet<int32>& AssignedSymbols);
+
+	bool MakeResourceFunction(const FString& Name, const EMathVMResourceFunction ResourceFunction, IMathVMResource* Resource, FMathVMFunction& BoundFunction) const;
+
+	// returns the index of the program function (unbound functions are shared by all the tokens with the same name)
+	int32 AddProgramFunction(const FString& Name, const int32 ResourceIndex = -1, FMathVMFunction BoundFunction = nullptr);
+
+	bool CallOperator(FMathVMCallContext& CallContext, const EMathVMOperator Operator) const;
+
+	// resolves every symbol to its local slot, constant or global (no string is hashed at runtime)
+	void BindSymbols();
+
+	// copy of the program with KnownValues baked as constants and the expressions depending only on constants folded
+	TArray<TArray<FMathVMToken>> FoldStatements(const TMap<FString, double>& KnownValues);
+
+	// replaces the tokens of Statement starting at Start with the number they evaluate to, returns false if they cannot be folded
+	bool FoldConstants(TArray<FMathVMToken>& Statement, const int32 Start);
+
+	// sorted local slots of the specified variables (the ones not referenced by the program are skipped)
+	TArray<int32> GetOutputSlots(const TArray<FString>& OutputVariables) const;
+
+	// discards the optimized program (waiting for a pending optimization)
+	void ResetPromotion();
+
+	// generates the optimized program in the background (over a copy of the program made by the calling thread)
+	void StartPromotion();
+
+	// copies the compiled program and everything it is bound to (the copy can be optimized on another thread)
+	void CopyProgram(FMathVMBase& Target) const;
+
+	// a single atomic load (the program stays alive until ResetPromotion())
+	const FMathVMPromotedProgram* GetPromotedProgram() const;
+
+	bool IsPromotedProgramValid(const FMathVMPromotedProgram& Program, const FMathVMLocals* Locals) const;
+
+	bool ExecuteProgram(const TArray<TArray<FMathVMToken>>& Program, FMathVMLocals& Locals, const int32 PopResults, TArray<double>& Results, FString& Error, void* LocalContext);
+
 	TArray<FMathVMToken> Tokens;
 	FString LastError;
 
 	int32 CurrentLine;
 	int32 CurrentOffset;
 
-	FString Accumulator;
+	FMathVMSymbolTable Symbols;
+
+	// symbols referenced by the compiled statements (the ones interned later are dropped by the next tokenization)
+	int32 NumCompiledSymbols = 0;
+
+	TArray<FMathVMSymbolBinding> SymbolBindings;
+
+	// case insensitive mapping of names to local slots
+	TMap<FString, int32> VariableIndices;
+
+	TArray<FMathVMProgramFunction> ProgramFunctions;
+
+	TMap<FString, int32> ProgramFunctionIndices;
 
 	TMap<FString, TPair<FMathVMFunction, int32>> Functions;
 
+	// functions whose first argument is a resource index (they can be bound at compile time)
+	TMap<FString, EMathVMResourceFunction> ResourceFunctions;
+
+	TSet<FString> PureFunctions;
+
+	// functions compiled to conditional jumps (the arms are lazily evaluated)
+	TSet<FString> SelectFunctions;
+
+	// functions compiled to loops over a range (sum() and prod())
+	TMap<FString, EMathVMTokenType> RangeFunctions;
+
+	int32 MaxRangeIterations = 1024;
+
+	TMap<FString, FMathVMInlineFunction> InlineFunctions;
+
 	FMathVMOperator OperatorAdd;
 	FMathVMOperator OperatorSub;
 	FMathVMOperator OperatorMul;
@@ -185,12 +693,43 @@ protected:
 
 	TMap<FString, const double> Constants;
 
-	TMap<FString, double> GlobalVariables;
+	// globals are stored in dense arrays so that they can be addressed by index
+	TMap<FString, int32> GlobalVariableIndices;
+	TArray<double> GlobalVariables;
+
+	TMap<FString, int32> GlobalVectorIndices;
+	TArray<FMathVMVector> GlobalVectors;
+
+	TArray<TArray<FMathVMToken>> Statements;
+
+	// pruned (and specialized) copies of Statements (see GetProgramVariant() and Specialize())
+	TArray<TArray<TArray<FMathVMToken>>> ProgramVariants;
+
+	// keyed by the sorted output slots and the number of popped results
+	TMap<FString, int32> ProgramVariantIndices;
+
+	// constant folded copy of Statements used by Execute() once the program gets hot (see SetPromotionThreshold()), published under
+	// PromotionLock and read with a single atomic load. Replaced programs can still be running, so they are freed by ResetPromotion()
+	std::atomic<const FMathVMPromotedProgram*> PromotedProgram = nullptr;
+	TArray<TUniquePtr<FMathVMPromotedProgram>> PromotedPrograms;
+	// programs whose globals keep changing are not promoted again after this number of promotions
+	static constexpr int32 MaxPromotedPrograms = 4;
+	mutable FCriticalSection PromotionLock;
+	std::atomic<int32> NumExecutions = 0;
+	int32 PromotionThreshold = 64;
+	bool bSpecializeGlobals = false;
+	TFuture<void> PendingPromotion;
+
+	// bumped at every change of a global variable from C++ (guards the promoted programs baking globals)
+	std::atomic<uint32> GlobalsVersion = 0;
 
-	TArray<TArray<const FMathVMToken*>> Statements;
+	// bumped at every change of the compiled program or of its bindings (a background optimization of an older program is discarded)
+	std::atomic<uint32> ProgramVersion = 0;
 
 	TArray<TSharedPtr<IMathVMResource>> Resources;
 
+	TMap<FString, int32> ResourceNames;
+
 	FCriticalSection Lock;
 };
 
@@ -206,8 +745,9 @@ struct MATHVM_API FMathVMCallContext
 {
 	FMathVMBase& MathVM;
 	FMathVMStack Stack;
-	TMap<FString, double>& LocalVariables;
-	TArray<FMathVMToken> TempTokens;
+	FMathVMLocals& Locals;
+	// values of the Vector tokens pushed on the stack
+	TArray<FMathVMVector> TempVectors;
 	FString LastError;
 	void* LocalContext = nullptr;
 
@@ -215,7 +755,7 @@ struct MATHVM_API FMathVMCallContext
 	FMathVMCallContext(const FMathVMCallContext& Other) = delete;
 	FMathVMCallContext(FMathVMCallContext&& Other) = delete;
 
-	FMathVMCallContext(FMathVMBase& InMathVM, TMap<FString, double>& InLocalVariables, void* InLocalContext) : MathVM(InMathVM), LocalVariables(InLocalVariables), LocalContext(InLocalContext)
+	FMathVMCallContext(FMathVMBase& InMathVM, FMathVMLocals& InLocals, void* InLocalContext) : MathVM(InMathVM), Locals(InLocals), LocalContext(InLocalContext)
 	{
 
 	}
@@ -224,12 +764,24 @@ struct MATHVM_API FMathVMCallContext
 
 	bool PopArgument(double& Value);
 
+	// like PopArgument() but accepts vectors too (scalars are returned as single component vectors)
+	bool PopVector(FMathVMVector& Value);
+
 	bool PopName(FString& Name);
 
+	// pops a variable returning its symbol index
+	bool PopSymbol(int32& Index);
+
 	bool PushResult(const double Value);
 
+	bool PushResult(const FMathVMVector& Value);
+
+	bool Swizzle(const FString& Components);
+
 	double ReadResource(const int32 Index, const TArray<double>& Args);
 
+	double SampleResource(const int32 Index, const TArray<double>& Args);
+
 	void WriteResource(const int32 Index, const TArray<double>& Args);
 };
 
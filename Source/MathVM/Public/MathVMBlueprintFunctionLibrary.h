@@ -8,6 +8,7 @@
 #include "Kismet/BlueprintFunctionLibrary.h"
 #include "Kismet/KismetRenderingLibrary.h"
 #include "Layout/Margin.h"
+#include "MathVMProgram.h"
 #include "MathVMResourceObject.h"
 #include "MathVMBlueprintFunctionLibrary.generated.h"
 
@@ -19,6 +20,16 @@ namespace MathVM
 	}
 }
 
+UENUM(BlueprintType)
+enum class EMathVMArrayElementType : uint8
+{
+	Double,
+	Float,
+	Half,
+	Int32,
+	NormalizedByte
+};
+
 UENUM()
 enum class EMathVMPlotterShape : uint8
 {
@@ -179,14 +190,20 @@ class MATHVM_API UMathVMBlueprintFunctionLibrary : public UBlueprintFunctionLibr
 
 public:
 	UFUNCTION(BlueprintCallable, Category = "MathVM")
-	static UMathVMResourceObject* MathVMResourceObjectFromTexture2D(UTexture2D* Texture);
+	static UMathVMResourceObject* MathVMResourceObjectFromTexture2D(UTexture2D* Texture, const bool bClampAddress = false);
 
 	UFUNCTION(BlueprintCallable, Category = "MathVM")
-	static UMathVMResourceObject* MathVMResourceObjectFromCurveBase(UCurveBase* Curve);
+	static UMathVMResourceObject* MathVMResourceObjectFromCurveBase(UCurveBase* Curve, const int32 BakeResolution = 0, const double BakeTolerance = 0);
 
 	UFUNCTION(BlueprintCallable, Category = "MathVM")
 	static UMathVMResourceObject* MathVMResourceObjectAsDoubleArray(const int32 ArraySize);
 
+	UFUNCTION(BlueprintCallable, Category = "MathVM")
+	static UMathVMResourceObject* MathVMResourceObjectAsTypedArray(const int32 ArraySize, const EMathVMArrayElementType ElementType, const bool bPrivatizedAtomics = false);
+
+	UFUNCTION(BlueprintCallable, Category = "MathVM")
+	static UMathVMResourceObject* MathVMResourceObjectFromMappedFile(const FString& Filename, const EMathVMArrayElementType ElementType, const bool bCopyOnWrite = false);
+
 	UFUNCTION(BlueprintCallable, Category = "MathVM")
 	static UMathVMResourceObject* MathVMResourceObjectFromDataTable(UDataTable* DataTable, const TArray<FString>& FieldNames);
 
@@ -199,6 +216,19 @@ public:
 	UFUNCTION(BlueprintCallable, meta = (AutoCreateRefTerm = "GlobalVariables,Constants,Resources"), Category = "MathVM")
 	static void MathVMRun(const FString& Code, const TMap<FString, double>& GlobalVariables, const TMap<FString, double>& Constants, const TArray<UMathVMResourceObject*>& Resources, const FMathVMEvaluatedWithResult& OnEvaluated, const int32 NumSamples = 1, const FString& SampleLocalVariable = "i");
 
+	UFUNCTION(BlueprintCallable, meta = (AutoCreateRefTerm = "LocalVariables,Resources"), Category = "MathVM")
+	static bool MathVMRunSimpleProgram(UMathVMProgram* Program, UPARAM(ref) TMap<FString, double>& LocalVariables, const TArray<UMathVMResourceObject*>& Resources, double& Result, FString& Error);
+
+	UFUNCTION(BlueprintCallable, meta = (AutoCreateRefTerm = "LocalVariables,Resources"), Category = "MathVM")
+	static bool MathVMRunSimpleMultiProgram(UMathVMProgram* Program, UPARAM(ref) TMap<FString, double>& LocalVariables, const TArray<UMathVMResourceObject*>& Resources, const int32 PopResults, TArray<double>& Results, FString& Error);
+
+	UFUNCTION(BlueprintCallable, meta = (AutoCreateRefTerm = "GlobalVariables,Constants,Resources"), Category = "MathVM")
+	static void MathVMRunProgram(UMathVMProgram* Program, const TMap<FString, double>& GlobalVariables, const TMap<FString, double>& Constants, const TArray<UMathVMResourceObject*>& Resources, const FMathVMEvaluatedWithResult& OnEvaluated, const int32 NumSamples = 1, const FString& SampleLocalVariable = "i");
+
 	UFUNCTION(BlueprintCallable, meta = (WorldContext = "WorldContextObject", AutoCreateRefTerm = "TextsToPlot,Constants,GlobalVariables,Resources,PlotterConfig"), Category = "MathVM")
 	static void MathVMPlotter(UObject* WorldContextObject, const FString& Code, const int32 NumSamples, const TMap<FString, FMathVMPlot>& VariablesToPlot, const TArray<FMathVMText>& TextsToPlot, const TMap<FString, double>& Constants, const TMap<FString, double>& GlobalVariables, const TArray<UMathVMResourceObject*>& Resources, const FMathVMPlotGenerated& OnPlotGenerated, const FMathVMPlotterConfig& PlotterConfig, const double DomainMin = 0, const double DomainMax = 1, const FString& SampleLocalVariable = "i");
+
+protected:
+	// shared by MathVMRun() and MathVMRunProgram(), Compile is called after globals, constants and resources registration
+	static void RunAsync(TFunction<bool(FMathVM& MathVM, FString& Error)> Compile, const TMap<FString, double>& GlobalVariables, const TMap<FString, double>& Constants, const TArray<UMathVMResourceObject*>& Resources, const FMathVMEvaluatedWithResult& OnEvaluated, const int32 NumSamples, const FString& SampleLocalVariable);
 };
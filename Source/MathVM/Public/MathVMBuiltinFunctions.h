@@ -17,6 +17,7 @@ namespace MathVM
 		MATHVM_API bool Ceil(MATHVM_ARGS); constexpr int32 CeilArgs = 1;
 		MATHVM_API bool Clamp(MATHVM_ARGS); constexpr int32 ClampArgs = 3;
 		MATHVM_API bool Cos(MATHVM_ARGS); constexpr int32 CosArgs = 1;
+		MATHVM_API bool Cross(MATHVM_ARGS); constexpr int32 CrossArgs = -1;
 		MATHVM_API bool Degrees(MATHVM_ARGS); constexpr int32 DegreesArgs = 1;
 		MATHVM_API bool Distance(MATHVM_ARGS); constexpr int32 DistanceArgs = -1;
 		MATHVM_API bool Dot(MATHVM_ARGS); constexpr int32 DotArgs = -1;
@@ -44,20 +45,38 @@ namespace MathVM
 		MATHVM_API bool Mean(MATHVM_ARGS); constexpr int32 MeanArgs = -1;
 		MATHVM_API bool Min(MATHVM_ARGS); constexpr int32 MinArgs = -1;
 		MATHVM_API bool Mod(MATHVM_ARGS); constexpr int32 ModArgs = 2;
+		MATHVM_API bool Normalize(MATHVM_ARGS); constexpr int32 NormalizeArgs = -1;
 		MATHVM_API bool Not(MATHVM_ARGS); constexpr int32 NotArgs = 1;
 		MATHVM_API bool Pow(MATHVM_ARGS); constexpr int32 PowArgs = 2;
+		MATHVM_API bool Prod(MATHVM_ARGS); constexpr int32 ProdArgs = 4;
 		MATHVM_API bool Radians(MATHVM_ARGS); constexpr int32 RadiansArgs = 1;
 		MATHVM_API bool Rand(MATHVM_ARGS); constexpr int32 RandArgs = 2;
 		MATHVM_API bool Round(MATHVM_ARGS); constexpr int32 RoundArgs = 1;
 		MATHVM_API bool RoundEven(MATHVM_ARGS); constexpr int32 RoundEvenArgs = 1;
+		MATHVM_API bool Select(MATHVM_ARGS); constexpr int32 SelectArgs = 3;
 		MATHVM_API bool Sign(MATHVM_ARGS); constexpr int32 SignArgs = 1;
 		MATHVM_API bool Sin(MATHVM_ARGS); constexpr int32 SinArgs = 1;
 		MATHVM_API bool Sqrt(MATHVM_ARGS); constexpr int32 SqrtArgs = 1;
+		MATHVM_API bool Sum(MATHVM_ARGS); constexpr int32 SumArgs = 4;
 		MATHVM_API bool Tan(MATHVM_ARGS); constexpr int32 TanArgs = 1;
 		MATHVM_API bool Trunc(MATHVM_ARGS); constexpr int32 TruncArgs = 1;
 
+		// Vectors
+		MATHVM_API bool Vec2(MATHVM_ARGS); constexpr int32 Vec2Args = -1;
+		MATHVM_API bool Vec3(MATHVM_ARGS); constexpr int32 Vec3Args = -1;
+		MATHVM_API bool Vec4(MATHVM_ARGS); constexpr int32 Vec4Args = -1;
+
 		// Resources
 		MATHVM_API bool Read(MATHVM_ARGS); constexpr int32 ReadArgs = -1;
 		MATHVM_API bool Write(MATHVM_ARGS); constexpr int32 WriteArgs = -1;
+		MATHVM_API bool Sample(MATHVM_ARGS); constexpr int32 SampleArgs = -1;
+		MATHVM_API bool AtomicAdd(MATHVM_ARGS); constexpr int32 AtomicAddArgs = -1;
+		MATHVM_API bool AtomicMin(MATHVM_ARGS); constexpr int32 AtomicMinArgs = -1;
+		MATHVM_API bool AtomicMax(MATHVM_ARGS); constexpr int32 AtomicMaxArgs = -1;
+		MATHVM_API bool SumOf(MATHVM_ARGS); constexpr int32 SumOfArgs = -1;
+		MATHVM_API bool MinOf(MATHVM_ARGS); constexpr int32 MinOfArgs = -1;
+		MATHVM_API bool MaxOf(MATHVM_ARGS); constexpr int32 MaxOfArgs = -1;
+		MATHVM_API bool MeanOf(MATHVM_ARGS); constexpr int32 MeanOfArgs = -1;
+		MATHVM_API bool DotOf(MATHVM_ARGS); constexpr int32 DotOfArgs = 4;
 	}
 }
\ No newline at end of file
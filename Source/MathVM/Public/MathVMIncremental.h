@@ -0,0 +1,69 @@
+// Copyright 2024, Roberto De Ioris.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MathVM.h"
+
+// Stateful evaluator for programs executed again and again with mostly unchanged inputs (per frame updates, formula sheets).
+// Local variables are kept between evaluations and only the statements depending (directly or indirectly) on changed
+// variables are executed again. Statements with side effects are always executed.
+// The evaluator must be recreated when the program is compiled again.
+class MATHVM_API FMathVMIncrementalEvaluator
+{
+public:
+	FMathVMIncrementalEvaluator(FMathVMBase& InMathVM, void* InLocalContext = nullptr);
+
+	// the variable is marked as changed only if the value is different
+	void SetVariable(const int32 Index, const double Value);
+	void SetVariable(const FString& Name, const double Value);
+
+	void SetVector(const int32 Index, const FMathVMVector& Value);
+	void SetVector(const FString& Name, const FMathVMVector& Value);
+
+	// for global variables changed outside of the program (Index is the local slot, see FMathVMBase::GetVariableIndex())
+	void MarkChanged(const int32 Index);
+	void MarkChanged(const FString& Name);
+
+	// the next evaluation will execute every statement (like after resources have been updated)
+	void MarkAllDirty();
+
+	bool Evaluate();
+
+	// pops results from the values left by the statements during their last execution (like FMathVMBase::Execute())
+	bool GetResults(const int32 PopResults, TArray<double>& Results);
+
+	bool GetVariable(const FString& Name, double& Value) const;
+
+	const FMathVMLocals& GetLocals() const;
+
+	const FString& GetError() const;
+
+	// number of statements executed by the last evaluation
+	int32 GetNumExecutedStatements() const;
+
+protected:
+	struct FStatementState
+	{
+		FMathVMStatementInfo Info;
+		// values left on the stack by the last execution
+		FMathVMStack Stack;
+		TArray<FMathVMVector> TempVectors;
+		bool bValid = false;
+	};
+
+	bool Init();
+
+	bool SetError(const FString& InError);
+
+	FMathVMBase& MathVM;
+	void* LocalContext;
+	FMathVMLocals Locals;
+	TArray<FStatementState> StatementStates;
+	// first statement reading each local slot
+	TArray<int32> FirstUses;
+	TBitArray<> Changed;
+	bool bAllDirty = true;
+	int32 NumExecutedStatements = 0;
+	FString Error;
+};
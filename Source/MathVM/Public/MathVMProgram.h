@@ -0,0 +1,62 @@
+// Copyright 2024, Roberto De Ioris.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/DataAsset.h"
+#include "MathVM.h"
+#include "MathVMProgram.generated.h"
+
+/**
+ * MathVM code stored as an asset: it is validated and compiled when saved (and cooked),
+ * so at runtime the compiled program is loaded without tokenization and compilation.
+ */
+UCLASS(BlueprintType)
+class MATHVM_API UMathVMProgram : public UDataAsset
+{
+	GENERATED_BODY()
+
+public:
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, meta = (MultiLine = true), Category = "MathVM")
+	FString Code;
+
+	// programs whose Code defines inline functions (def statements) usable by Code, they are expanded in the compiled program
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "MathVM")
+	TArray<TObjectPtr<UMathVMProgram>> Libraries;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "MathVM")
+	FString CompileError;
+
+	// compiles Code with the builtin functions of FMathVM and stores the result
+	UFUNCTION(BlueprintCallable, Category = "MathVM")
+	bool Compile();
+
+	// loads the compiled program into the VM (its resources must be already registered).
+	// Falls back to compiling the code if the compiled program is missing or was generated by an incompatible version.
+	bool Load(FMathVMBase& MathVM, FString& Error) const;
+
+	// registers the inline functions of the libraries (and of their libraries) in the VM
+	bool RegisterLibraries(FMathVMBase& MathVM, FString& Error) const;
+
+	// hash of the code of the libraries (and of their libraries), a compiled program is stale if it does not match anymore
+	uint32 GetLibrariesHash() const;
+
+	const TArray<uint8>& GetCompiledProgram() const;
+
+	virtual void PreSave(FObjectPreSaveContext ObjectSaveContext) override;
+
+#if WITH_EDITOR
+	virtual void PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent) override;
+#endif
+
+protected:
+	UPROPERTY()
+	TArray<uint8> CompiledProgram;
+
+	// libraries hash at the time of the compilation
+	UPROPERTY()
+	uint32 CompiledLibrariesHash = 0;
+
+	// the code calls functions unknown to FMathVM (registered by the game), it can only be compiled at runtime
+	bool bUnknownFunctions = false;
+};
@@ -5,52 +5,642 @@
 #include "CoreMinimal.h"
 #include "Curves/CurveBase.h"
 #include "Engine/DataTable.h"
+#include "Async/MappedFileHandle.h"
 #include "Engine/Texture2D.h"
 #include "MathVM.h"
 
+enum class EMathVMTextureAddress : uint8
+{
+	Wrap,
+	Clamp
+};
+
 class MATHVM_API FMathVMTexture2DResource : public IMathVMResource
 {
 public:
-	FMathVMTexture2DResource(UTexture2D* Texture);
+	FMathVMTexture2DResource(UTexture2D* Texture, const EMathVMTextureAddress InAddress = EMathVMTextureAddress::Wrap);
+
+	// channel, u, v, [mip] (nearest)
 	virtual double Read(const TArray<double>& Args) const override;
 	virtual void Write(const TArray<double>& Args) override;
 
+	// channel, u, v, [lod] (bilinear, trilinear when lod is specified)
+	virtual double Sample(const TArray<double>& Args) const override;
+
+	int32 GetNumMips() const;
+
+	// false when the first mip is not available (or its format is not supported), reads would always return 0
+	bool IsValid() const;
+
 protected:
-	TArray<uint8> Pixels;
-	int32 Width = 0;
-	int32 Height = 0;
-	EPixelFormat PixelFormat = EPixelFormat::PF_Unknown;
+	// pixels are converted to floats once and stored as one plane per channel
+	struct FMip
+	{
+		int32 Width = 0;
+		int32 Height = 0;
+		int32 NumChannels = 0;
+		TArray<float> Planes;
+
+		float GetTexel(const int32 Channel, const int32 X, const int32 Y) const;
+	};
+
+	bool CacheMip(const uint8* Data, const int64 DataSize, const int32 Width, const int32 Height, const EPixelFormat Format);
+#if WITH_EDITORONLY_DATA
+	bool CacheSourceMip(UTexture2D* Texture);
+#endif
+	void BuildMipChain();
+
+	int32 AddressTexel(const int32 Coordinate, const int32 Size) const;
+	double SampleBilinear(const FMip& Mip, const int32 Channel, const double U, const double V) const;
+
+	TArray<FMip> Mips;
+	EMathVMTextureAddress Address;
 };
 
 class MATHVM_API FMathVMCurveBaseResource : public IMathVMResource
 {
 public:
-	FMathVMCurveBaseResource(UCurveBase* Curve);
+	// when BakeResolution is > 1 each curve is sampled into a uniform lookup table (doubling the resolution until the error is below BakeTolerance).
+	// Times outside the curve range (and curves not meeting the tolerance) are evaluated exactly.
+	FMathVMCurveBaseResource(UCurveBase* Curve, const int32 BakeResolution = 0, const double BakeTolerance = 0);
 	virtual double Read(const TArray<double>& Args) const override;
 	virtual void Write(const TArray<double>& Args) override;
+	virtual int32 GetNumReadArgs() const override;
+	virtual void ReadBatch(TConstArrayView<double> Coordinates, const int32 NumCoordinates, TArrayView<double> Results) const override;
+
+	bool IsBaked(const int32 CurveIndex) const;
 
 protected:
+	struct FBakedCurve
+	{
+		double MinTime = 0;
+		double MaxTime = 0;
+		double SamplesPerUnit = 0;
+		TArray<double> Samples;
+	};
+
+	bool BakeCurve(const FRealCurve& Curve, const int32 BakeResolution, const double BakeTolerance, FBakedCurve& BakedCurve) const;
+	double Evaluate(const int32 CurveIndex, const double Time) const;
+
 	TArray<FRichCurveEditInfo> Curves;
+	TArray<FBakedCurve> BakedCurves;
 };
 
-class MATHVM_API FMathVMDoubleArrayResource : public IMathVMResource
+// per-thread accumulation buffers (each thread updates its own copy without atomics), merged by Flush()
+class MATHVM_API FMathVMPrivatizedBuffers
+{
+public:
+	FMathVMPrivatizedBuffers();
+
+	// 0 disables privatization (pending values are discarded)
+	void Reset(const int32 InNumElements);
+
+	bool IsEnabled() const;
+
+	// the buffer of the calling thread (allocated at the first call, then cached by the thread)
+	double* GetThreadBuffer();
+
+	// calls Merge for each element with a non zero accumulated value and clears the buffers (no thread can use the buffers while flushing)
+	void Flush(TFunctionRef<void(const int32 Index, const double Value)> Merge);
+
+protected:
+	// never reused, allows threads to cache their buffers
+	uint64 Id = 0;
+	int32 NumElements = 0;
+	FCriticalSection BuffersLock;
+	TArray<TUniquePtr<TArray<double>>> Buffers;
+	// owner of each buffer, a thread gets its buffer back when evicted from its cache
+	TArray<uint32> BufferThreadIds;
+};
+
+namespace MathVM
+{
+	namespace Utils
+	{
+		// compare and swap loop over the (same size) integer representation of the element, returns the previous value
+		template<typename ElementType, typename ConverterType, typename OperatorType>
+		double AtomicUpdate(ElementType& Element, OperatorType Operator)
+		{
+			using FIntType = typename TSignedIntType<sizeof(ElementType)>::Type;
+
+			volatile FIntType* Address = reinterpret_cast<volatile FIntType*>(&Element);
+			FIntType Comparand = FPlatformAtomics::AtomicRead(Address);
+			for (;;)
+			{
+				ElementType Current;
+				FMemory::Memcpy(&Current, &Comparand, sizeof(ElementType));
+				const double CurrentValue = ConverterType::ToDouble(Current);
+
+				const ElementType New = ConverterType::FromDouble(Operator(CurrentValue));
+				FIntType Exchange;
+				FMemory::Memcpy(&Exchange, &New, sizeof(ElementType));
+
+				const FIntType Previous = FPlatformAtomics::InterlockedCompareExchange(Address, Exchange, Comparand);
+				if (Previous == Comparand)
+				{
+					return CurrentValue;
+				}
+				Comparand = Previous;
+			}
+		}
+
+		// elements are converted in blocks (the conversion loop and the reduction can both be vectorized)
+		template<typename ElementType, typename ConverterType>
+		bool ReduceConverted(const EMathVMResourceReduction Reduction, const ElementType* Elements, const int64 NumElements, double& Result)
+		{
+			constexpr int64 BlockSize = 256;
+			double Block[BlockSize];
+
+			for (int64 BlockStart = 0; BlockStart < NumElements; BlockStart += BlockSize)
+			{
+				const int32 NumBlockElements = static_cast<int32>(FMath::Min(BlockSize, NumElements - BlockStart));
+				for (int32 ElementIndex = 0; ElementIndex < NumBlockElements; ElementIndex++)
+				{
+					Block[ElementIndex] = ConverterType::ToDouble(Elements[BlockStart + ElementIndex]);
+				}
+
+				double BlockResult = 0;
+				if (!Reduce(Reduction, TConstArrayView<double>(Block, NumBlockElements), BlockResult))
+				{
+					return false;
+				}
+
+				if (BlockStart == 0)
+				{
+					Result = BlockResult;
+				}
+				else if (Reduction == EMathVMResourceReduction::Sum)
+				{
+					Result += BlockResult;
+				}
+				else if (Reduction == EMathVMResourceReduction::Min)
+				{
+					Result = FMath::Min(Result, BlockResult);
+				}
+				else if (Reduction == EMathVMResourceReduction::Max)
+				{
+					Result = FMath::Max(Result, BlockResult);
+				}
+			}
+
+			return true;
+		}
+	}
+}
+
+// conversion between doubles and the element type of typed arrays
+template<typename ElementType>
+struct TMathVMArrayElement
+{
+	static double ToDouble(const ElementType Value)
+	{
+		return static_cast<double>(Value);
+	}
+
+	static ElementType FromDouble(const double Value)
+	{
+		return static_cast<ElementType>(Value);
+	}
+};
+
+template<>
+struct TMathVMArrayElement<FFloat16>
+{
+	static double ToDouble(const FFloat16 Value)
+	{
+		return Value.GetFloat();
+	}
+
+	static FFloat16 FromDouble(const double Value)
+	{
+		return FFloat16(static_cast<float>(Value));
+	}
+};
+
+template<>
+struct TMathVMArrayElement<int32>
+{
+	static double ToDouble(const int32 Value)
+	{
+		return Value;
+	}
+
+	// truncated (like a C cast) but saturated, NaN becomes 0
+	static int32 FromDouble(const double Value)
+	{
+		if (FMath::IsNaN(Value))
+		{
+			return 0;
+		}
+		return static_cast<int32>(FMath::Clamp(Value, static_cast<double>(MIN_int32), static_cast<double>(MAX_int32)));
+	}
+};
+
+// uint8 elements are normalized (0-255 maps to 0-1)
+template<>
+struct TMathVMArrayElement<uint8>
+{
+	static double ToDouble(const uint8 Value)
+	{
+		return Value / 255.0;
+	}
+
+	static uint8 FromDouble(const double Value)
+	{
+		if (FMath::IsNaN(Value))
+		{
+			return 0;
+		}
+		return static_cast<uint8>(FMath::RoundToInt(FMath::Clamp(Value, 0.0, 1.0) * 255.0));
+	}
+};
+
+// same read()/write() semantics of the Array of doubles but with a more compact storage (values are converted on access)
+template<typename ElementType>
+class TMathVMArrayResource : public IMathVMResource
+{
+public:
+	using FElement = TMathVMArrayElement<ElementType>;
+
+	TMathVMArrayResource(const int32 ArraySize)
+	{
+		Data.AddZeroed(ArraySize);
+	}
+
+	virtual double Read(const TArray<double>& Args) const override
+	{
+		if (Args.Num() < 1)
+		{
+			return 0;
+		}
+
+		const int32 Index = static_cast<int32>(Args[0]);
+		return Data.IsValidIndex(Index) ? FElement::ToDouble(Data[Index]) : 0;
+	}
+
+	virtual void Write(const TArray<double>& Args) override
+	{
+		if (Args.Num() < 2)
+		{
+			return;
+		}
+
+		const int32 Index = static_cast<int32>(Args[0]);
+		if (Data.IsValidIndex(Index))
+		{
+			Data[Index] = FElement::FromDouble(Args[1]);
+		}
+	}
+
+	virtual int32 GetNumReadArgs() const override
+	{
+		return 1;
+	}
+
+	virtual int32 GetNumWriteArgs() const override
+	{
+		return 2;
+	}
+
+	virtual void ReadBatch(TConstArrayView<double> Coordinates, const int32 NumCoordinates, TArrayView<double> Results) const override
+	{
+		if (NumCoordinates != 1)
+		{
+			IMathVMResource::ReadBatch(Coordinates, NumCoordinates, Results);
+			return;
+		}
+
+		const int32 NumElements = FMath::Min(Results.Num(), Coordinates.Num());
+		for (int32 ElementIndex = 0; ElementIndex < NumElements; ElementIndex++)
+		{
+			const int32 Index = static_cast<int32>(Coordinates[ElementIndex]);
+			Results[ElementIndex] = Data.IsValidIndex(Index) ? FElement::ToDouble(Data[Index]) : 0;
+		}
+	}
+
+	virtual void WriteBatch(TConstArrayView<double> Coordinates, const int32 NumCoordinates, TConstArrayView<double> Values) override
+	{
+		if (NumCoordinates != 1)
+		{
+			return;
+		}
+
+		const int32 NumElements = FMath::Min(Values.Num(), Coordinates.Num());
+		for (int32 ElementIndex = 0; ElementIndex < NumElements; ElementIndex++)
+		{
+			const int32 Index = static_cast<int32>(Coordinates[ElementIndex]);
+			if (Data.IsValidIndex(Index))
+			{
+				Data[Index] = FElement::FromDouble(Values[ElementIndex]);
+			}
+		}
+	}
+
+	virtual bool Reduce(const EMathVMResourceReduction Reduction, const int32 From, const int32 To, const TArray<double>& Args, double& Result) const override
+	{
+		if (!Args.IsEmpty() || From < 0 || To > Data.Num() || From >= To)
+		{
+			return false;
+		}
+
+		return MathVM::Utils::ReduceConverted<ElementType, FElement>(Reduction, Data.GetData() + From, To - From, Result);
+	}
+
+	virtual bool Atomic(const EMathVMResourceAtomic Operation, const TArray<double>& Args, double& Result) override
+	{
+		Result = 0;
+		if (Args.Num() < 2)
+		{
+			return true;
+		}
+
+		const int32 Index = static_cast<int32>(Args[0]);
+		if (!Data.IsValidIndex(Index))
+		{
+			return true;
+		}
+
+		const double Value = Args[1];
+
+		// privatized additions are accumulated without atomics (the previous value is not available)
+		if (Operation == EMathVMResourceAtomic::Add && PrivatizedBuffers.IsEnabled())
+		{
+			PrivatizedBuffers.GetThreadBuffer()[Index] += Value;
+			return true;
+		}
+
+		switch (Operation)
+		{
+		case(EMathVMResourceAtomic::Add):
+			Result = MathVM::Utils::AtomicUpdate<ElementType, FElement>(Data[Index], [Value](const double Current) { return Current + Value; });
+			break;
+		case(EMathVMResourceAtomic::Min):
+			Result = MathVM::Utils::AtomicUpdate<ElementType, FElement>(Data[Index], [Value](const double Current) { return FMath::Min(Current, Value); });
+			break;
+		case(EMathVMResourceAtomic::Max):
+			Result = MathVM::Utils::AtomicUpdate<ElementType, FElement>(Data[Index], [Value](const double Current) { return FMath::Max(Current, Value); });
+			break;
+		default:
+			return false;
+		}
+
+		return true;
+	}
+
+	virtual void Flush() override
+	{
+		PrivatizedBuffers.Flush([this](const int32 Index, const double Value)
+			{
+				Data[Index] = FElement::FromDouble(FElement::ToDouble(Data[Index]) + Value);
+			});
+	}
+
+	// atomic_add() is accumulated in per-thread copies of the array, merged by Flush()
+	void SetPrivatized(const bool bPrivatized)
+	{
+		Flush();
+		PrivatizedBuffers.Reset(bPrivatized ? Data.Num() : 0);
+	}
+
+	TConstArrayView<ElementType> GetData() const
+	{
+		return Data;
+	}
+
+	TArrayView<ElementType> GetData()
+	{
+		return Data;
+	}
+
+protected:
+	TArray<ElementType> Data;
+	FMathVMPrivatizedBuffers PrivatizedBuffers;
+};
+
+using FMathVMFloatArrayResource = TMathVMArrayResource<float>;
+using FMathVMHalfArrayResource = TMathVMArrayResource<FFloat16>;
+using FMathVMIntArrayResource = TMathVMArrayResource<int32>;
+using FMathVMByteArrayResource = TMathVMArrayResource<uint8>;
+
+class MATHVM_API FMathVMDoubleArrayResource : public TMathVMArrayResource<double>
 {
 public:
 	FMathVMDoubleArrayResource(const int32 ArraySize);
-	virtual double Read(const TArray<double>& Args) const override;
-	virtual void Write(const TArray<double>& Args) override;
+	virtual TConstArrayView<double> GetLinearView() const override;
+	virtual bool Reduce(const EMathVMResourceReduction Reduction, const int32 From, const int32 To, const TArray<double>& Args, double& Result) const override;
+};
+
+// read-only mapping of a whole file (pages are loaded by the OS on access)
+class MATHVM_API FMathVMMappedFile
+{
+public:
+	bool Open(const FString& Filename);
+	const uint8* GetData() const;
+	int64 GetSize() const;
+
+	// asks the OS to page in the specified range (sequential access hint)
+	void PreloadHint(const int64 Offset, const int64 Size) const;
+
+protected:
+	// the region must be released before the handle
+	TUniquePtr<IMappedFileHandle> Handle;
+	TUniquePtr<IMappedFileRegion> Region;
+};
+
+// raw binary file of ElementType values addressed like an Array (read(id, index)), no load step is required.
+// When bCopyOnWrite is true, write() updates a private copy of the touched pages (the file is never modified), otherwise it is ignored.
+// Pages are published with a lock free page table, so reads and writes can run concurrently (like the other arrays, concurrent writes
+// to the same element are not ordered).
+template<typename ElementType>
+class TMathVMMappedFileResource : public IMathVMResource
+{
+public:
+	using FElement = TMathVMArrayElement<ElementType>;
+
+	TMathVMMappedFileResource(const FString& Filename, const bool bInCopyOnWrite = false) : bCopyOnWrite(bInCopyOnWrite)
+	{
+		if (MappedFile.Open(Filename))
+		{
+			Elements = reinterpret_cast<const ElementType*>(MappedFile.GetData());
+			NumElements = MappedFile.GetSize() / sizeof(ElementType);
+			if (bCopyOnWrite)
+			{
+				NumPages = (NumElements + PageSize - 1) / PageSize;
+				Pages = MakeUnique<std::atomic<ElementType*>[]>(NumPages);
+			}
+		}
+	}
+
+	TMathVMMappedFileResource(const TMathVMMappedFileResource&) = delete;
+	TMathVMMappedFileResource& operator=(const TMathVMMappedFileResource&) = delete;
+
+	virtual ~TMathVMMappedFileResource()
+	{
+		for (int64 PageIndex = 0; PageIndex < NumPages; PageIndex++)
+		{
+			delete[] Pages[PageIndex].load(std::memory_order_relaxed);
+		}
+	}
+
+	bool IsValid() const
+	{
+		return Elements != nullptr;
+	}
+
+	int64 Num() const
+	{
+		return NumElements;
+	}
+
+	virtual double Read(const TArray<double>& Args) const override
+	{
+		if (Args.Num() < 1)
+		{
+			return 0;
+		}
+
+		const int64 Index = static_cast<int64>(Args[0]);
+		return Index >= 0 && Index < NumElements ? GetValue(Index) : 0;
+	}
+
+	virtual void Write(const TArray<double>& Args) override
+	{
+		if (!bCopyOnWrite || Args.Num() < 2)
+		{
+			return;
+		}
+
+		const int64 Index = static_cast<int64>(Args[0]);
+		if (Index < 0 || Index >= NumElements)
+		{
+			return;
+		}
+
+		const int64 PageIndex = Index / PageSize;
+		ElementType* Page = Pages[PageIndex].load(std::memory_order_acquire);
+		if (!Page)
+		{
+			// the copy is published only if no other thread published its own in the meantime
+			const int64 PageStart = PageIndex * PageSize;
+			ElementType* NewPage = new ElementType[PageSize];
+			FMemory::Memcpy(NewPage, Elements + PageStart, FMath::Min(PageSize, NumElements - PageStart) * sizeof(ElementType));
+			if (Pages[PageIndex].compare_exchange_strong(Page, NewPage, std::memory_order_acq_rel, std::memory_order_acquire))
+			{
+				Page = NewPage;
+				NumDirtyPages.fetch_add(1, std::memory_order_release);
+			}
+			else
+			{
+				delete[] NewPage;
+			}
+		}
+
+		Page[Index - PageIndex * PageSize] = FElement::FromDouble(Args[1]);
+	}
+
+	virtual int32 GetNumReadArgs() const override
+	{
+		return 1;
+	}
+
+	virtual int32 GetNumWriteArgs() const override
+	{
+		return 2;
+	}
+
+	virtual void ReadBatch(TConstArrayView<double> Coordinates, const int32 NumCoordinates, TArrayView<double> Results) const override
+	{
+		if (NumCoordinates != 1)
+		{
+			IMathVMResource::ReadBatch(Coordinates, NumCoordinates, Results);
+			return;
+		}
+
+		const int32 NumResults = FMath::Min(Results.Num(), Coordinates.Num());
+		for (int32 ResultIndex = 0; ResultIndex < NumResults; ResultIndex++)
+		{
+			const int64 Index = static_cast<int64>(Coordinates[ResultIndex]);
+			Results[ResultIndex] = Index >= 0 && Index < NumElements ? GetValue(Index) : 0;
+		}
+	}
+
+	virtual bool Reduce(const EMathVMResourceReduction Reduction, const int32 From, const int32 To, const TArray<double>& Args, double& Result) const override
+	{
+		// modified pages fallback to the VM reduction
+		if (!Args.IsEmpty() || NumDirtyPages.load(std::memory_order_acquire) > 0 || From < 0 || To > NumElements || From >= To)
+		{
+			return false;
+		}
+
+		Prefetch(From, To);
+		return MathVM::Utils::ReduceConverted<ElementType, FElement>(Reduction, Elements + From, To - From, Result);
+	}
+
+	// hints the OS to page in the [From, To) range of elements (useful before sequential scans)
+	void Prefetch(const int64 From, const int64 To) const
+	{
+		const int64 ClampedFrom = FMath::Clamp<int64>(From, 0, NumElements);
+		const int64 ClampedTo = FMath::Clamp<int64>(To, ClampedFrom, NumElements);
+		if (ClampedTo > ClampedFrom)
+		{
+			MappedFile.PreloadHint(ClampedFrom * sizeof(ElementType), (ClampedTo - ClampedFrom) * sizeof(ElementType));
+		}
+	}
 
 protected:
-	TArray<double> Data;
+	// copy on write granularity (in elements)
+	static constexpr int64 PageSize = 4096;
+
+	double GetValue(const int64 Index) const
+	{
+		if (NumPages > 0)
+		{
+			if (const ElementType* Page = Pages[Index / PageSize].load(std::memory_order_acquire))
+			{
+				return FElement::ToDouble(Page[Index % PageSize]);
+			}
+		}
+		return FElement::ToDouble(Elements[Index]);
+	}
+
+	FMathVMMappedFile MappedFile;
+	const ElementType* Elements = nullptr;
+	int64 NumElements = 0;
+	bool bCopyOnWrite = false;
+	// one slot for each page (null until the first write to the page)
+	TUniquePtr<std::atomic<ElementType*>[]> Pages;
+	int64 NumPages = 0;
+	std::atomic<int32> NumDirtyPages = 0;
 };
 
+using FMathVMMappedFloatFileResource = TMathVMMappedFileResource<float>;
+using FMathVMMappedDoubleFileResource = TMathVMMappedFileResource<double>;
+using FMathVMMappedIntFileResource = TMathVMMappedFileResource<int32>;
+
 class MATHVM_API FMathVMDataTableResource : public IMathVMResource
 {
 public:
 	FMathVMDataTableResource(UDataTable* DataTable, const TArray<FString>& FieldNames);
 	virtual double Read(const TArray<double>& Args) const override;
 	virtual void Write(const TArray<double>& Args) override;
+	virtual int32 GetNumReadArgs() const override;
+	virtual void ReadBatch(TConstArrayView<double> Coordinates, const int32 NumCoordinates, TArrayView<double> Results) const override;
+	virtual bool Reduce(const EMathVMResourceReduction Reduction, const int32 From, const int32 To, const TArray<double>& Args, double& Result) const override;
+
+	// row names are resolved on the first coordinate, field names on the second one
+	virtual bool ResolveArgument(const int32 Coordinate, const FString& Name, double& Value) const override;
+
+	int32 GetNumRows() const;
+	int32 GetRowIndex(const FName& RowName) const;
+	int32 GetFieldIndex(const FString& FieldName) const;
+
+	// all of the values of a field (in row order)
+	TConstArrayView<double> GetColumn(const int32 FieldIndex) const;
 
 protected:
-	TArray<TArray<double>> Data;
+	// one contiguous array for each field
+	TArray<TArray<double>> Columns;
+	int32 NumRows = 0;
+	TMap<FName, int32> RowIndices;
+	TMap<FString, int32> FieldIndices;
 };
\ No newline at end of file
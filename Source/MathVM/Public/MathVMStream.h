@@ -0,0 +1,63 @@
+// Copyright 2024, Roberto De Ioris.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MathVM.h"
+
+enum class EMathVMStreamFormat : uint8
+{
+	// a header line with the column names followed by comma separated values
+	Csv,
+	// input: a block of NumRows doubles for each column (columnar), output: a sequence of doubles for each row (interleaved)
+	Binary
+};
+
+struct MATHVM_API FMathVMStreamConfig
+{
+	FString InputFilename;
+	EMathVMStreamFormat InputFormat = EMathVMStreamFormat::Csv;
+	// names of the columns of a binary input (csv columns are read from the header line)
+	TArray<FString> InputColumns;
+
+	FString OutputFilename;
+	EMathVMStreamFormat OutputFormat = EMathVMStreamFormat::Csv;
+	// variables (local or global) written to the output for each row
+	TArray<FString> OutputVariables;
+
+	// number of rows evaluated at once (memory usage is bounded by two chunks)
+	int32 ChunkSize = 16384;
+};
+
+// Evaluates an already compiled VM for each row of an input file (columns are mapped to local variables).
+// Chunks are evaluated in parallel while the next chunk is read and the previous results are written.
+class MATHVM_API FMathVMStreamEvaluator
+{
+public:
+	FMathVMStreamEvaluator(FMathVMBase& InMathVM, const FMathVMStreamConfig& InConfig);
+
+	bool Run();
+
+	const FString& GetError() const;
+
+	int64 GetNumRows() const;
+
+protected:
+	struct FChunk
+	{
+		int32 NumRows = 0;
+		// row-major
+		TArray<double> Inputs;
+		TArray<double> Outputs;
+	};
+
+	bool EvaluateChunk(FChunk& Chunk);
+
+	bool SetError(const FString& InError);
+
+	FMathVMBase& MathVM;
+	FMathVMStreamConfig Config;
+	TArray<FString> Columns;
+	int64 NumRows = 0;
+	FString Error;
+};
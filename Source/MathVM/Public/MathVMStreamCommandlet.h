@@ -0,0 +1,22 @@
+// Copyright 2024, Roberto De Ioris.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "MathVMStreamCommandlet.generated.h"
+
+/**
+ * Streams an input file through a MathVM expression:
+ * -run=MathVMStream -Code=<file> (or -Expression="...") -Input=<file> -Output=<file> -Outputs=x,y [-InputFormat=csv|binary] [-Columns=a,b] [-OutputFormat=csv|binary] [-ChunkSize=N]
+ */
+UCLASS()
+class MATHVM_API UMathVMStreamCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UMathVMStreamCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};